@@ -30,7 +30,21 @@ help() {
 	echo "    -P[picker]    Set the pick algorithm, seperated by ':', \"slow:fast:cfd\""
 	echo "                    mx(max), tt(trapezoid-top), le(leading-edge)"
 	echo "                    zcl(zero-cross-linear), zcc(zero-cross-cubic)"
+	echo "                    uzl(upsample-zero-cross-linear), uzc(upsample-zero-cross-cubic)"
 	echo "                    dfl(digital-fraction-linear), dfc(digital-fraction-cubic)"
+	echo "    -u[factor]    Set the upsampling factor of uz cfd picker, default is 8."
+	echo "    -i[points]    Set the pile-up inspection window, default is 0(disabled)."
+	echo "    -j            Skip slow and cfd stages of the piled up traces."
+	echo "    -o[points]    Set the retrigger holdoff of multi-hit mode, default is 0(disabled)."
+	echo "    -k[workers]   Set the pipeline workers of each tree simulator, default is 0(serial)."
+	echo "    -d[backend]   Set the output backend, ttree, rntuple or columnar, default is ttree."
+	echo "    -c            Write all configurations into one shared table."
+	echo "    -n            Run all configurations again, ignore the result cache."
+	echo "    -y[entries]   Set the checkpoint interval of the sweep, default is 100000, 0 for configurations only."
+	echo "    -x[processes] Set the worker processes of the sweep, default is 0(threads)."
+	echo "    -S            Decode the trace once into shared memory for all runs on the node."
+	echo "    -q[configs]   Set the configurations run in one pass over the trace, default is 1(alone), no checkpoint within a pass."
+	echo "    -T            Estimate ST from the tails of the traces instead of sweeping it."
 	echo ""
 	echo "Produced by pwl."
 	exit
@@ -51,8 +65,21 @@ runFlagStr="all"
 multiThread=false
 entries=0
 verbose=false
+upsample=8
+pileupWindow=0
+pileupReject=false
+hitHoldoff=0
+pipelineWorkers=0
+outputBackend="ttree"
+outputMode="files"
+useCache=true
+checkpointEntries=100000
+processes=0
+sharedTrace=false
+fuse=1
+estimateTau=false
 
-while getopts ":v :h :V :m r: p: s: f: b: w: z: a: l: g: e: t: F: P:" flag;
+while getopts ":v :h :V :m r: p: s: f: b: w: z: a: l: g: e: t: F: P: u: i: :j o: k: d: :c :n y: x: :S q: :T" flag;
 do
 	case $flag in
 		h) # display help
@@ -113,6 +140,32 @@ do
 			fi;;
 		m) # run in multi-thread mode
 			multiThread=true;;
+		u) # set the upsampling factor of cfd picker
+			upsample=$OPTARG;;
+		i) # set the pile-up inspection window
+			pileupWindow=$OPTARG;;
+		j) # reject the piled up traces
+			pileupReject=true;;
+		o) # set the retrigger holdoff of multi-hit mode
+			hitHoldoff=$OPTARG;;
+		k) # set the pipeline workers
+			pipelineWorkers=$OPTARG;;
+		d) # set the output backend
+			outputBackend=$OPTARG;;
+		c) # write one shared table
+			outputMode="shared";;
+		n) # ignore the result cache
+			useCache=false;;
+		y) # set the checkpoint interval
+			checkpointEntries=$OPTARG;;
+		x) # set the worker processes
+			processes=$OPTARG;;
+		S) # read the traces from shared memory
+			sharedTrace=true;;
+		q) # set the configurations of one pass
+			fuse=$OPTARG;;
+		T) # estimate the decay constant
+			estimateTau=true;;
 		\?) # Invalid option
         	echo "Error: Invalid option"
         	help;;
@@ -234,6 +287,8 @@ elif [[ ${cfdPickerType:0:2} == "zc" ]]; then
 	cfdPickerType="zero-cross"
 elif [[ ${cfdPickerType:0:2} == "df" ]]; then
 	cfdPickerType="digital-fraction"
+elif [[ ${cfdPickerType:0:2} == "uz" ]]; then
+	cfdPickerType="upsample-zero-cross"
 else
 	echo "Error: invalid cfd picker type ${cfdPickerType} (flag -P)"
 	help
@@ -258,6 +313,16 @@ echo "trace  ${traceStart}  ${traceLen}  ${zeroPoint}"
 # prepare paramters
 rootDir=$(pwd)
 rootDir=${rootDir%bin}
+
+# output backend, rntuple only if sim is built with it
+if [[ ${outputBackend} != "ttree" && ${outputBackend} != "rntuple" && ${outputBackend} != "columnar" ]]; then
+	echo "Error: invalid output backend ${outputBackend} (flag -d)"
+	help
+fi
+if [[ ${outputBackend} == "rntuple" ]] && ! grep -q "^DEFINES.*-DSIM_RNTUPLE" ${rootDir}main/Makefile; then
+	echo "Error: output backend rntuple needs -DSIM_RNTUPLE in DEFINES of main/Makefile (flag -d)"
+	help
+fi
 dataPath=${rootDir}data/$project/
 rawPath="/data/TestData/decode/"
 tracePath=${dataPath}
@@ -300,6 +365,9 @@ sed -i "/^.*SinglePath.*/c\	\"SinglePath\": \"${singlePath}\"," ${configFile}
 sed -i "/^.*TimeResPath.*/c\	\"TimeResPath\": \"${timeResPath}\"," ${configFile}
 # edit cache path
 sed -i "/^.*CachePath.*/c\	\"CachePath\": \"${cachePath}\"," ${configFile}
+sed -i "/^.*\"Cache\":.*/c\	\"Cache\": ${useCache}," ${configFile}
+# edit checkpoint interval
+sed -i "/^.*CheckpointEntries.*/c\	\"CheckpointEntries\": ${checkpointEntries}," ${configFile}
 # edit fbw
 sed -i "/^.*fbw.*/c\	\"fbw\": ${width}," ${configFile}
 # edit strip counts
@@ -325,10 +393,33 @@ sed -i "/^.*SlowPicker.*/c\	\"SlowPicker\": \"${slowPickerType}\"," ${configFile
 sed -i "/^.*FastPicker.*/c\	\"FastPicker\": \"${fastPickerType}\"," ${configFile}
 sed -i "/^.*CFDPicker.*/c\	\"CFDPicker\": \"${cfdPickerType}\"," ${configFile}
 sed -i "/^.*CFDCubic.*/c\	\"CFDCubic\": ${cfdCubic}," ${configFile}
+sed -i "/^.*CFDUpsample.*/c\	\"CFDUpsample\": ${upsample}," ${configFile}
+# add it to the configs without it, after the opening brace
+grep -q '"CFDUpsample"' ${configFile} || sed -i "0,/^{/s/^{/{\n\t\"CFDUpsample\": ${upsample},/" ${configFile}
+# edit pile-up options
+sed -i "/^.*PileupWindow.*/c\	\"PileupWindow\": ${pileupWindow}," ${configFile}
+sed -i "/^.*PileupReject.*/c\	\"PileupReject\": ${pileupReject}," ${configFile}
+# edit multi-hit holdoff
+sed -i "/^.*HitHoldoff.*/c\	\"HitHoldoff\": ${hitHoldoff}," ${configFile}
+# edit pipeline workers
+sed -i "/^.*PipelineWorkers.*/c\	\"PipelineWorkers\": ${pipelineWorkers}," ${configFile}
+# edit output backend
+sed -i "/^.*OutputBackend.*/c\	\"OutputBackend\": \"${outputBackend}\"," ${configFile}
+sed -i "/^.*OutputMode.*/c\	\"OutputMode\": \"${outputMode}\"," ${configFile}
 # edit verbose
 sed -i "/^.*Verbose.*/c\	\"Verbose\": ${verbose}," ${configFile}
 # edit multi-thread option
 sed -i "/^.*MultiThread.*/c\	\"MultiThread\": ${multiThread}," ${configFile}
+# edit worker processes
+sed -i "/^.*\"Processes\":.*/c\	\"Processes\": ${processes}," ${configFile}
+# edit shared trace option
+sed -i "/^.*SharedTrace.*/c\	\"SharedTrace\": ${sharedTrace}," ${configFile}
+# edit fused configurations
+sed -i "/^.*\"Fuse\":.*/c\	\"Fuse\": ${fuse}," ${configFile}
+# edit the decay constant to estimate it
+if [ "$estimateTau" == "true" ]; then
+	sed -i "/^.*\"ST\":.*/c\	\"ST\": \"auto\"," ${configFile}
+fi
 
 # save the config file
 cp ${configFile} ${dataPath}config.json
@@ -0,0 +1,91 @@
+#ifndef __CPUTOPOLOGY_H__
+#define __CPUTOPOLOGY_H__
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+// CPUs of each NUMA node
+//  Read from /sys on linux and limited to the cpus this process may run on,
+//  so a container or taskset sees only its own cpus. Without the nodes in
+//  /sys all cpus are one node.
+
+struct CpuTopology {
+	std::vector<std::vector<int>> nodes;
+
+	static CpuTopology Detect();
+	// cpus of a list like "0-3,8,10-11"
+	static std::vector<int> ParseList(const std::string &list);
+	// cpus this process may run on
+	static std::vector<int> Allowed();
+};
+
+
+inline CpuTopology CpuTopology::Detect() {
+	std::vector<int> allowed = Allowed();
+	CpuTopology topology;
+	std::vector<std::pair<int, std::vector<int>>> found;
+	std::error_code error;
+	for (auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+		std::string name = entry.path().filename().string();
+		if (name.size() <= 4 || name.compare(0, 4, "node") != 0) continue;
+		if (name.find_first_not_of("0123456789", 4) != std::string::npos) continue;
+		std::ifstream input(entry.path() / "cpulist");
+		std::string list;
+		if (!std::getline(input, list)) continue;
+		std::vector<int> cpus;
+		for (int cpu : ParseList(list)) {
+			if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) cpus.push_back(cpu);
+		}
+		if (cpus.size()) found.emplace_back(std::stoi(name.substr(4)), cpus);
+	}
+	std::sort(found.begin(), found.end());
+	for (auto &node : found) topology.nodes.push_back(node.second);
+	if (topology.nodes.empty()) topology.nodes.push_back(allowed);
+	return topology;
+}
+
+
+inline std::vector<int> CpuTopology::ParseList(const std::string &list) {
+	std::vector<int> cpus;
+	std::stringstream stream(list);
+	std::string range;
+	while (std::getline(stream, range, ',')) {
+		if (range.find_first_of("0123456789") == std::string::npos) continue;
+		size_t dash = range.find('-');
+		int first = std::stoi(range.substr(0, dash));
+		int last = dash == std::string::npos ? first : std::stoi(range.substr(dash+1));
+		for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+
+inline std::vector<int> CpuTopology::Allowed() {
+	std::vector<int> cpus;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+		}
+	}
+#endif
+	if (cpus.empty()) {
+		unsigned int count = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned int cpu = 0; cpu != count; ++cpu) cpus.push_back(int(cpu));
+	}
+	return cpus;
+}
+
+#endif
@@ -0,0 +1,404 @@
+#ifndef __WORKSTEALINGPOOL_H__
+#define __WORKSTEALINGPOOL_H__
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "CpuTopology.h"
+
+
+// Work stealing thread pool
+//  Every worker owns a deque, runs its own tasks from the back and steals from
+//  the front of the others when it runs out, the workers of its NUMA node
+//  first. A task is a function pointer and an argument, so parallel_for queues
+//  one task for each worker and the chunks are claimed by atomic counters
+//  without any allocation. The thread waiting for a parallel_for runs the
+//  queued tasks meanwhile, so a loop nested in a task doesn't block a worker.
+//
+//  With an affinity the workers are spread over the nodes in turn and pinned,
+//  and parallel_for deals the chunks to the nodes in turn, so each node works
+//  on its own share and steals from the others only at the end. The memory a
+//  task allocates is then on its node by the first touch, and the threads it
+//  starts inherit the pinning.
+
+class WorkStealingPool {
+public:
+	enum class Affinity {
+		None,			// threads float, one node
+		Core,			// each worker on one core
+		Node			// each worker on the cores of its node, the threads it starts too
+	};
+
+	/*
+	 * constructor
+	 *  @threads: Workers, at least 1.
+	 *  @affinity_: Pinning of the workers, only on linux.
+	 */
+	WorkStealingPool(size_t threads, Affinity affinity_ = Affinity::None);
+	// run all queued tasks and join the workers
+	~WorkStealingPool();
+
+	// "none", "core" or "node"
+	static Affinity ParseAffinity(const std::string &name);
+
+	// run f(args...) in the pool, the future throws the exception of it
+	template<class F, class... Args>
+	auto enqueue(F &&f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type>;
+
+	/*
+	 * parallel_for
+	 *  Run body(begin, end) on the chunks of grain indices of [first, last) in
+	 *  the workers and the calling thread, and wait for all of them. Chunk c
+	 *  belongs to the node c % nodes, and the chunks of a node are claimed in
+	 *  order, so the first indices start first on every node.
+	 *
+	 *  @body: Called with the range of a chunk, from any thread.
+	 *  @return: The first exception of the body is thrown here, the chunks not
+	 *    started then are skipped.
+	 */
+	template<class F>
+	void parallel_for(size_t first, size_t last, size_t grain, F &&body);
+
+	size_t size() const;
+	// nodes the workers are spread over, 1 without affinity
+	size_t nodes() const;
+	// node of the calling worker, 0 for other threads
+	static size_t CurrentNode();
+	// node of the calling worker, or of the cpu another thread runs on, a node
+	// without workers counts as node % nodes()
+	size_t ThreadNode() const;
+private:
+	struct Task {
+		void (*run)(void*);
+		void *arg;
+	};
+
+	struct alignas(64) Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// into the own queue in a worker, round robin from other threads
+	void Push(const Task &task);
+	// the back of the queue of the index, or the front of another one, the same node first
+	bool Pop(Task &task, size_t index);
+	// index of the queue of this thread, the count of queues if not a worker
+	size_t Index() const;
+	void Work(size_t index, std::vector<int> cpus);
+
+	Affinity affinity;
+	size_t nodeCount;
+	std::vector<size_t> workerNodes;
+	// topology node of each cpu, empty without affinity
+	std::vector<size_t> cpuNodes;
+	// queues to steal from for each worker, and for other threads at the end
+	std::vector<std::vector<size_t>> victims;
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> queued;
+	std::atomic<size_t> next;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stop;
+
+	static inline thread_local const WorkStealingPool *current = nullptr;
+	static inline thread_local size_t currentIndex = 0;
+	static inline thread_local size_t currentNode = 0;
+};
+
+
+inline WorkStealingPool::WorkStealingPool(size_t threads, Affinity affinity_) {
+	if (!threads) threads = 1;
+	affinity = affinity_;
+	queued.store(0);
+	next.store(0);
+	stop = false;
+
+	// worker i on the node i % nodes, on the (i / nodes)-th core of it
+	CpuTopology topology;
+	if (affinity == Affinity::None) {
+		topology.nodes.push_back(std::vector<int>());
+	} else {
+		topology = CpuTopology::Detect();
+	}
+	nodeCount = std::min(topology.nodes.size(), threads);
+	if (affinity != Affinity::None) {
+		for (size_t node = 0; node != topology.nodes.size(); ++node) {
+			for (int cpu : topology.nodes[node]) {
+				if (size_t(cpu) >= cpuNodes.size()) cpuNodes.resize(cpu + 1, 0);
+				cpuNodes[cpu] = node;
+			}
+		}
+	}
+	std::vector<std::vector<int>> workerCpus(threads);
+	for (size_t i = 0; i != threads; ++i) {
+		size_t node = i % nodeCount;
+		workerNodes.push_back(node);
+		const std::vector<int> &cpus = topology.nodes[node];
+		if (affinity == Affinity::Core) {
+			workerCpus[i].push_back(cpus[(i / nodeCount) % cpus.size()]);
+		} else if (affinity == Affinity::Node) {
+			workerCpus[i] = cpus;
+		}
+	}
+	for (size_t i = 0; i <= threads; ++i) {
+		std::vector<size_t> order;
+		for (size_t k = 1; k <= threads; ++k) {
+			size_t other = (i + k) % (threads + 1);
+			if (other == threads) continue;
+			order.push_back(other);
+		}
+		if (i != threads) {
+			std::stable_partition(order.begin(), order.end(), [&](size_t other) {
+				return workerNodes[other] == workerNodes[i];
+			});
+		}
+		victims.push_back(order);
+	}
+
+	for (size_t i = 0; i != threads; ++i) queues.push_back(std::make_unique<Queue>());
+	for (size_t i = 0; i != threads; ++i) {
+		workers.emplace_back([this, i, cpus = workerCpus[i]]() { Work(i, cpus); });
+	}
+}
+
+
+inline WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) worker.join();
+}
+
+
+inline WorkStealingPool::Affinity WorkStealingPool::ParseAffinity(const std::string &name) {
+	if (name == "none") return Affinity::None;
+	if (name == "core") return Affinity::Core;
+	if (name == "node") return Affinity::Node;
+	throw std::runtime_error("Error: invalid affinity " + name + ", none, core or node.");
+}
+
+
+template<class F, class... Args>
+auto WorkStealingPool::enqueue(F &&f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type> {
+	using ReturnType = typename std::result_of<F(Args...)>::type;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		if (stop) throw std::runtime_error("Error: enqueue on stopped pool.");
+	}
+	auto task = new std::packaged_task<ReturnType()>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+	std::future<ReturnType> result = task->get_future();
+	Push(Task{[](void *arg) {
+		auto packaged = (std::packaged_task<ReturnType()>*)arg;
+		(*packaged)();
+		delete packaged;
+	}, task});
+	return result;
+}
+
+
+template<class F>
+void WorkStealingPool::parallel_for(size_t first, size_t last, size_t grain, F &&body) {
+	if (last <= first) return;
+	if (!grain) grain = 1;
+
+	// on the stack of the caller, which waits until no task refers to it
+	struct Loop {
+		size_t first;
+		size_t last;
+		size_t grain;
+		size_t chunks;
+		size_t nodes;
+		// chunks claimed of each node, chunk k * nodes + node
+		std::unique_ptr<std::atomic<size_t>[]> claimed;
+		// helpers not finished, the last one signals done under doneMutex
+		std::atomic<size_t> pending;
+		std::mutex doneMutex;
+		std::condition_variable done;
+		std::mutex errorMutex;
+		std::exception_ptr error;
+		typename std::remove_reference<F>::type *body;
+
+		// the chunks of the own node, then the ones left on the others
+		void RunChunks(size_t node) {
+			for (size_t n = 0; n != nodes; ++n) {
+				size_t share = (node + n) % nodes;
+				for (;;) {
+					size_t chunk = claimed[share].fetch_add(1, std::memory_order_relaxed) * nodes + share;
+					if (chunk >= chunks) break;
+					size_t begin = first + chunk * grain;
+					size_t end = std::min(begin + grain, last);
+					try {
+						(*body)(begin, end);
+					} catch (...) {
+						std::lock_guard<std::mutex> lock(errorMutex);
+						if (!error) error = std::current_exception();
+						for (size_t s = 0; s != nodes; ++s) claimed[s].store(chunks, std::memory_order_relaxed);
+					}
+				}
+			}
+		}
+	};
+	Loop loop;
+	loop.first = first;
+	loop.last = last;
+	loop.grain = grain;
+	loop.chunks = (last - first + grain - 1) / grain;
+	loop.nodes = nodeCount;
+	loop.claimed = std::make_unique<std::atomic<size_t>[]>(nodeCount);
+	for (size_t n = 0; n != nodeCount; ++n) loop.claimed[n].store(0);
+	loop.body = &body;
+
+	size_t helpers = std::min(workers.size(), loop.chunks - 1);
+	loop.pending.store(helpers);
+	for (size_t h = 0; h != helpers; ++h) {
+		Push(Task{[](void *arg) {
+			Loop *l = (Loop*)arg;
+			l->RunChunks(CurrentNode());
+			// notified under the lock, the caller can't return and free the loop before
+			std::lock_guard<std::mutex> lock(l->doneMutex);
+			if (l->pending.fetch_sub(1, std::memory_order_release) == 1) l->done.notify_all();
+		}, &loop});
+	}
+	loop.RunChunks(ThreadNode());
+
+	// the helpers not started yet still refer to the loop, run queued tasks
+	// until all are taken, then sleep until the last running one is done
+	size_t index = Index();
+	while (loop.pending.load(std::memory_order_acquire)) {
+		Task task;
+		if (Pop(task, index)) {
+			task.run(task.arg);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(loop.doneMutex);
+		loop.done.wait(lock, [&loop]() {
+			return !loop.pending.load(std::memory_order_acquire);
+		});
+	}
+	// the last helper may still be in the notify when pending is seen 0 unlocked
+	{
+		std::lock_guard<std::mutex> lock(loop.doneMutex);
+	}
+	if (loop.error) std::rethrow_exception(loop.error);
+}
+
+
+inline size_t WorkStealingPool::size() const {
+	return workers.size();
+}
+
+
+inline size_t WorkStealingPool::nodes() const {
+	return nodeCount;
+}
+
+
+inline size_t WorkStealingPool::CurrentNode() {
+	return currentNode;
+}
+
+
+inline size_t WorkStealingPool::ThreadNode() const {
+	if (Index() != queues.size()) return currentNode;
+#ifdef __linux__
+	int cpu = sched_getcpu();
+	if (cpu >= 0 && size_t(cpu) < cpuNodes.size()) return cpuNodes[cpu] % nodeCount;
+#endif
+	return 0;
+}
+
+
+// a helper of parallel_for from another thread goes to the workers in turn, so every node gets some
+inline void WorkStealingPool::Push(const Task &task) {
+	size_t index = Index();
+	if (index == queues.size()) index = next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(task);
+		queued.fetch_add(1, std::memory_order_release);
+	}
+	// a worker checks the count under the lock before sleeping, so the wake is never lost
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+
+inline bool WorkStealingPool::Pop(Task &task, size_t index) {
+	if (index < queues.size()) {
+		Queue &own = *queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = own.tasks.back();
+			own.tasks.pop_back();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	for (size_t other : victims[index]) {
+		Queue &queue = *queues[other];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+inline size_t WorkStealingPool::Index() const {
+	return current == this ? currentIndex : queues.size();
+}
+
+
+inline void WorkStealingPool::Work(size_t index, std::vector<int> cpus) {
+	current = this;
+	currentIndex = index;
+	currentNode = workerNodes[index];
+#ifdef __linux__
+	if (cpus.size()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : cpus) CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+	for (;;) {
+		Task task;
+		if (Pop(task, index)) {
+			task.run(task.arg);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this]() {
+			return stop || queued.load(std::memory_order_acquire) > 0;
+		});
+		if (stop && !queued.load(std::memory_order_acquire)) return;
+	}
+}
+
+#endif
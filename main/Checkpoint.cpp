@@ -0,0 +1,92 @@
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+
+#include "Checkpoint.h"
+
+
+//--------------------------------------------------
+//					SweepCheckpoint
+//--------------------------------------------------
+
+SweepCheckpoint::SweepCheckpoint(const std::string &fileName_, const std::string &sweep_) {
+	fileName = fileName_;
+	sweep = sweep_;
+	std::ifstream input(fileName);
+	if (input.good()) {
+		try {
+			input >> journal;
+		} catch (const std::exception &) {
+			// broken journal, start again
+			journal = nlohmann::json();
+		}
+	}
+	if (!journal.is_object() || !journal.contains("Sweep") || journal["Sweep"] != sweep) {
+		journal = nlohmann::json::object();
+		journal["Sweep"] = sweep;
+		journal["Configs"] = nlohmann::json::object();
+	}
+}
+
+
+SweepCheckpoint::~SweepCheckpoint() {
+}
+
+
+bool SweepCheckpoint::IsCompleted(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto &configs = journal["Configs"];
+	return configs.contains(name) && bool(configs[name]["Completed"]);
+}
+
+
+nlohmann::json SweepCheckpoint::GetExtra(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto &configs = journal["Configs"];
+	if (!configs.contains(name) || !configs[name].contains("Extra")) return nlohmann::json::object();
+	return configs[name]["Extra"];
+}
+
+
+unsigned long long SweepCheckpoint::GetProgress(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto &configs = journal["Configs"];
+	if (!configs.contains(name)) return 0;
+	return configs[name]["Entries"];
+}
+
+
+void SweepCheckpoint::SetProgress(const std::string &name, unsigned long long entries) {
+	std::lock_guard<std::mutex> lock(mutex);
+	journal["Configs"][name] = {{"Entries", entries}, {"Completed", false}};
+	Save();
+}
+
+
+void SweepCheckpoint::Complete(const std::string &name, const nlohmann::json &extra) {
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned long long entries = journal["Configs"].contains(name) ? (unsigned long long)(journal["Configs"][name]["Entries"]) : 0;
+	journal["Configs"][name] = {{"Entries", entries}, {"Completed", true}, {"Extra", extra}};
+	Save();
+}
+
+
+void SweepCheckpoint::Remove() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::remove(fileName.c_str());
+}
+
+
+// rename replaces the old journal atomically on POSIX
+void SweepCheckpoint::Save() {
+	std::string temporary = fileName + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::trunc);
+		output << journal.dump(1, '\t') << std::endl;
+		output.flush();
+		if (!output) throw std::runtime_error("Error: write checkpoint " + temporary + ".");
+	}
+	if (std::rename(temporary.c_str(), fileName.c_str())) {
+		throw std::runtime_error("Error: rename checkpoint " + temporary + ".");
+	}
+}
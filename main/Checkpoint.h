@@ -0,0 +1,46 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <string>
+#include <mutex>
+
+#include "../lib/json.hpp"
+
+
+// Journal of a sweep for resuming it
+//  Keeps the entries saved of each configuration in progress and the
+//  configurations completed, written to a temporary file and renamed on each
+//  change so a crash leaves either the old or the new journal. The journal of
+//  another sweep is dropped when opened.
+
+class SweepCheckpoint {
+public:
+	/*
+	 * constructor
+	 *  @fileName_: Path of the journal.
+	 *  @sweep_: Key of the sweep, a journal of another key is dropped.
+	 */
+	SweepCheckpoint(const std::string &fileName_, const std::string &sweep_);
+	virtual ~SweepCheckpoint();
+
+	virtual bool IsCompleted(const std::string &name) const;
+	// extra results of a completed configuration
+	virtual nlohmann::json GetExtra(const std::string &name) const;
+	// entries saved of the configuration, 0 if none
+	virtual unsigned long long GetProgress(const std::string &name) const;
+	virtual void SetProgress(const std::string &name, unsigned long long entries);
+	// mark the configuration completed with the extra results
+	virtual void Complete(const std::string &name, const nlohmann::json &extra = nlohmann::json::object());
+	// remove the journal after the whole sweep completed
+	virtual void Remove();
+private:
+	// write the journal atomically, under the lock
+	void Save();
+
+	mutable std::mutex mutex;
+	std::string fileName;
+	std::string sweep;
+	nlohmann::json journal;
+};
+
+#endif
@@ -0,0 +1,315 @@
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Daemon.h"
+
+
+// set by SIGINT and SIGTERM
+static volatile sig_atomic_t daemonStopping = 0;
+
+static void StopDaemon(int) {
+	daemonStopping = 1;
+}
+
+
+// the address of the path, throw if it's too long
+static sockaddr_un SocketAddress(const std::string &path) {
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("Error: socket path " + path + " too long.");
+	}
+	std::strcpy(address.sun_path, path.c_str());
+	return address;
+}
+
+
+// write it all, false if the reader is gone
+static bool WriteAll(int fd, const std::string &text) {
+	size_t written = 0;
+	while (written < text.size()) {
+		ssize_t n = write(fd, text.data() + written, text.size() - written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		written += size_t(n);
+	}
+	return true;
+}
+
+
+//--------------------------------------------------
+//					SimDaemon
+//--------------------------------------------------
+
+SimDaemon::SimDaemon(const std::string &path_, size_t jobs_) {
+	path = path_;
+	jobs = jobs_ ? jobs_ : 1;
+	starts = 0;
+	sockaddr_un address = SocketAddress(path);
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) throw std::runtime_error("Error: create socket " + path + ".");
+	unlink(path.c_str());
+	// a sweep runs as the owner of the daemon, so only the owner may send one
+	mode_t mask = umask(0077);
+	int bound = bind(listenFd, (sockaddr*)&address, sizeof(address));
+	umask(mask);
+	if (bound != 0 || listen(listenFd, 16) != 0) {
+		close(listenFd);
+		throw std::runtime_error("Error: listen on socket " + path + ".");
+	}
+	fcntl(listenFd, F_SETFL, O_NONBLOCK);
+}
+
+
+SimDaemon::~SimDaemon() {
+	for (auto &client : receiving) close(client.fd);
+	for (auto &client : queue) close(client.fd);
+	close(listenFd);
+	unlink(path.c_str());
+}
+
+
+void SimDaemon::Serve(const Prepare &prepare, const Run &run) {
+	// no restart, so poll returns on the signals
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = StopDaemon;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	// a client gone shows up as an error of the write
+	signal(SIGPIPE, SIG_IGN);
+	std::cout << "Serve sweeps on " << path << ", " << jobs << " at a time" << std::endl;
+
+	while (!daemonStopping) {
+		std::vector<pollfd> fds{{listenFd, POLLIN, 0}};
+		for (auto &client : receiving) fds.push_back({client.fd, POLLIN, 0});
+		// the exit of a child isn't polled, so wake up now and then
+		if (poll(fds.data(), fds.size(), 200) < 0 && errno != EINTR) {
+			throw std::runtime_error("Error: poll socket " + path + ".");
+		}
+
+		if (fds[0].revents & POLLIN) {
+			for (;;) {
+				int fd = accept(listenFd, nullptr, nullptr);
+				if (fd < 0) break;
+				// the mode of the socket could be changed, check the peer too
+				ucred credentials;
+				socklen_t size = sizeof(credentials);
+				if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0 || credentials.uid != geteuid()) {
+					WriteAll(fd, "Error: the daemon only runs the sweeps of its owner.\n");
+					Finish(fd, 1);
+					continue;
+				}
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				pid_t session = getsid(credentials.pid);
+				std::string submitter = "session " + std::to_string(session > 0 ? session : credentials.pid);
+				receiving.push_back(Client{fd, "", submitter, std::chrono::steady_clock::now()});
+			}
+		}
+		auto now = std::chrono::steady_clock::now();
+		for (size_t i = 1; i != fds.size(); ++i) {
+			Client &client = receiving[i-1];
+			if (!fds[i].revents) {
+				if (now - client.active > std::chrono::seconds(ReceiveTimeout)) {
+					WriteAll(client.fd, "Error: no request received in " + std::to_string(ReceiveTimeout) + " s, shut the writing down after it.\n");
+					Finish(client.fd, 1);
+					client.fd = -1;
+				}
+				continue;
+			}
+			if (Receive(client)) continue;
+			if (client.fd >= 0) queue.push_back(client);
+			client.fd = -1;
+		}
+		receiving.erase(std::remove_if(receiving.begin(), receiving.end(), [](const Client &client) {
+			return client.fd < 0;
+		}), receiving.end());
+
+		for (;;) {
+			int status;
+			int pid = waitpid(-1, &status, WNOHANG);
+			if (pid <= 0) break;
+			auto iter = running.find(pid);
+			if (iter == running.end()) continue;
+			Finish(iter->second.fd, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+			running.erase(iter);
+		}
+
+		while (running.size() < jobs && queue.size()) {
+			auto next = Next();
+			Client client = *next;
+			queue.erase(next);
+			lastStart[client.submitter] = ++starts;
+			Start(client, prepare, run);
+		}
+	}
+
+	std::cout << "Stop serving, wait for " << running.size() << " running sweeps" << std::endl;
+	for (auto &client : queue) Finish(client.fd, 128 + SIGTERM);
+	queue.clear();
+	for (auto &job : running) {
+		int status;
+		waitpid(job.first, &status, 0);
+		Finish(job.second.fd, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+	}
+	running.clear();
+}
+
+
+bool SimDaemon::Receive(Client &client) {
+	char buffer[4096];
+	for (;;) {
+		ssize_t n = read(client.fd, buffer, sizeof(buffer));
+		if (n > 0) {
+			client.request.append(buffer, size_t(n));
+			client.active = std::chrono::steady_clock::now();
+			continue;
+		}
+		if (n == 0) return false;
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+		close(client.fd);
+		client.fd = -1;
+		return false;
+	}
+}
+
+
+// the earliest one of the submitter with the fewest running, of them the one
+// started longest ago, so each session gets its turn whatever it queued
+std::deque<SimDaemon::Client>::iterator SimDaemon::Next() {
+	auto next = queue.end();
+	std::pair<size_t, unsigned long long> best;
+	for (auto iter = queue.begin(); iter != queue.end(); ++iter) {
+		size_t count = 0;
+		for (auto &job : running) {
+			if (job.second.submitter == iter->submitter) ++count;
+		}
+		auto last = lastStart.find(iter->submitter);
+		std::pair<size_t, unsigned long long> rank(count, last == lastStart.end() ? 0 : last->second);
+		if (next == queue.end() || rank < best) {
+			next = iter;
+			best = rank;
+		}
+	}
+	return next;
+}
+
+
+void SimDaemon::Start(Client &client, const Prepare &prepare, const Run &run) {
+	fcntl(client.fd, F_SETFL, 0);
+	nlohmann::json js;
+	try {
+		js = nlohmann::json::parse(client.request);
+		prepare(js);
+	} catch (const std::exception &e) {
+		WriteAll(client.fd, std::string(e.what()) + "\n");
+		Finish(client.fd, 1);
+		return;
+	}
+
+	// the buffered output would be written by both processes
+	std::cout.flush();
+	std::cerr.flush();
+	std::fflush(nullptr);
+	int pid = fork();
+	if (pid < 0) {
+		WriteAll(client.fd, "Error: fork the sweep.\n");
+		Finish(client.fd, 1);
+		return;
+	}
+	if (pid) {
+		running[pid] = client;
+		return;
+	}
+
+	// the other clients see the end of their output only when no process holds their socket
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+	close(listenFd);
+	for (auto &other : receiving) close(other.fd);
+	for (auto &other : queue) close(other.fd);
+	for (auto &job : running) close(job.second.fd);
+	dup2(client.fd, STDOUT_FILENO);
+	dup2(client.fd, STDERR_FILENO);
+	close(client.fd);
+	int code = 1;
+	try {
+		code = run(js);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+	}
+	std::cout.flush();
+	std::cerr.flush();
+	std::fflush(nullptr);
+	// no exit handlers and destructors on the state copied from the daemon
+	_exit(code);
+}
+
+
+void SimDaemon::Finish(int fd, int status) {
+	WriteAll(fd, std::string(StatusPrefix) + std::to_string(status) + "\n");
+	close(fd);
+}
+
+
+int SimDaemon::Request(const std::string &path, const std::string &configFileName) {
+	std::ifstream configFile(configFileName);
+	if (!configFile.good()) throw std::runtime_error("Error open file " + configFileName + ".");
+	std::stringstream request;
+	request << configFile.rdbuf();
+
+	sockaddr_un address = SocketAddress(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+		if (fd >= 0) close(fd);
+		throw std::runtime_error("Error: connect to the daemon on " + path + ".");
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (!WriteAll(fd, request.str())) {
+		close(fd);
+		throw std::runtime_error("Error: send the request to the daemon on " + path + ".");
+	}
+	shutdown(fd, SHUT_WR);
+
+	// the lines as they come, except the status line
+	int status = -1;
+	std::string line;
+	char buffer[4096];
+	for (;;) {
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		for (ssize_t i = 0; i != n; ++i) {
+			line += buffer[i];
+			if (buffer[i] != '\n') continue;
+			if (line.compare(0, std::strlen(StatusPrefix), StatusPrefix) == 0) {
+				status = std::atoi(line.c_str() + std::strlen(StatusPrefix));
+			} else {
+				std::cout << line << std::flush;
+			}
+			line.clear();
+		}
+	}
+	close(fd);
+	std::cout << line << std::flush;
+	if (status < 0) throw std::runtime_error("Error: the daemon on " + path + " ended without a status.");
+	return status;
+}
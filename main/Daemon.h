@@ -0,0 +1,84 @@
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <functional>
+
+#include "../lib/json.hpp"
+
+
+// Daemon serving sweeps over a Unix domain socket
+//  A client sends the json of a sweep and shuts its writing down. The daemon
+//  queues the request and runs it in a forked child writing its output to the
+//  socket, so the client reads the output as it's written and the exit status
+//  in the last line. The daemon keeps ROOT started and whatever the prepare
+//  step loads, and the children get it by the fork. Up to jobs requests run at
+//  a time. The next one is the earliest request of the submitter with the
+//  fewest running, and of them the one started longest ago, a submitter being
+//  the login session of the client process, so the sessions take turns and a
+//  script queueing many sweeps doesn't hold back the others. The
+//  socket is only open to the owner of the daemon, since the sweeps run as the
+//  owner. A client that sends nothing for ReceiveTimeout is dropped.
+
+class SimDaemon {
+public:
+	// in the daemon before the fork, e.g. to load the traces, may throw
+	using Prepare = std::function<void(nlohmann::json&)>;
+	// in the child, returns the exit status
+	using Run = std::function<int(nlohmann::json&)>;
+
+	/*
+	 * constructor
+	 *  @path_: Path of the socket, an old socket there is replaced.
+	 *  @jobs_: Requests running at a time, at least 1.
+	 */
+	SimDaemon(const std::string &path_, size_t jobs_);
+	// remove the socket
+	virtual ~SimDaemon();
+
+	// serve the requests until SIGINT or SIGTERM, the running ones are waited for
+	virtual void Serve(const Prepare &prepare, const Run &run);
+
+	// send the config file to the daemon, print the output and return the exit status
+	static int Request(const std::string &path, const std::string &configFileName);
+
+	// last line of the output of a request
+	static constexpr const char *StatusPrefix = "sim-daemon: exit ";
+	// seconds a client may send nothing before its request is complete
+	static constexpr int ReceiveTimeout = 30;
+private:
+	struct Client {
+		int fd;
+		std::string request;
+		std::string submitter;								// session of the client process
+		std::chrono::steady_clock::time_point active;		// last data received
+	};
+
+	// read what the client sent, false once it's all there, the fd is -1 if the client is gone
+	bool Receive(Client &client);
+	// the next request to run, of the submitter with the fewest running, then served longest ago
+	std::deque<Client>::iterator Next();
+	// fork the child running the request, or answer the error of a bad one
+	void Start(Client &client, const Prepare &prepare, const Run &run);
+	// the status line and the end of the output
+	static void Finish(int fd, int status);
+
+	std::string path;
+	size_t jobs;
+	int listenFd;
+	// clients still sending
+	std::vector<Client> receiving;
+	// requests waiting, in the order they arrived, run fairly by Next
+	std::deque<Client> queue;
+	// children running and their clients
+	std::map<int, Client> running;
+	// start count of the last request started of each submitter
+	std::map<std::string, unsigned long long> lastStart;
+	unsigned long long starts;
+};
+
+#endif
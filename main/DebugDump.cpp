@@ -0,0 +1,129 @@
+#include <stdexcept>
+
+#include "DebugDump.h"
+
+
+// names of the branches of each stage
+static const char *stageNames[DebugDump::Stages] = {"trace", "fast", "slow", "cfd"};
+
+
+//--------------------------------------------------
+//					DebugDump
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @mode_: Sampling policy of the entries.
+ *  @n_: Entries of First, interval of Every, max entries of Failed.
+ *  @batchSize_: Entries in one entry of the dump tree.
+ */
+DebugDump::DebugDump(Mode mode_, unsigned int n_, size_t batchSize_) {
+	mode = mode_;
+	n = n_;
+	batchSize = batchSize_ ? batchSize_ : 1;
+	predicate = nullptr;
+	tree = nullptr;
+	dt = 0.0;
+	dumped = 0;
+	data.resize(Stages);
+	offsets.resize(Stages);
+	for (auto &offset : offsets) offset.push_back(0);
+}
+
+
+DebugDump::~DebugDump() {
+}
+
+
+void DebugDump::SetPredicate(std::function<bool(unsigned int, bool)> predicate_) {
+	predicate = predicate_;
+}
+
+
+/*
+ * Open
+ *  Create the dump tree in the file, the branches point to the buffers.
+ *
+ *  @file: The output file.
+ *  @dt_: Time of one point in ns, written with each batch.
+ */
+void DebugDump::Open(TFile *file, double dt_) {
+	dt = dt_;
+	file->cd();
+	tree = new TTree("dump", "sampled stage outputs");
+	tree->Branch("dt", &dt, "dt/D");
+	tree->Branch("entry", &entries);
+	for (size_t s = 0; s != Stages; ++s) {
+		tree->Branch(stageNames[s], &data[s]);
+		tree->Branch((std::string(stageNames[s])+"Offset").c_str(), &offsets[s]);
+	}
+}
+
+
+// Select the entry by the predicate or the mode
+bool DebugDump::Select(unsigned int entry, bool failed) {
+	if (predicate) return predicate(entry, failed);
+	switch (mode) {
+		case Mode::First:
+			return entry < n;
+		case Mode::Every:
+			return n && entry % n == 0;
+		case Mode::Failed:
+			return failed && dumped < n;
+	}
+	return false;
+}
+
+
+/*
+ * Add
+ *  Append the outputs to the arrays of the batch, and fill the batch when
+ *  it's full.
+ *
+ *  @entry: Index of the entry.
+ *  @outputs: Outputs indexed by Stage, null for stages not run.
+ */
+void DebugDump::Add(unsigned int entry, const std::vector<const std::vector<double>*> &outputs) {
+	if (!tree) throw std::runtime_error("Error: debug dump is not opened.");
+	entries.push_back(int(entry));
+	for (size_t s = 0; s != Stages; ++s) {
+		if (s < outputs.size() && outputs[s]) {
+			data[s].insert(data[s].end(), outputs[s]->begin(), outputs[s]->end());
+		}
+		offsets[s].push_back((unsigned int)data[s].size());
+	}
+	++dumped;
+	if (entries.size() >= batchSize) Flush();
+}
+
+
+void DebugDump::Close() {
+	if (!tree) return;
+	if (entries.size()) Flush();
+	tree->Write();
+	tree = nullptr;
+}
+
+
+size_t DebugDump::GetDumped() const {
+	return dumped;
+}
+
+
+DebugDump::Mode DebugDump::ParseMode(const std::string &name) {
+	if (name == "first") return Mode::First;
+	if (name == "every") return Mode::Every;
+	if (name == "failed") return Mode::Failed;
+	throw std::runtime_error("Error: invalid debug dump mode " + name + ".");
+}
+
+
+// Fill the batch and clear the buffers, they keep the capacity
+void DebugDump::Flush() {
+	tree->Fill();
+	entries.clear();
+	for (size_t s = 0; s != Stages; ++s) {
+		data[s].clear();
+		offsets[s].assign(1, 0);
+	}
+}
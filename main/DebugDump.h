@@ -0,0 +1,70 @@
+#ifndef __DEBUGDUMP_H__
+#define __DEBUGDUMP_H__
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "TFile.h"
+#include "TTree.h"
+
+
+// Sampled debug dump of the stage outputs
+//  Selects the entries by a policy and buffers the raw trace and the filter
+//  outputs of a batch of them in contiguous arrays, one per stage. Each batch
+//  is one entry of the "dump" tree, the offsets give the range of each dumped
+//  entry in the arrays, and a stage not run on the entry has an empty range.
+
+class DebugDump {
+public:
+	// stages dumped, indexes of the outputs
+	enum Stage {
+		Trace = 0,
+		Fast,
+		Slow,
+		CFD,
+		Stages
+	};
+
+	// sampling policy
+	enum class Mode: int {
+		First = 0,				// the first n entries
+		Every,					// every n-th entry
+		Failed					// entries with a failed pick, at most n
+	};
+
+	DebugDump(Mode mode_, unsigned int n_, size_t batchSize_ = 64);
+	virtual ~DebugDump();
+
+	// replace the mode, the arguments are the entry and whether any pick failed
+	virtual void SetPredicate(std::function<bool(unsigned int, bool)> predicate_);
+	// create the dump tree in the file
+	virtual void Open(TFile *file, double dt_);
+	// whether the entry should be dumped
+	virtual bool Select(unsigned int entry, bool failed);
+	// add outputs of the stages indexed by Stage, null for stages not run
+	virtual void Add(unsigned int entry, const std::vector<const std::vector<double>*> &outputs);
+	// fill the buffered batch and write the tree
+	virtual void Close();
+	virtual size_t GetDumped() const;
+
+	// parse the mode from "first", "every" or "failed"
+	static Mode ParseMode(const std::string &name);
+private:
+	virtual void Flush();
+
+	Mode mode;
+	unsigned int n;
+	size_t batchSize;
+	std::function<bool(unsigned int, bool)> predicate;
+
+	TTree *tree;
+	double dt;
+	size_t dumped;
+	// batch buffers, the branches point to them
+	std::vector<int> entries;
+	std::vector<std::vector<double>> data;
+	std::vector<std::vector<unsigned int>> offsets;
+};
+
+#endif
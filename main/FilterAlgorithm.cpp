@@ -1,6 +1,17 @@
 #include "FilterAlgorithm.h"
 #include <iostream>
 #include <cmath>
+#include <stdexcept>
+#include <cstdio>
+#include <typeinfo>
+
+
+// double in the signature, exact enough to tell the parameters apart
+static std::string Number(double x) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.17g", x);
+	return buffer;
+}
 
 
 //--------------------------------------------------
@@ -28,6 +39,30 @@ std::unique_ptr<FilterAlgorithm> FilterAlgorithm::Clone() const {
 	return std::make_unique<FilterAlgorithm>();
 }
 
+
+std::string FilterAlgorithm::Signature() const {
+	if (typeid(*this) == typeid(FilterAlgorithm)) return "empty";
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%p", (const void*)this);
+	return std::string("unshared(") + typeid(*this).name() + "," + buffer + ")";
+}
+
+
+// copy of the trace
+double FilterAlgorithm::Cost(size_t samples) const {
+	return double(samples);
+}
+
+
+std::unique_ptr<FilterAlgorithm> FilterAlgorithm::InputFilter() const {
+	return nullptr;
+}
+
+
+const std::vector<double>& FilterAlgorithm::FilterInput(const std::vector<double> &input) {
+	return Filter(input);
+}
+
 //--------------------------------------------------
 // 				SlowFilter
 //--------------------------------------------------
@@ -89,6 +124,17 @@ std::unique_ptr<FilterAlgorithm> MWDAlgorithm::Clone() const {
 }
 
 
+std::string MWDAlgorithm::Signature() const {
+	return "mwd(" + std::to_string(l) + "," + std::to_string(m) + "," + Number(alpha) + ")";
+}
+
+
+// recursive, the windows only in the preparing
+double MWDAlgorithm::Cost(size_t samples) const {
+	return 5.0 * double(samples) + 3.0 * double(l+m);
+}
+
+
 
 // MWD filter
 const std::vector<double>& MWDAlgorithm::Filter(const std::vector<double> &trace) {
@@ -189,51 +235,40 @@ std::unique_ptr<FilterAlgorithm> XiaSlowFilter::Clone() const {
 }
 
 
+std::string XiaSlowFilter::Signature() const {
+	return "xia-slow(" + std::to_string(l) + "," + std::to_string(m) + "," + Number(b) + ")";
+}
+
+
+// three running sums, the windows summed twice for the base
+double XiaSlowFilter::Cost(size_t samples) const {
+	return 8.0 * double(samples) + 2.0 * double(l+m);
+}
+
+
 const std::vector<double> &XiaSlowFilter::Filter(const std::vector<double> &trace) {
+	XiaSlowSums::Sum(trace, l, m, sums);
+	return FilterInput(sums);
+}
+
+
+std::unique_ptr<FilterAlgorithm> XiaSlowFilter::InputFilter() const {
+	return std::make_unique<XiaSlowSums>(l, m);
+}
+
+
+// the base is the sums at l+m, the windows before the first output
+const std::vector<double> &XiaSlowFilter::FilterInput(const std::vector<double> &input) {
 	double c0 = -(1.0-b) * 4.0 * pow(b, double(l))  / (1.0 - pow(b, double(l)));
 	double c1 = (1.0-b) * 4.0;
 	double c2 = (1.0-b) * 4.0 / (1.0 - pow(b, double(l)));
-// std::cout << "b = " << b << std::endl;
-// std::cout << "c0= " << c0 << std::endl;
-// std::cout << "c1= " << c1 << std::endl;
-// std::cout << "c2= " << c2 << std::endl;
-
-	// compute base
-	double bsum0, bsum1, bsum2;
-	bsum0 = bsum1 = bsum2 = 0.0;
-	for (size_t i = 0; i < l; ++i) {
-		bsum0 += trace[i];
-	}
-	for (size_t i = l; i != m; ++i) {
-		bsum1 += trace[i];
-	}
-	for (size_t i = m; i != m+l; ++i) {
-		bsum2 += trace[i];
-	}
-	double cbase = c0*bsum0 + c1*bsum1 + c2*bsum2;
 
-	// compute filter result
-	data.resize(trace.size());
-	double esum0, esum1, esum2;
-	esum0 = esum1 = esum2 = 0.0;
-	for (size_t i = 0; i != l; ++i) {
-		esum0 += trace[i];
-	}
-	for (size_t i = l; i != m; ++i) {
-		esum1 += trace[i];
-	}
-	for (size_t i = m; i != l+m; ++i) {
-		esum2 += trace[i];
-	}
-	data[l+m] = c0*esum0 + c1*esum1 + c2*esum2 - cbase;
-
-	size_t tsize = trace.size();
-	for (size_t i = l+m+1; i != tsize; ++i) {
-		esum0 += trace[i-m] - trace[i-l-m-1];
-		esum1 += trace[i-l] - trace[i-m-1];
-		esum2 += trace[i-1] - trace[i-l-1];
-
-		data[i] = c0*esum0 + c1*esum1 + c2*esum2 - cbase;
+	size_t tsize = input.size() / 3;
+	data.resize(tsize);
+	const double *s = input.data() + 3*(l+m);
+	double cbase = c0*s[0] + c1*s[1] + c2*s[2];
+	for (size_t i = l+m; i != tsize; ++i, s += 3) {
+		data[i] = c0*s[0] + c1*s[1] + c2*s[2] - cbase;
 	}
 	for (size_t i = 0; i != l+m; ++i) {
 		data[i] = data[l+m];
@@ -263,6 +298,73 @@ void XiaSlowFilter::SetParameters(size_t l_, size_t m_, unsigned int tau, unsign
 
 
 
+//--------------------------------------------------
+// 				XiaSlowSums
+//--------------------------------------------------
+
+
+XiaSlowSums::XiaSlowSums(size_t l_, size_t m_):
+FilterAlgorithm(), l(l_), m(m_) {
+}
+
+
+XiaSlowSums::~XiaSlowSums() {
+}
+
+
+std::unique_ptr<FilterAlgorithm> XiaSlowSums::Clone() const {
+	return std::make_unique<XiaSlowSums>(l, m);
+}
+
+
+std::string XiaSlowSums::Signature() const {
+	return "xia-sums(" + std::to_string(l) + "," + std::to_string(m) + ")";
+}
+
+
+double XiaSlowSums::Cost(size_t samples) const {
+	return 6.0 * double(samples) + 2.0 * double(l+m);
+}
+
+
+const std::vector<double> &XiaSlowSums::Filter(const std::vector<double> &trace) {
+	Sum(trace, l, m, data);
+	return data;
+}
+
+
+void XiaSlowSums::Sum(const std::vector<double> &trace, size_t l, size_t m, std::vector<double> &sums) {
+	size_t tsize = trace.size();
+	sums.resize(3 * tsize);
+	double esum0, esum1, esum2;
+	esum0 = esum1 = esum2 = 0.0;
+	for (size_t i = 0; i != l; ++i) {
+		esum0 += trace[i];
+	}
+	for (size_t i = l; i != m; ++i) {
+		esum1 += trace[i];
+	}
+	for (size_t i = m; i != l+m; ++i) {
+		esum2 += trace[i];
+	}
+	double *s = sums.data() + 3*(l+m);
+	s[0] = esum0;
+	s[1] = esum1;
+	s[2] = esum2;
+	for (size_t i = l+m+1; i != tsize; ++i) {
+		esum0 += trace[i-m] - trace[i-l-m-1];
+		esum1 += trace[i-l] - trace[i-m-1];
+		esum2 += trace[i-1] - trace[i-l-1];
+		s += 3;
+		s[0] = esum0;
+		s[1] = esum1;
+		s[2] = esum2;
+	}
+	return;
+}
+
+
+
 //--------------------------------------------------
 // 				FastFilter
 //--------------------------------------------------
@@ -333,6 +435,16 @@ std::unique_ptr<FilterAlgorithm> XiaFastFilter::Clone() const {
 }
 
 
+std::string XiaFastFilter::Signature() const {
+	return "xia-fast(" + std::to_string(l) + "," + std::to_string(m) + ")";
+}
+
+
+double XiaFastFilter::Cost(size_t samples) const {
+	return 5.0 * double(samples) + 2.0 * double(l+m);
+}
+
+
 const std::vector<double> &XiaFastFilter::Filter(const std::vector<double> &trace) {
 	// DC offset
 	double offset = 0.0;
@@ -398,11 +510,30 @@ std::unique_ptr<FilterAlgorithm> XiaCFDFilter::Clone() const {
 }
 
 
+std::string XiaCFDFilter::Signature() const {
+	return "xia-cfd(" + std::to_string(l) + "," + std::to_string(m) + "," + std::to_string(d) + "," + std::to_string(w) + ")";
+}
+
+
+// the own fast filter and the delayed difference
+double XiaCFDFilter::Cost(size_t samples) const {
+	return fastFilter.Cost(samples) + 3.0 * double(samples);
+}
+
+
 // Filter
 // CFD[i] = FF[i]*(1-w/8) - FF[i-D]
 const std::vector<double> &XiaCFDFilter::Filter(const std::vector<double> &trace) {
-	const std::vector<double> &fast = fastFilter.Filter(trace);
+	return FilterInput(fastFilter.Filter(trace));
+}
+
+
+std::unique_ptr<FilterAlgorithm> XiaCFDFilter::InputFilter() const {
+	return fastFilter.Clone();
+}
+
 
+const std::vector<double> &XiaCFDFilter::FilterInput(const std::vector<double> &fast) {
 	double factor  = 1.0 - double(w) / 8.0;
 	size_t vsize = fast.size();
 	data.resize(vsize);
@@ -443,4 +574,123 @@ void XiaCFDFilter::SetParameters(size_t l_, size_t m_, size_t d_, unsigned int w
 void XiaCFDFilter::SetFastFilterParameters(size_t l_, size_t m_) {
 	SetParameters(l_, m_, d, w);
 	return;
-}
\ No newline at end of file
+}
+
+
+//--------------------------------------------------
+//				PolyphaseUpsampler
+//--------------------------------------------------
+
+// constructor
+//  @factor_: upsampling factor, points between two samples is factor_-1
+//  @taps_: taps of each phase, the half of it is taken from each side
+PolyphaseUpsampler::PolyphaseUpsampler(unsigned int factor_, size_t taps_):
+FilterAlgorithm(), factor(factor_), taps(taps_) {
+	if (factor == 0) throw std::runtime_error("Error: PolyphaseUpsampler's factor is 0.");
+	if (taps < 2 || taps % 2) throw std::runtime_error("Error: PolyphaseUpsampler's taps should be even: " + std::to_string(taps) + ".");
+
+	// coefficients of phase p at tap j weight the sample at offset k = j-taps/2+1,
+	// h_p[j] = sinc(p/factor - k) * blackman(p/factor - k), normalized to unit DC gain
+	const double pi = 3.14159265358979323846;
+	const double half = double(taps / 2);
+	auto coeff = std::make_shared<std::vector<double>>(factor * taps);
+	for (unsigned int p = 0; p != factor; ++p) {
+		double *c = coeff->data() + p * taps;
+		double sum = 0.0;
+		for (size_t j = 0; j != taps; ++j) {
+			double x = double(p) / double(factor) - (double(j) - half + 1.0);
+			double sinc = x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+			double blackman = 0.42 + 0.5 * cos(pi * x / half) + 0.08 * cos(2.0 * pi * x / half);
+			c[j] = sinc * blackman;
+			sum += c[j];
+		}
+		for (size_t j = 0; j != taps; ++j) {
+			c[j] /= sum;
+		}
+	}
+	coefficients = coeff;
+}
+
+// deconstructor
+PolyphaseUpsampler::~PolyphaseUpsampler() {
+}
+
+
+// clone, share the coefficients
+std::unique_ptr<FilterAlgorithm> PolyphaseUpsampler::Clone() const {
+	return std::make_unique<PolyphaseUpsampler>(*this);
+}
+
+
+std::string PolyphaseUpsampler::Signature() const {
+	return "upsample(" + std::to_string(factor) + "," + std::to_string(taps) + ")";
+}
+
+
+// taps of one phase for each output point
+double PolyphaseUpsampler::Cost(size_t samples) const {
+	return double(samples) * double(factor) * double(taps);
+}
+
+
+// upsample the whole trace
+const std::vector<double> &PolyphaseUpsampler::Filter(const std::vector<double> &trace) {
+	return Upsample(trace, 0, trace.size());
+}
+
+
+// Upsample
+//  Upsample the samples in [begin, end). The output data[k] is the value
+//  at the position begin + k/factor, so its size is (end-begin-1)*factor+1.
+//  Samples out of the trace are replaced by the edge samples.
+const std::vector<double> &PolyphaseUpsampler::Upsample(const std::vector<double> &trace, size_t begin, size_t end) {
+	if (end > trace.size() || begin >= end) {
+		throw std::runtime_error("Error: PolyphaseUpsampler's range overflow: data size: " + std::to_string(trace.size()) + ", begin: " + std::to_string(begin) + ", end: " + std::to_string(end) + ".");
+	}
+	size_t points = end - begin;
+	long long half = taps / 2;
+	long long last = trace.size() - 1;
+
+	// copy the samples with the edges padded, window[i] = trace[begin-half+1+i]
+	window.resize(points + taps - 1);
+	for (size_t i = 0; i != window.size(); ++i) {
+		long long index = (long long)begin - half + 1 + (long long)i;
+		index = index < 0 ? 0 : (index > last ? last : index);
+		window[i] = trace[index];
+	}
+
+	// kernel, loop over the output points in the inner loop so it vectorizes
+	data.resize(points * factor);
+	phase.resize(points);
+	const double *w = window.data();
+	double *y = phase.data();
+	for (unsigned int p = 0; p != factor; ++p) {
+		const double *c = coefficients->data() + p * taps;
+		for (size_t n = 0; n != points; ++n) {
+			y[n] = 0.0;
+		}
+		for (size_t j = 0; j != taps; ++j) {
+			const double cj = c[j];
+			const double *wj = w + j;
+			for (size_t n = 0; n != points; ++n) {
+				y[n] += cj * wj[n];
+			}
+		}
+		for (size_t n = 0; n != points; ++n) {
+			data[n*factor+p] = y[n];
+		}
+	}
+	data.resize((points-1) * factor + 1);
+
+	return data;
+}
+
+
+unsigned int PolyphaseUpsampler::GetFactor() const {
+	return factor;
+}
+
+
+size_t PolyphaseUpsampler::GetTaps() const {
+	return taps;
+}
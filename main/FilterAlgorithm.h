@@ -15,6 +15,15 @@ public:
 
 	virtual const std::vector<double>& Filter(const std::vector<double> &trace);
 	virtual std::unique_ptr<FilterAlgorithm> Clone() const;
+	// type and parameters, the same for filters giving the same output, the outputs of the same
+	// signature are shared, so a derived filter without its own gets one unique to the object
+	virtual std::string Signature() const;
+	// rough operations to filter a trace of samples points, to schedule the runs
+	virtual double Cost(size_t samples) const;
+	// filter of the intermediate output the filter is computed from, null if from the trace
+	virtual std::unique_ptr<FilterAlgorithm> InputFilter() const;
+	// the output from the intermediate output, or from the trace if none
+	virtual const std::vector<double>& FilterInput(const std::vector<double> &input);
 protected:
 	// filtered data
 	std::vector<double> data;
@@ -42,6 +51,8 @@ public:
 	MWDAlgorithm(unsigned int L, unsigned int G, unsigned int tau, unsigned int dt);
 	virtual ~MWDAlgorithm();
 	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
 
 	virtual const std::vector<double>& Filter(const std::vector<double> &trace) override;
 
@@ -60,13 +71,39 @@ public:
 	XiaSlowFilter(unsigned int L, unsigned int G, unsigned int tau, unsigned int dt);
 	virtual ~XiaSlowFilter();
 	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
 
 	virtual const std::vector<double> &Filter(const std::vector<double> &trace) override;
+	// from the running sums of the windows, shared by the filters of other decay constants
+	virtual std::unique_ptr<FilterAlgorithm> InputFilter() const override;
+	virtual const std::vector<double> &FilterInput(const std::vector<double> &input) override;
 
 	virtual void SetParameters(unsigned int L, unsigned int G, unsigned int tau, unsigned int dt) override;
 	virtual void SetParameters(size_t l_, size_t m_, unsigned int tau, unsigned int dt);
 private:
 	double b;
+	std::vector<double> sums;			// running sums of the windows
+};
+
+
+
+// running sums of the three windows of the xia slow filter at each point, interleaved
+//  sums[3*i+k] of window k at point i from l+m, the same for any decay constant
+class XiaSlowSums: public FilterAlgorithm {
+public:
+	XiaSlowSums(size_t l_, size_t m_);
+	virtual ~XiaSlowSums();
+	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
+
+	virtual const std::vector<double> &Filter(const std::vector<double> &trace) override;
+	// the sums of the trace into sums
+	static void Sum(const std::vector<double> &trace, size_t l, size_t m, std::vector<double> &sums);
+private:
+	size_t l;
+	size_t m;
 };
 
 
@@ -93,6 +130,8 @@ public:
 	XiaFastFilter(unsigned int L, unsigned int G, unsigned int dt);
 	virtual ~XiaFastFilter();
 	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
 
 	virtual const std::vector<double> &Filter(const std::vector<double> &trace) override;
 };
@@ -105,12 +144,17 @@ public:
 	XiaCFDFilter(unsigned int L_, unsigned int G_, unsigned int D_, unsigned int factor_, unsigned int dt);
 	virtual ~XiaCFDFilter();
 	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
 
 	virtual void SetParameters(unsigned int L_, unsigned int G_, unsigned int D_, unsigned int W_, unsigned int dt_);
 	virtual void SetParameters(size_t l_, size_t m_, size_t d_, unsigned int w_);
 	virtual void SetFastFilterParameters(size_t l_, size_t m_);
 
 	virtual const std::vector<double> &Filter(const std::vector<double> &fast) override;
+	// from the output of the own fast filter, shared with the fast stage of the same parameters
+	virtual std::unique_ptr<FilterAlgorithm> InputFilter() const override;
+	virtual const std::vector<double> &FilterInput(const std::vector<double> &fast) override;
 
 	// virtual void AddXiaFastFilter(std::unique_ptr<FilterAlgorithm> filter_);
 private:
@@ -121,4 +165,30 @@ private:
 	unsigned int w;
 };
 
-#endif
\ No newline at end of file
+
+
+// polyphase windowed-sinc upsampler
+//  Interpolates factor-1 points between every two samples. The coefficients of
+//  all phases are computed once in the constructor and shared by the clones.
+class PolyphaseUpsampler: public FilterAlgorithm {
+public:
+	PolyphaseUpsampler(unsigned int factor_, size_t taps_ = 16);
+	virtual ~PolyphaseUpsampler();
+	virtual std::unique_ptr<FilterAlgorithm> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
+
+	virtual const std::vector<double> &Filter(const std::vector<double> &trace) override;
+	virtual const std::vector<double> &Upsample(const std::vector<double> &trace, size_t begin, size_t end);
+
+	virtual unsigned int GetFactor() const;
+	virtual size_t GetTaps() const;
+private:
+	unsigned int factor;
+	size_t taps;										// taps of each phase, even
+	std::shared_ptr<const std::vector<double>> coefficients;		// [phase][tap]
+	std::vector<double> window;							// padded input samples
+	std::vector<double> phase;							// output of one phase
+};
+
+#endif
\ No newline at end of file
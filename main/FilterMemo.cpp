@@ -0,0 +1,62 @@
+#include "FilterMemo.h"
+
+
+//--------------------------------------------------
+//					FilterMemo
+//--------------------------------------------------
+
+FilterMemo::FilterMemo() {
+	generation = 1;
+	hits = 0;
+}
+
+
+FilterMemo::~FilterMemo() {
+}
+
+
+// the input node is added before the node, so the nodes are in the order they're computed
+size_t FilterMemo::Add(const FilterAlgorithm &filter) {
+	std::string signature = filter.Signature();
+	auto iter = index.find(signature);
+	if (iter != index.end()) return iter->second;
+
+	size_t input = NoInput;
+	std::unique_ptr<FilterAlgorithm> inputFilter = filter.InputFilter();
+	if (inputFilter) input = Add(*inputFilter);
+
+	nodes.push_back(Node{filter.Clone(), input, 0, nullptr});
+	index[signature] = nodes.size() - 1;
+	return nodes.size() - 1;
+}
+
+
+void FilterMemo::Next() {
+	++generation;
+}
+
+
+const std::vector<double> &FilterMemo::Get(size_t node, const std::vector<double> &trace) {
+	Node &n = nodes[node];
+	if (n.generation == generation) {
+		++hits;
+		return *n.output;
+	}
+	if (n.input == NoInput) {
+		n.output = &n.filter->Filter(trace);
+	} else {
+		n.output = &n.filter->FilterInput(Get(n.input, trace));
+	}
+	n.generation = generation;
+	return *n.output;
+}
+
+
+size_t FilterMemo::Nodes() const {
+	return nodes.size();
+}
+
+
+unsigned long long FilterMemo::Hits() const {
+	return hits;
+}
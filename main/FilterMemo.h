@@ -0,0 +1,50 @@
+#ifndef __FILTERMEMO_H__
+#define __FILTERMEMO_H__
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+
+#include "FilterAlgorithm.h"
+
+
+// Filter outputs of one trace shared by the stages of several configurations
+//  Each filter is a node keyed by its signature, so the configurations with
+//  the same filter get the same node and the output is computed once for
+//  each trace. A filter computed from an intermediate output, e.g. the cfd
+//  from its fast filter or the xia slow filters of any decay constant from
+//  the same running sums, gets the node of that output as its input. The
+//  outputs are valid until the next trace, the memo belongs to one thread.
+
+class FilterMemo {
+public:
+	FilterMemo();
+	virtual ~FilterMemo();
+
+	// node of the filter output, the node of the same signature if it's there
+	virtual size_t Add(const FilterAlgorithm &filter);
+	// start the next trace, the outputs of the last one are dropped
+	virtual void Next();
+	// output of the node for the trace, computed at the first call of the trace
+	virtual const std::vector<double> &Get(size_t node, const std::vector<double> &trace);
+
+	// nodes, and outputs taken from the memo instead of computed
+	virtual size_t Nodes() const;
+	virtual unsigned long long Hits() const;
+private:
+	struct Node {
+		std::unique_ptr<FilterAlgorithm> filter;
+		size_t input;							// node of the intermediate output, or NoInput
+		unsigned long long generation;			// trace of the output
+		const std::vector<double> *output;
+	};
+	static constexpr size_t NoInput = size_t(-1);
+
+	std::vector<Node> nodes;
+	std::map<std::string, size_t> index;		// node of each signature
+	unsigned long long generation;
+	unsigned long long hits;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "Histogram.h"
+
+
+// add to the atomic double, fetch_add of double is only in C++20
+static void AtomicAdd(std::atomic<double> &target, double value) {
+	double old = target.load(std::memory_order_relaxed);
+	while (!target.compare_exchange_weak(old, old + value, std::memory_order_relaxed));
+}
+
+
+//--------------------------------------------------
+//					ShardedHistogram
+//--------------------------------------------------
+
+/*
+ * constructor of the fixed range
+ *  @name_: Name of the TH1D.
+ *  @title_: Title of the TH1D.
+ *  @bins_: Bins between low and high.
+ *  @low_: Lower edge of the first bin.
+ *  @high_: Upper edge of the last bin.
+ *  @shards_: Shards, one for each thread filling.
+ */
+ShardedHistogram::ShardedHistogram(const std::string &name_, const std::string &title_, size_t bins_, double low_, double high_, size_t shards_)
+:name(name_), title(title_), bins(bins_), samples(0), state(Unranged), shards(shards_ ? shards_ : 1), totals(bins_+2), entries(0), sum(0.0), sum2(0.0), inRange(0) {
+	if (!bins) throw std::runtime_error("Error: histogram " + name + " has no bins.");
+	if (!(high_ > low_)) throw std::runtime_error("Error: histogram " + name + " has invalid range.");
+	for (auto &total : totals) total.store(0, std::memory_order_relaxed);
+	for (auto &s : shards) s.counts.assign(bins+2, 0);
+	SetRange(low_, high_);
+	state.store(Ranged, std::memory_order_release);
+}
+
+
+/*
+ * constructor of the auto range
+ *  @samples_: Values kept by a shard before it fixes the range.
+ */
+ShardedHistogram::ShardedHistogram(const std::string &name_, const std::string &title_, size_t bins_, size_t samples_, size_t shards_)
+:name(name_), title(title_), bins(bins_), samples(samples_ ? samples_ : 1), low(0.0), high(1.0), scale(0.0), state(Unranged), shards(shards_ ? shards_ : 1), totals(bins_+2), entries(0), sum(0.0), sum2(0.0), inRange(0) {
+	if (!bins) throw std::runtime_error("Error: histogram " + name + " has no bins.");
+	for (auto &total : totals) total.store(0, std::memory_order_relaxed);
+	for (auto &s : shards) {
+		s.counts.assign(bins+2, 0);
+		s.pending.reserve(samples);
+	}
+}
+
+
+ShardedHistogram::~ShardedHistogram() {
+}
+
+
+/*
+ * Fill
+ *  Only plain increments of the shard once the range is fixed. Before it the
+ *  value is kept, and the shard that has enough values fixes the range.
+ *
+ *  @shard: Shard of the calling thread.
+ *  @value: Value to fill.
+ */
+void ShardedHistogram::Fill(size_t shard, double value) {
+	Shard &s = shards[shard];
+	if (!s.ranged) {
+		if (state.load(std::memory_order_acquire) != Ranged) {
+			s.pending.push_back(value);
+			if (s.pending.size() >= samples) TryRange(s.pending);
+			if (state.load(std::memory_order_acquire) == Ranged) FlushPending(s);
+			return;
+		}
+		FlushPending(s);
+	}
+	size_t bin = Bin(value);
+	++s.counts[bin];
+	++s.entries;
+	if (bin && bin <= bins) {
+		s.sum += value;
+		s.sum2 += value * value;
+	}
+}
+
+
+/*
+ * MergeShard
+ *  Add the counts of the shard to the totals with atomic adds and clear it, so
+ *  threads could merge their shards at the same time. The values of a shard
+ *  still unranged are left for Merge.
+ */
+void ShardedHistogram::MergeShard(size_t shard) {
+	Shard &s = shards[shard];
+	if (!s.ranged && state.load(std::memory_order_acquire) == Ranged) FlushPending(s);
+	unsigned long long counted = 0;
+	for (size_t b = 0; b != bins+2; ++b) {
+		if (!s.counts[b]) continue;
+		totals[b].fetch_add(s.counts[b], std::memory_order_relaxed);
+		if (b && b <= bins) counted += s.counts[b];
+		s.counts[b] = 0;
+	}
+	entries.fetch_add(s.entries, std::memory_order_relaxed);
+	inRange.fetch_add(counted, std::memory_order_relaxed);
+	AtomicAdd(sum, s.sum);
+	AtomicAdd(sum2, s.sum2);
+	s.entries = 0;
+	s.sum = s.sum2 = 0.0;
+}
+
+
+/*
+ * Merge
+ *  Fix the range by the kept values of all shards if none had enough, then
+ *  merge every shard.
+ */
+void ShardedHistogram::Merge() {
+	if (state.load(std::memory_order_acquire) != Ranged) {
+		std::vector<double> values;
+		for (auto &s : shards) values.insert(values.end(), s.pending.begin(), s.pending.end());
+		if (values.empty()) return;
+		TryRange(values);
+	}
+	for (size_t i = 0; i != shards.size(); ++i) MergeShard(i);
+}
+
+
+/*
+ * Restore
+ *  The binning must be the same, an auto range histogram takes the range of
+ *  it if the range is not fixed yet. Called before any fill.
+ */
+void ShardedHistogram::Restore(const TH1 &h) {
+	if (size_t(h.GetNbinsX()) != bins) throw std::runtime_error("Error: restore histogram " + name + " of different bins.");
+	double xmin = h.GetXaxis()->GetXmin();
+	double xmax = h.GetXaxis()->GetXmax();
+	if (state.load(std::memory_order_acquire) != Ranged) {
+		int expected = Unranged;
+		if (state.compare_exchange_strong(expected, Ranging, std::memory_order_acq_rel)) {
+			SetRange(xmin, xmax);
+			state.store(Ranged, std::memory_order_release);
+		}
+	}
+	double tolerance = 1e-9 * (high - low);
+	if (std::fabs(xmin - low) > tolerance || std::fabs(xmax - high) > tolerance) {
+		throw std::runtime_error("Error: restore histogram " + name + " of different range.");
+	}
+	for (size_t b = 0; b != bins+2; ++b) {
+		totals[b].fetch_add((unsigned long long)(h.GetBinContent(int(b)) + 0.5), std::memory_order_relaxed);
+	}
+	double stats[4] = {0.0, 0.0, 0.0, 0.0};
+	h.GetStats(stats);
+	entries.fetch_add((unsigned long long)(h.GetEntries() + 0.5), std::memory_order_relaxed);
+	inRange.fetch_add((unsigned long long)(stats[0] + 0.5), std::memory_order_relaxed);
+	AtomicAdd(sum, stats[2]);
+	AtomicAdd(sum2, stats[3]);
+}
+
+
+const std::string &ShardedHistogram::GetName() const {
+	return name;
+}
+
+
+unsigned long long ShardedHistogram::GetEntries() const {
+	return entries.load(std::memory_order_relaxed);
+}
+
+
+double ShardedHistogram::GetLow() const {
+	return low;
+}
+
+
+double ShardedHistogram::GetHigh() const {
+	return high;
+}
+
+
+size_t ShardedHistogram::GetBins() const {
+	return bins;
+}
+
+
+double ShardedHistogram::GetBinCenter(size_t bin) const {
+	return low + (double(bin) - 0.5) / scale;
+}
+
+
+unsigned long long ShardedHistogram::GetBinCount(size_t bin) const {
+	return totals.at(bin).load(std::memory_order_relaxed);
+}
+
+
+// TH1D of the merged totals, the statistics are the ones of the in range fills.
+// The auto range is fixed by the first values of one shard, so the fraction of
+// later values out of it is reported.
+TH1D *ShardedHistogram::ToTH1D() const {
+	unsigned long long all = GetEntries();
+	unsigned long long outside = totals[0].load(std::memory_order_relaxed) + totals[bins+1].load(std::memory_order_relaxed);
+	if (samples && outside) {
+		std::cerr << "Warning: " << 100.0 * double(outside) / double(all) << "% of the entries of histogram " << name;
+		std::cerr << " out of the auto range [" << low << ", " << high << "), set its range instead." << std::endl;
+	}
+	TH1D *h = new TH1D(name.c_str(), title.c_str(), int(bins), low, high);
+	h->SetDirectory(nullptr);
+	for (size_t b = 0; b != bins+2; ++b) {
+		h->SetBinContent(int(b), double(totals[b].load(std::memory_order_relaxed)));
+	}
+	double stats[4];
+	stats[0] = stats[1] = double(inRange.load(std::memory_order_relaxed));
+	stats[2] = sum.load(std::memory_order_relaxed);
+	stats[3] = sum2.load(std::memory_order_relaxed);
+	h->PutStats(stats);
+	h->SetEntries(double(all));
+	return h;
+}
+
+
+// Set the range, the range is padded on both sides for the auto range
+void ShardedHistogram::SetRange(double min, double max) {
+	low = min;
+	high = max;
+	scale = double(bins) / (high - low);
+}
+
+
+// Fix the range by the values if the state is unranged, the others wait for it
+void ShardedHistogram::TryRange(const std::vector<double> &values) {
+	int expected = Unranged;
+	if (!state.compare_exchange_strong(expected, Ranging, std::memory_order_acq_rel)) return;
+	double min = INFINITY;
+	double max = -INFINITY;
+	for (double v : values) {
+		if (!std::isfinite(v)) continue;
+		min = std::min(min, v);
+		max = std::max(max, v);
+	}
+	if (!std::isfinite(min)) {
+		min = 0.0;
+		max = 1.0;
+	}
+	// pad the range for the values after the samples
+	double pad = max > min ? 0.05 * (max - min) : 0.5;
+	SetRange(min - pad, max + pad);
+	state.store(Ranged, std::memory_order_release);
+}
+
+
+// Count the kept values of the shard after the range is fixed
+void ShardedHistogram::FlushPending(Shard &s) {
+	s.ranged = true;
+	for (double v : s.pending) Fill(size_t(&s - shards.data()), v);
+	s.pending.clear();
+	s.pending.shrink_to_fit();
+}
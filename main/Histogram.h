@@ -0,0 +1,91 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "TH1D.h"
+
+
+// Histogram of the hot loop
+//  Integer bin counters in one shard for each thread, so the fills need no
+//  lock and no ROOT object. A shard is merged into the totals with atomic adds
+//  when its thread is done, and the totals are converted to a TH1D only for
+//  writing. In the auto range mode the shards keep the first values until one
+//  of them has enough samples to fix the range for all.
+
+class ShardedHistogram {
+public:
+	// fixed range
+	ShardedHistogram(const std::string &name_, const std::string &title_, size_t bins_, double low_, double high_, size_t shards_ = 1);
+	// auto range from the first samples values of a shard
+	ShardedHistogram(const std::string &name_, const std::string &title_, size_t bins_, size_t samples_, size_t shards_ = 1);
+	virtual ~ShardedHistogram();
+
+	// fill in the shard, only one thread fills a shard
+	void Fill(size_t shard, double value);
+	// add the shard to the totals, lock free, after its thread stops filling
+	void MergeShard(size_t shard);
+	// merge all shards, after all threads stop filling
+	void Merge();
+	// add the counts of a histogram written earlier, e.g. by a checkpoint, of
+	// the same bins and range
+	void Restore(const TH1 &h);
+
+	const std::string &GetName() const;
+	unsigned long long GetEntries() const;
+	double GetLow() const;
+	double GetHigh() const;
+	size_t GetBins() const;
+	double GetBinCenter(size_t bin) const;
+	// count of the bin after merge, 0 underflow and bins+1 overflow
+	unsigned long long GetBinCount(size_t bin) const;
+	// new TH1D of the totals, not attached to any directory, warns of the
+	// entries out of an auto range
+	TH1D *ToTH1D() const;
+private:
+	struct alignas(64) Shard {
+		std::vector<unsigned long long> counts;
+		std::vector<double> pending;			// values before the range is fixed
+		bool ranged = false;
+		unsigned long long entries = 0;
+		double sum = 0.0;
+		double sum2 = 0.0;
+	};
+
+	// range states
+	static constexpr int Unranged = 0;
+	static constexpr int Ranging = 1;
+	static constexpr int Ranged = 2;
+
+	void SetRange(double min, double max);
+	// fix the range by the values if no shard has fixed it
+	void TryRange(const std::vector<double> &values);
+	void FlushPending(Shard &s);
+	inline size_t Bin(double value) const {
+		if (!(value >= low)) return 0;
+		if (value >= high) return bins + 1;
+		size_t bin = 1 + size_t((value - low) * scale);
+		return bin > bins ? bins : bin;
+	}
+
+	std::string name;
+	std::string title;
+	size_t bins;
+	size_t samples;
+	double low;
+	double high;
+	double scale;						// bins per unit
+	std::atomic<int> state;
+
+	std::vector<Shard> shards;
+	std::vector<std::atomic<unsigned long long>> totals;
+	std::atomic<unsigned long long> entries;
+	// in range statistics, added under the merge of the shards
+	std::atomic<double> sum;
+	std::atomic<double> sum2;
+	std::atomic<unsigned long long> inRange;
+};
+
+#endif
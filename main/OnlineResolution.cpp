@@ -0,0 +1,189 @@
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include "OnlineResolution.h"
+
+
+//--------------------------------------------------
+//					ResolutionRanking
+//--------------------------------------------------
+
+ResolutionRanking::ResolutionRanking(double lineLow_, double lineHigh_, const std::string &sortBy_) {
+	lineLow = lineLow_;
+	lineHigh = lineHigh_;
+	if (sortBy_ == "energy") {
+		byTime = false;
+	} else if (sortBy_ == "time") {
+		byTime = true;
+	} else {
+		throw std::runtime_error("Error: invalid ranking " + sortBy_ + ".");
+	}
+}
+
+
+ResolutionRanking::~ResolutionRanking() {
+}
+
+
+/*
+ * Add
+ *  @name: Name of the configuration.
+ *  @energy: Merged energy histogram.
+ *  @time: Merged histogram of the cfd time in points.
+ *  @dt: Time of one point in ns.
+ */
+void ResolutionRanking::Add(const std::string &name, const ShardedHistogram &energy, const ShardedHistogram &time, double dt) {
+	ResolutionEstimate estimate;
+	estimate.name = name;
+	estimate.entries = energy.GetEntries();
+
+	bool whole = !(lineHigh > lineLow);
+	auto line = PeakWidth(energy, whole ? energy.GetLow() : lineLow, whole ? energy.GetHigh() : lineHigh);
+	if (line.second > 0.0 && line.first > 0.0) {
+		estimate.peak = line.first;
+		estimate.energyFWHM = line.second;
+		estimate.energyResolution = line.second / line.first;
+	}
+	auto jitter = PeakWidth(time, time.GetLow(), time.GetHigh());
+	if (jitter.second > 0.0) estimate.timeSigma = jitter.second / 2.355 * dt;
+
+	Add(estimate);
+}
+
+
+// one estimate of each name, so Find and Ranked see the same one
+void ResolutionRanking::Add(const ResolutionEstimate &estimate) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &e : estimates) {
+		if (e.name != estimate.name) continue;
+		e = estimate;
+		return;
+	}
+	estimates.push_back(estimate);
+}
+
+
+bool ResolutionRanking::Find(const std::string &name, ResolutionEstimate &estimate) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &e : estimates) {
+		if (e.name != name) continue;
+		estimate = e;
+		return true;
+	}
+	return false;
+}
+
+
+std::vector<ResolutionEstimate> ResolutionRanking::Ranked() const {
+	std::vector<ResolutionEstimate> ranked;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ranked = estimates;
+	}
+	std::stable_sort(ranked.begin(), ranked.end(), [this](const ResolutionEstimate &a, const ResolutionEstimate &b) {
+		return Better(a, b);
+	});
+	return ranked;
+}
+
+
+// the ones not found have negative widths and rank last
+bool ResolutionRanking::Better(const ResolutionEstimate &a, const ResolutionEstimate &b) const {
+	double ka = byTime ? a.timeSigma : a.energyResolution;
+	double kb = byTime ? b.timeSigma : b.energyResolution;
+	if ((ka < 0.0) != (kb < 0.0)) return kb < 0.0;
+	return ka < kb;
+}
+
+
+void ResolutionRanking::Print(std::ostream &os, size_t top) const {
+	std::vector<ResolutionEstimate> ranked = Ranked();
+	if (top && top < ranked.size()) ranked.resize(top);
+	std::streamsize precision = os.precision();
+	os << "rank  " << std::setw(10) << "entries" << std::setw(10) << "peak" << std::setw(10) << "FWHM"
+		<< std::setw(10) << "res(%)" << std::setw(10) << "sigma(ns)" << "  name" << std::endl;
+	for (size_t i = 0; i != ranked.size(); ++i) {
+		auto &e = ranked[i];
+		os << std::setw(4) << i+1 << "  " << std::setw(10) << e.entries << std::fixed << std::setprecision(2)
+			<< std::setw(10) << e.peak << std::setw(10) << e.energyFWHM
+			<< std::setw(10) << (e.energyResolution < 0.0 ? -1.0 : e.energyResolution * 100.0)
+			<< std::setw(10) << e.timeSigma << "  " << e.name << std::endl;
+		os.unsetf(std::ios_base::floatfield);
+	}
+	os.precision(precision);
+}
+
+
+void ResolutionRanking::Write(const std::string &fileName) const {
+	std::ofstream output(fileName);
+	if (!output.good()) throw std::runtime_error("Error: open ranking file " + fileName + ".");
+	output << "rank,name,entries,peak,fwhm,resolution,sigma" << std::endl;
+	std::vector<ResolutionEstimate> ranked = Ranked();
+	for (size_t i = 0; i != ranked.size(); ++i) {
+		auto &e = ranked[i];
+		output << i+1 << "," << e.name << "," << e.entries << "," << e.peak << "," << e.energyFWHM
+			<< "," << e.energyResolution << "," << e.timeSigma << std::endl;
+	}
+}
+
+
+/*
+ * PeakWidth
+ *  Take the highest bin between low and high of the histogram smoothed over
+ *  three bins, walk to both sides until half of it and interpolate the edges
+ *  linearly. The position is the mean of the bins above half maximum.
+ *
+ *  @h: The merged histogram.
+ *  @low: Lower edge of the search.
+ *  @high: Upper edge of the search.
+ */
+std::pair<double, double> ResolutionRanking::PeakWidth(const ShardedHistogram &h, double low, double high) {
+	size_t bins = h.GetBins();
+	if (!h.GetEntries() || !bins) return {0.0, -1.0};
+	double width = (h.GetHigh() - h.GetLow()) / double(bins);
+
+	// smoothed counts of the bins 1 to bins
+	std::vector<double> counts(bins+2, 0.0);
+	for (size_t b = 1; b <= bins; ++b) counts[b] = double(h.GetBinCount(b));
+	std::vector<double> smooth(bins+2, 0.0);
+	for (size_t b = 1; b <= bins; ++b) {
+		double c = counts[b];
+		size_t n = 1;
+		if (b > 1) { c += counts[b-1]; ++n; }
+		if (b < bins) { c += counts[b+1]; ++n; }
+		smooth[b] = c / double(n);
+	}
+
+	// highest bin in the range
+	size_t peak = 0;
+	for (size_t b = 1; b <= bins; ++b) {
+		double center = h.GetBinCenter(b);
+		if (center < low || center > high) continue;
+		if (!peak || smooth[b] > smooth[peak]) peak = b;
+	}
+	if (!peak || smooth[peak] <= 0.0) return {0.0, -1.0};
+	double half = smooth[peak] / 2.0;
+
+	// edges at half maximum
+	size_t left = peak;
+	while (left > 1 && smooth[left-1] >= half) --left;
+	size_t right = peak;
+	while (right < bins && smooth[right+1] >= half) ++right;
+	// the line runs off the histogram
+	if (left == 1 || right == bins) return {0.0, -1.0};
+	double leftEdge = h.GetBinCenter(left-1)
+		+ width * (half - smooth[left-1]) / (smooth[left] - smooth[left-1]);
+	double rightEdge = h.GetBinCenter(right)
+		+ width * (smooth[right] - half) / (smooth[right] - smooth[right+1]);
+
+	double sum = 0.0;
+	double weighted = 0.0;
+	for (size_t b = left; b <= right; ++b) {
+		sum += counts[b];
+		weighted += counts[b] * h.GetBinCenter(b);
+	}
+	double position = sum > 0.0 ? weighted / sum : h.GetBinCenter(peak);
+	return {position, rightEdge - leftEdge};
+}
@@ -0,0 +1,71 @@
+#ifndef __ONLINERESOLUTION_H__
+#define __ONLINERESOLUTION_H__
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <ostream>
+
+#include "Histogram.h"
+
+
+// Online resolution of the sweep
+//  Each simulator adds the estimate of its configuration from the merged
+//  streaming histograms at the end of its run, so a sweep ranks the
+//  configurations without reading the result tables again. The widths are
+//  taken at half maximum of the histograms instead of a fit, so a low tail or
+//  a neighbour line doesn't pull them. The name is the key of a
+//  configuration, the sweep keeps the names unique.
+
+
+// resolution of one configuration
+struct ResolutionEstimate {
+	std::string name;
+	unsigned long long entries = 0;		// energies in the histogram
+	double peak = 0.0;					// position of the energy line
+	double energyFWHM = -1.0;			// FWHM of the energy line, negative if not found
+	double energyResolution = -1.0;		// FWHM over the position
+	double timeSigma = -1.0;			// sigma of the cfd time in ns, FWHM over 2.355
+};
+
+
+class ResolutionRanking {
+public:
+	/*
+	 * constructor
+	 *  @lineLow_: Lower energy of the line searched, the whole histogram if not above lineLow_.
+	 *  @lineHigh_: Upper energy of the line searched.
+	 *  @sortBy_: "energy" or "time", the estimate ranked by.
+	 */
+	ResolutionRanking(double lineLow_, double lineHigh_, const std::string &sortBy_ = "energy");
+	virtual ~ResolutionRanking();
+
+	// estimate from the merged histograms of one configuration, thread safe
+	virtual void Add(const std::string &name, const ShardedHistogram &energy, const ShardedHistogram &time, double dt);
+	// add an estimate of an earlier run, e.g. from the result cache, it replaces the one of the same name
+	virtual void Add(const ResolutionEstimate &estimate);
+	// estimate of the configuration, false if it's not added
+	virtual bool Find(const std::string &name, ResolutionEstimate &estimate) const;
+	// estimates from the best, the ones not found are the last
+	virtual std::vector<ResolutionEstimate> Ranked() const;
+	// whether a ranks before b
+	virtual bool Better(const ResolutionEstimate &a, const ResolutionEstimate &b) const;
+	// print the first top estimates, all if 0
+	virtual void Print(std::ostream &os, size_t top = 0) const;
+	// write all estimates in csv
+	virtual void Write(const std::string &fileName) const;
+
+	/*
+	 * position and FWHM of the highest peak between low and high
+	 *  @return: The position and the FWHM, negative FWHM if no peak.
+	 */
+	static std::pair<double, double> PeakWidth(const ShardedHistogram &h, double low, double high);
+private:
+	double lineLow;
+	double lineHigh;
+	bool byTime;
+	mutable std::mutex mutex;
+	std::vector<ResolutionEstimate> estimates;
+};
+
+#endif
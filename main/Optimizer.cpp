@@ -0,0 +1,184 @@
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+#include "Optimizer.h"
+
+
+//--------------------------------------------------
+//					NelderMead
+//--------------------------------------------------
+
+NelderMead::NelderMead(const Point &low_, const Point &high_, const Point &step_, bool speculative_) {
+	if (low_.size() != high_.size() || low_.size() != step_.size() || low_.empty()) {
+		throw std::runtime_error("Error: bounds and steps of the optimizer differ in size.");
+	}
+	for (size_t i = 0; i != low_.size(); ++i) {
+		if (low_[i] > high_[i] || step_[i] < 0.0) {
+			throw std::runtime_error("Error: invalid bounds or step of optimizer parameter " + std::to_string(i) + ".");
+		}
+	}
+	low = low_;
+	high = high_;
+	step = step_;
+	speculative = speculative_;
+}
+
+
+NelderMead::~NelderMead() {
+}
+
+
+/*
+ * Minimize
+ *  The standard coefficients, reflection 1, expansion 2, contraction 0.5 and
+ *  shrink 0.5. A move the grid rounds back to the worst vertex shrinks the
+ *  simplex instead, so the search always moves or stops.
+ */
+NelderMead::Point NelderMead::Minimize(const Point &start, const BatchFunction &function, size_t maxEvaluations) {
+	size_t n = low.size();
+	if (start.size() != n) throw std::runtime_error("Error: start point of the optimizer differs in size.");
+
+	std::vector<Point> simplex{Snap(start)};
+	for (size_t i = 0; i != n; ++i) {
+		Point vertex = simplex[0];
+		double edge = std::max((high[i] - low[i]) / 4.0, step[i]);
+		vertex[i] += vertex[i] + edge <= high[i] ? edge : -edge;
+		simplex.push_back(Snap(vertex));
+	}
+	std::vector<double> values = Evaluate(simplex, function, maxEvaluations);
+
+	while (history.size() < maxEvaluations) {
+		// sort the vertices from the best
+		std::vector<size_t> order(n+1);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return values[a] < values[b];
+		});
+		std::vector<Point> sortedSimplex;
+		std::vector<double> sortedValues;
+		for (size_t v : order) {
+			sortedSimplex.push_back(simplex[v]);
+			sortedValues.push_back(values[v]);
+		}
+		simplex.swap(sortedSimplex);
+		values.swap(sortedValues);
+
+		bool collapsed = true;
+		for (size_t v = 1; v <= n; ++v) {
+			if (simplex[v] != simplex[0]) collapsed = false;
+		}
+		if (collapsed) break;
+
+		Point centroid(n, 0.0);
+		for (size_t v = 0; v != n; ++v) {
+			for (size_t i = 0; i != n; ++i) centroid[i] += simplex[v][i] / double(n);
+		}
+		const Point &worst = simplex[n];
+		auto along = [&](double t) {
+			Point point(n);
+			for (size_t i = 0; i != n; ++i) point[i] = centroid[i] + t * (centroid[i] - worst[i]);
+			return Snap(point);
+		};
+		// reflection, expansion, outside and inside contraction, in one batch if
+		// speculative, otherwise the reflection first and the others on demand
+		std::vector<Point> proposals{along(1.0), along(2.0), along(0.5), along(-0.5)};
+		std::vector<double> proposed(4, std::numeric_limits<double>::infinity());
+		if (speculative) {
+			proposed = Evaluate(proposals, function, maxEvaluations);
+		} else {
+			proposed[0] = Evaluate({proposals[0]}, function, maxEvaluations)[0];
+		}
+		auto value = [&](size_t k) {
+			if (!speculative) proposed[k] = Evaluate({proposals[k]}, function, maxEvaluations)[0];
+			return proposed[k];
+		};
+
+		int next = -1;
+		if (proposed[0] < values[0]) {
+			next = value(1) < proposed[0] ? 1 : 0;
+		} else if (proposed[0] < values[n-1]) {
+			next = 0;
+		} else if (proposed[0] < values[n]) {
+			if (value(2) <= proposed[0]) next = 2;
+		} else {
+			if (value(3) < values[n]) next = 3;
+		}
+		if (next >= 0 && proposals[next] != worst) {
+			simplex[n] = proposals[next];
+			values[n] = proposed[next];
+			continue;
+		}
+
+		// shrink to the best vertex, stop if the grid keeps the simplex
+		std::vector<Point> shrunk;
+		bool moved = false;
+		for (size_t v = 1; v <= n; ++v) {
+			Point point(n);
+			for (size_t i = 0; i != n; ++i) point[i] = simplex[0][i] + 0.5 * (simplex[v][i] - simplex[0][i]);
+			shrunk.push_back(Snap(point));
+			if (shrunk.back() != simplex[v]) moved = true;
+		}
+		if (!moved) break;
+		std::vector<double> shrunkValues = Evaluate(shrunk, function, maxEvaluations);
+		for (size_t v = 1; v <= n; ++v) {
+			simplex[v] = shrunk[v-1];
+			values[v] = shrunkValues[v-1];
+		}
+	}
+
+	auto best = std::min_element(history.begin(), history.end(), [](const auto &a, const auto &b) {
+		return a.second < b.second;
+	});
+	return best == history.end() ? simplex[0] : best->first;
+}
+
+
+size_t NelderMead::GetEvaluations() const {
+	return history.size();
+}
+
+
+const std::map<NelderMead::Point, double> &NelderMead::GetHistory() const {
+	return history;
+}
+
+
+NelderMead::Point NelderMead::Snap(const Point &point) const {
+	Point snapped(point.size());
+	for (size_t i = 0; i != point.size(); ++i) {
+		double x = std::min(std::max(point[i], low[i]), high[i]);
+		if (step[i] > 0.0) {
+			x = low[i] + std::round((x - low[i]) / step[i]) * step[i];
+			if (x > high[i]) x -= step[i];
+		}
+		snapped[i] = x;
+	}
+	return snapped;
+}
+
+
+std::vector<double> NelderMead::Evaluate(const std::vector<Point> &points, const BatchFunction &function, size_t maxEvaluations) {
+	std::vector<Point> batch;
+	for (auto &point : points) {
+		if (history.count(point) || std::find(batch.begin(), batch.end(), point) != batch.end()) continue;
+		if (history.size() + batch.size() >= maxEvaluations) break;
+		batch.push_back(point);
+	}
+	if (batch.size()) {
+		std::vector<double> batchValues = function(batch);
+		if (batchValues.size() != batch.size()) throw std::runtime_error("Error: optimizer got values of a different size.");
+		for (size_t b = 0; b != batch.size(); ++b) {
+			// a failed evaluation never wins
+			history[batch[b]] = std::isnan(batchValues[b]) ? std::numeric_limits<double>::infinity() : batchValues[b];
+		}
+	}
+	std::vector<double> values;
+	for (auto &point : points) {
+		auto iter = history.find(point);
+		values.push_back(iter == history.end() ? std::numeric_limits<double>::infinity() : iter->second);
+	}
+	return values;
+}
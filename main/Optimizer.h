@@ -0,0 +1,62 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <vector>
+#include <map>
+#include <functional>
+
+
+// Derivative-free search of the filter parameters
+//  Nelder-Mead on the grid of the sweep: every point is clamped into the
+//  bounds and rounded to the steps, and each grid point is evaluated once.
+//  An iteration evaluates the reflection and then only the move it calls for,
+//  1 or 2 points. The speculative mode evaluates the reflection, expansion and
+//  both contractions in one batch, so they run in parallel at up to twice the
+//  evaluations, and the simplex takes the one the sequential method would
+//  take. The search stops when the simplex collapses to one grid point or the
+//  evaluations run out.
+
+class NelderMead {
+public:
+	using Point = std::vector<double>;
+	// values of a batch of points, the smaller the better, may run them in parallel
+	using BatchFunction = std::function<std::vector<double>(const std::vector<Point>&)>;
+
+	/*
+	 * constructor
+	 *  @low_: Lower bound of each parameter.
+	 *  @high_: Upper bound of each parameter.
+	 *  @step_: Grid step of each parameter from the lower bound, 0 for continuous.
+	 *  @speculative_: Evaluate the 4 moves of an iteration in one batch.
+	 */
+	NelderMead(const Point &low_, const Point &high_, const Point &step_, bool speculative_ = false);
+	virtual ~NelderMead();
+
+	/*
+	 * Minimize
+	 *  @start: First vertex of the simplex, the others are a quarter of the
+	 *    range away along each parameter.
+	 *  @function: Evaluates the batches of new grid points.
+	 *  @maxEvaluations: Grid points evaluated at most.
+	 *  @return: The best point evaluated.
+	 */
+	virtual Point Minimize(const Point &start, const BatchFunction &function, size_t maxEvaluations);
+
+	// grid points evaluated
+	size_t GetEvaluations() const;
+	// value of every evaluated grid point
+	const std::map<Point, double> &GetHistory() const;
+private:
+	// clamp into the bounds and round to the grid
+	Point Snap(const Point &point) const;
+	// values of the points, only the new ones are evaluated, the new ones over the budget are infinity
+	std::vector<double> Evaluate(const std::vector<Point> &points, const BatchFunction &function, size_t maxEvaluations);
+
+	Point low;
+	Point high;
+	Point step;
+	bool speculative;
+	std::map<Point, double> history;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <exception>
 #include <string>
+#include <cstdio>
 
 #include "Picker.h"
 
@@ -9,6 +10,14 @@
 //					help functions
 //--------------------------------------------------
 
+// double in the signature, exact enough to tell the parameters apart
+static std::string Number(double x) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.17g", x);
+	return buffer;
+}
+
+
 double zeroPointCubicBinary(double y0, double y1, double y2, double y3) {
 	double c0 = y1;
 	double c1 = -y3/6.0 + y2 - y1/2.0 - y0/3.0;
@@ -57,6 +66,31 @@ Picker::~Picker() {
 }
 
 
+// PickShifted
+//  Pick with the search range shifted by shift points. Pickers without
+//  search range ignore the shift.
+double Picker::PickShifted(const std::vector<double> &data, long long shift) {
+	return Pick(data);
+}
+
+
+double Picker::PickHit(const std::vector<double> &data, long long shift, size_t begin, size_t end) {
+	return PickShifted(data, shift);
+}
+
+
+// one scan of the data
+double Picker::Cost(size_t samples) const {
+	return double(samples);
+}
+
+
+// a value, e.g. the max, is always a trigger
+bool Picker::Triggered(double pick, size_t size) const {
+	return true;
+}
+
+
 //--------------------------------------------------
 //						MaxPicker
 //--------------------------------------------------
@@ -74,6 +108,11 @@ std::unique_ptr<Picker> MaxPicker::Clone() const{
 }
 
 
+std::string MaxPicker::Signature() const {
+	return "max";
+}
+
+
 double MaxPicker::Pick(const std::vector<double> &data) {
 	double maxPoint = data[0];
 	for (auto &d : data) {
@@ -83,6 +122,19 @@ double MaxPicker::Pick(const std::vector<double> &data) {
 }
 
 
+// pick the max value between the trigger of the hit and the next one, so a
+// larger later pulse isn't picked for the earlier hits
+double MaxPicker::PickHit(const std::vector<double> &data, long long shift, size_t begin, size_t end) {
+	if (end > data.size()) end = data.size();
+	if (begin >= end) return -1.0;
+	double maxPoint = data[begin];
+	for (size_t i = begin; i != end; ++i) {
+		maxPoint = maxPoint < data[i] ? data[i] : maxPoint;
+	}
+	return maxPoint;
+}
+
+
 
 
 
@@ -114,6 +166,11 @@ std::unique_ptr<Picker> BasePicker::Clone() const {
 }
 
 
+std::string BasePicker::Signature() const {
+	return "base(" + std::to_string(len) + "," + std::to_string(start) + ")";
+}
+
+
 /*
  * Pick
  *  Calculate the average value of the range slected by start and len.
@@ -156,6 +213,11 @@ std::unique_ptr<Picker> TopBasePicker::Clone() const {
 }
 
 
+std::string TopBasePicker::Signature() const {
+	return "top-base(" + std::to_string(len) + "," + std::to_string(stop) + ")";
+}
+
+
 /*
  * Pick
  *  Calculate the average value from the end of the data,
@@ -198,6 +260,11 @@ std::unique_ptr<Picker> TrapezoidTopPicker::Clone() const {
 }
 
 
+std::string TrapezoidTopPicker::Signature() const {
+	return "trapezoid-top(" + std::to_string(ts) + "," + std::to_string(l) + "," + std::to_string(m) + ")";
+}
+
+
 double TrapezoidTopPicker::Pick(const std::vector<double> &data) {
 	// size_t fl = 0;
 	size_t fr = 0;
@@ -228,6 +295,19 @@ double TrapezoidTopPicker::Pick(const std::vector<double> &data) {
 }
 
 
+// pick the top of the trapezoid triggered shift points later
+double TrapezoidTopPicker::PickShifted(const std::vector<double> &data, long long shift) {
+	long long start = (long long)ts + shift;
+	// the search range and the difference cover [ts+m-20, ts+m+8)
+	if (start + (long long)m < 20 || size_t(start) + m + 8 > data.size()) return -1.0;
+	size_t origin = ts;
+	ts = start;
+	double ret = Pick(data);
+	ts = origin;
+	return ret;
+}
+
+
 
 
 
@@ -248,6 +328,11 @@ std::unique_ptr<Picker> LeadingEdgePicker::Clone() const {
 }
 
 
+std::string LeadingEdgePicker::Signature() const {
+	return "leading-edge(" + std::to_string(threshold) + ")";
+}
+
+
 double LeadingEdgePicker::Pick(const std::vector<double> &data) {
 // std::cout << "le-picker: size " << data.size() << std::endl;
 	size_t ts = 0;
@@ -260,6 +345,12 @@ double LeadingEdgePicker::Pick(const std::vector<double> &data) {
 }
 
 
+// no point over the threshold picks the size
+bool LeadingEdgePicker::Triggered(double pick, size_t size) const {
+	return pick >= 0.0 && pick < double(size);
+}
+
+
 
 //--------------------------------------------------
 //					ZeroCrossPicker
@@ -280,6 +371,11 @@ std::unique_ptr<Picker> ZeroCrossPicker::Clone() const {
 }
 
 
+std::string ZeroCrossPicker::Signature() const {
+	return "zero-cross(" + std::to_string(ts) + "," + std::to_string(threshold) + "," + std::to_string(cubic) + ")";
+}
+
+
 double ZeroCrossPicker::Pick(const std::vector<double> &data) {
 	if (cubic) {		// cubic fit
 
@@ -308,6 +404,18 @@ double ZeroCrossPicker::Pick(const std::vector<double> &data) {
 }
 
 
+// search the zero cross point from shift points later
+double ZeroCrossPicker::PickShifted(const std::vector<double> &data, long long shift) {
+	long long start = (long long)ts + shift;
+	if (start < 1 || size_t(start) + 2 >= data.size()) return -1.0;
+	size_t origin = ts;
+	ts = start;
+	double ret = Pick(data);
+	ts = origin;
+	return ret;
+}
+
+
 
 //--------------------------------------------------
 //					DigitalFractionPicker
@@ -332,6 +440,17 @@ std::unique_ptr<Picker> DigitalFractionPicker::Clone() const {
 }
 
 
+std::string DigitalFractionPicker::Signature() const {
+	return "digital-fraction(" + std::to_string(ts) + "," + Number(fraction) + "," + std::to_string(cubic) + "," + std::to_string(baseLen) + ")";
+}
+
+
+// the base, the top and the crossing
+double DigitalFractionPicker::Cost(size_t samples) const {
+	return topPicker.Cost(samples) + basePicker.Cost(samples) + double(samples);
+}
+
+
 double DigitalFractionPicker::Pick(const std::vector<double> &data) {
 	double base = basePicker.Pick(data);
 	double topBase = topPicker.Pick(data);
@@ -359,3 +478,240 @@ double DigitalFractionPicker::Pick(const std::vector<double> &data) {
 	return -1.0;
 }
 
+
+// search the fraction point from shift points later, the base and top are
+// still taken from the edges of the trace
+double DigitalFractionPicker::PickShifted(const std::vector<double> &data, long long shift) {
+	long long start = (long long)ts + shift;
+	if (start < 1 || size_t(start) + 2 >= data.size()) return -1.0;
+	size_t origin = ts;
+	ts = start;
+	double ret = Pick(data);
+	ts = origin;
+	return ret;
+}
+
+
+
+
+//--------------------------------------------------
+//					PileupPicker
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @thres_: Set the trigger threshold of the fast filter.
+ *  @window_: Set the inspection window after the first trigger, in points.
+ */
+PileupPicker::PileupPicker(unsigned int thres_, size_t window_): Picker() {
+	threshold = thres_;
+	window = window_;
+}
+
+
+PileupPicker::~PileupPicker() {
+}
+
+
+std::unique_ptr<Picker> PileupPicker::Clone() const {
+	return std::make_unique<PileupPicker>(threshold, window);
+}
+
+
+std::string PileupPicker::Signature() const {
+	return "pileup(" + std::to_string(threshold) + "," + std::to_string(window) + ")";
+}
+
+
+/*
+ * Pick
+ *  Count the rising crossings of the threshold from the first trigger to the
+ *  end of the inspection window, the trace is piled up if it's more than 1.
+ *
+ *  @data: The fast filter trace being processed.
+ */
+double PileupPicker::Pick(const std::vector<double> &data) {
+	size_t vsize = data.size();
+	size_t first = vsize;
+	bool overThres = false;
+	unsigned int count = 0;
+	for (size_t i = 0; i != vsize; ++i) {
+		if (first != vsize && i >= first + window) break;
+		if (!overThres && data[i] > threshold) {
+			overThres = true;
+			++count;
+			if (first == vsize) first = i;
+		} else if (overThres && data[i] <= threshold) {
+			overThres = false;
+		}
+	}
+	return double(count);
+}
+
+
+
+//--------------------------------------------------
+//					MultiHitPicker
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @thres_: Set the trigger threshold of the fast filter.
+ *  @holdoff_: Set the points after a trigger that can't trigger again.
+ *  @maxHits_: Set the max hits of one trace.
+ */
+MultiHitPicker::MultiHitPicker(unsigned int thres_, size_t holdoff_, size_t maxHits_): Picker() {
+	threshold = thres_;
+	holdoff = holdoff_;
+	maxHits = maxHits_;
+	hits.reserve(maxHits);
+}
+
+
+MultiHitPicker::~MultiHitPicker() {
+}
+
+
+std::unique_ptr<Picker> MultiHitPicker::Clone() const {
+	return std::make_unique<MultiHitPicker>(threshold, holdoff, maxHits);
+}
+
+
+std::string MultiHitPicker::Signature() const {
+	return "multi-hit(" + std::to_string(threshold) + "," + std::to_string(holdoff) + "," + std::to_string(maxHits) + ")";
+}
+
+
+/*
+ * Pick
+ *  Record the rising crossings of the threshold, a new trigger is accepted
+ *  only after the holdoff and after the data falls below the threshold.
+ *
+ *  @data: The fast filter trace being processed.
+ *  @return: Count of the hits, the points are got by GetHits.
+ */
+double MultiHitPicker::Pick(const std::vector<double> &data) {
+	hits.clear();
+	size_t vsize = data.size();
+	size_t next = 0;
+	bool overThres = false;
+	for (size_t i = 0; i != vsize; ++i) {
+		if (data[i] <= threshold) {
+			overThres = false;
+			continue;
+		}
+		if (overThres) continue;
+		overThres = true;
+		if (i < next) continue;
+		hits.push_back(i);
+		if (hits.size() == maxHits) break;
+		next = i + holdoff;
+	}
+	return double(hits.size());
+}
+
+
+const std::vector<size_t> &MultiHitPicker::GetHits() const {
+	return hits;
+}
+
+
+
+//--------------------------------------------------
+//				UpsampleZeroCrossPicker
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @ts_: Set the start point to search the zero cross point.
+ *  @thres_: Set the threshold the data should be over before crossing zero.
+ *  @factor_: Set the upsampling factor.
+ *  @cubic_: Use cubic or linear interpolation on the upsampled data.
+ *  @taps_: Set the taps of each phase of the upsampler.
+ */
+UpsampleZeroCrossPicker::UpsampleZeroCrossPicker(size_t ts_, unsigned int thres_, unsigned int factor_, bool cubic_, size_t taps_):
+Picker(), upsampler(factor_, taps_) {
+	ts = ts_;
+	threshold = thres_;
+	cubic = cubic_;
+}
+
+
+UpsampleZeroCrossPicker::~UpsampleZeroCrossPicker() {
+}
+
+
+// clone, the upsampler coefficients are shared
+std::unique_ptr<Picker> UpsampleZeroCrossPicker::Clone() const {
+	return std::make_unique<UpsampleZeroCrossPicker>(*this);
+}
+
+
+std::string UpsampleZeroCrossPicker::Signature() const {
+	return "upsample-zero-cross(" + std::to_string(ts) + "," + std::to_string(threshold) + "," + std::to_string(cubic) + "," + upsampler.Signature() + ")";
+}
+
+
+// the coarse scan and the six samples upsampled around the crossing
+double UpsampleZeroCrossPicker::Cost(size_t samples) const {
+	return double(samples) + upsampler.Cost(6);
+}
+
+
+/*
+ * Pick
+ *  Search the first zero cross point like ZeroCrossPicker, then upsample
+ *  only the samples around it and search the crossing on the upsampled data.
+ *
+ *  @data: The cfd trace being processed.
+ */
+double UpsampleZeroCrossPicker::Pick(const std::vector<double> &data) {
+	// search the coarse crossing point
+	bool overThres = false;
+	size_t coarse = data.size();
+	size_t vsize = data.size()-1;
+	for (size_t i = ts; i < vsize; ++i) {
+		if (data[i] > threshold) overThres = true;
+		if (!overThres) continue;
+		if (data[i] >= 0 && data[i+1] < 0) {
+			coarse = i;
+			break;
+		}
+	}
+	if (coarse == data.size()) return -1.0;
+
+	// upsample the region of interest, two samples on each side
+	size_t begin = coarse >= 2 ? coarse - 2 : 0;
+	size_t end = coarse + 4 < data.size() ? coarse + 4 : data.size();
+	const std::vector<double> &up = upsampler.Upsample(data, begin, end);
+	double factor = double(upsampler.GetFactor());
+
+	// search the crossing on the upsampled data, start from the coarse point
+	size_t usize = up.size()-1;
+	for (size_t j = (coarse-begin) * upsampler.GetFactor(); j < usize; ++j) {
+		if (up[j] >= 0 && up[j+1] < 0) {
+			double frac;
+			if (cubic && j >= 1 && j+2 <= usize) {
+				frac = zeroPointCubicBinary(up[j-1], up[j], up[j+1], up[j+2]);
+			} else {
+				frac = up[j] / (up[j] - up[j+1]);
+			}
+			return double(begin) + (double(j) + frac) / factor;
+		}
+	}
+
+	// not reached since phase 0 reproduces the samples, keep the linear result
+	return coarse + data[coarse] / (data[coarse] - data[coarse+1]);
+}
+
+
+// search the zero cross point from shift points later
+double UpsampleZeroCrossPicker::PickShifted(const std::vector<double> &data, long long shift) {
+	long long start = (long long)ts + shift;
+	if (start < 0 || size_t(start) + 1 >= data.size()) return -1.0;
+	size_t origin = ts;
+	ts = start;
+	double ret = Pick(data);
+	ts = origin;
+	return ret;
+}
@@ -3,6 +3,9 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+
+#include "FilterAlgorithm.h"
 
 
 // Picker, pick the energy, timestamp, cfd from the filtered trace
@@ -10,7 +13,18 @@ class Picker {
 public:
 	virtual ~Picker();
 	virtual std::unique_ptr<Picker> Clone() const = 0;
+	// type and parameters, the same for pickers giving the same pick
+	virtual std::string Signature() const = 0;
 	virtual double Pick(const std::vector<double> &data) = 0;
+	// rough operations to pick from data of samples points, to schedule the runs
+	virtual double Cost(size_t samples) const;
+	// pick with the search range shifted by shift points, for the later hits
+	virtual double PickShifted(const std::vector<double> &data, long long shift);
+	// pick the hit shift points after the first one, its trigger at begin and
+	// the next hit at end, the shifted pick by default
+	virtual double PickHit(const std::vector<double> &data, long long shift, size_t begin, size_t end);
+	// the pick of data of size points is a trigger, only pickers of a point can miss
+	virtual bool Triggered(double pick, size_t size) const;
 protected:
 	Picker();
 };
@@ -22,7 +36,9 @@ public:
 	MaxPicker();
 	virtual ~MaxPicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
+	virtual double PickHit(const std::vector<double> &data, long long shift, size_t begin, size_t end) override;
 };
 
 
@@ -32,6 +48,7 @@ public:
 	BasePicker(size_t len_, size_t start_ = 0);
 	virtual ~BasePicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
 protected:
 	size_t len;
@@ -46,6 +63,7 @@ public:
 	TopBasePicker(size_t len_, size_t stop_ = 0);
 	virtual ~TopBasePicker() = default;
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
 private:
 	size_t len;
@@ -59,7 +77,9 @@ public:
 	TrapezoidTopPicker(size_t ts_, size_t l_, size_t m_);
 	virtual ~TrapezoidTopPicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
+	virtual double PickShifted(const std::vector<double> &data, long long shift) override;
 private:
 	size_t ts;
 	size_t l;
@@ -73,7 +93,9 @@ public:
 	LeadingEdgePicker(unsigned int thres_);
 	virtual ~LeadingEdgePicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
+	virtual bool Triggered(double pick, size_t size) const override;
 private:
 	unsigned int threshold;
 };
@@ -85,7 +107,9 @@ public:
 	ZeroCrossPicker(size_t ts_, unsigned int thres_, bool cubic_);
 	virtual ~ZeroCrossPicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
 	virtual double Pick(const std::vector<double> &data) override;
+	virtual double PickShifted(const std::vector<double> &data, long long shift) override;
 private:
 	size_t ts;
 	unsigned int threshold;
@@ -99,7 +123,10 @@ public:
 	DigitalFractionPicker(size_t ts_, double fraction_, bool cubic_, size_t baseLen_);
 	virtual ~DigitalFractionPicker();
 	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
 	virtual double Pick(const std::vector<double> &data) override;
+	virtual double PickShifted(const std::vector<double> &data, long long shift) override;
 private:
 	size_t ts;
 	double fraction;
@@ -111,6 +138,56 @@ private:
 };
 
 
+// count the triggers in the inspection window after the first trigger
+class PileupPicker: public Picker {
+public:
+	PileupPicker(unsigned int thres_, size_t window_);
+	virtual ~PileupPicker();
+	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Pick(const std::vector<double> &data) override;
+private:
+	unsigned int threshold;
+	size_t window;
+};
+
+
+// pick all the triggers with retrigger holdoff, Pick returns the count
+class MultiHitPicker: public Picker {
+public:
+	MultiHitPicker(unsigned int thres_, size_t holdoff_, size_t maxHits_);
+	virtual ~MultiHitPicker();
+	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Pick(const std::vector<double> &data) override;
+	virtual const std::vector<size_t> &GetHits() const;
+private:
+	unsigned int threshold;
+	size_t holdoff;
+	size_t maxHits;
+	std::vector<size_t> hits;
+};
+
+
+// pick the zero cross point on the upsampled data around the first crossing
+class UpsampleZeroCrossPicker: public Picker {
+public:
+	UpsampleZeroCrossPicker(size_t ts_, unsigned int thres_, unsigned int factor_, bool cubic_, size_t taps_ = 16);
+	virtual ~UpsampleZeroCrossPicker();
+	virtual std::unique_ptr<Picker> Clone() const override;
+	virtual std::string Signature() const override;
+	virtual double Cost(size_t samples) const override;
+	virtual double Pick(const std::vector<double> &data) override;
+	virtual double PickShifted(const std::vector<double> &data, long long shift) override;
+private:
+	size_t ts;
+	unsigned int threshold;
+	bool cubic;
+
+	PolyphaseUpsampler upsampler;
+};
+
+
 
 
 
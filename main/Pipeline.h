@@ -0,0 +1,187 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+#include <condition_variable>
+
+
+// Bounded lock-free ring buffer
+//  Multi-producer multi-consumer queue with a sequence number in each cell
+//  (D. Vyukov's bounded queue). The capacity is rounded up to a power of 2.
+//  Push and Pop spin and yield a while when the buffer is full or empty, then
+//  sleep until the other side pops or pushes, which is the back-pressure
+//  between the pipeline stages, and give up on abort. The one who aborts
+//  calls Wake so the sleeping ones see it.
+
+template<class T>
+class RingBuffer {
+public:
+	RingBuffer(size_t capacity_);
+	~RingBuffer() = default;
+
+	// try once, return false if full or empty
+	bool TryPush(const T &value);
+	bool TryPop(T &value);
+	// wait until done, return false if aborted
+	bool Push(const T &value, const std::atomic<bool> &abort);
+	bool Pop(T &value, const std::atomic<bool> &abort);
+	// wake all sleeping Push and Pop to check the abort
+	void Wake();
+private:
+	// tries before Push and Pop sleep
+	static constexpr int SpinCount = 64;
+
+	// notify the sleepers of the other side, if any
+	void Notify(std::atomic<size_t> &waiters, std::condition_variable &cv);
+
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	size_t mask;
+	std::unique_ptr<Cell[]> cells;
+	alignas(64) std::atomic<size_t> head;			// next position to push
+	alignas(64) std::atomic<size_t> tail;			// next position to pop
+	alignas(64) std::atomic<size_t> pushWaiters;	// sleeping in Push
+	std::atomic<size_t> popWaiters;					// sleeping in Pop
+	std::mutex sleepMutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+};
+
+
+template<class T>
+RingBuffer<T>::RingBuffer(size_t capacity_) {
+	size_t capacity = 2;
+	while (capacity < capacity_) capacity <<= 1;
+	mask = capacity - 1;
+	cells = std::make_unique<Cell[]>(capacity);
+	for (size_t i = 0; i != capacity; ++i) {
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	pushWaiters.store(0, std::memory_order_relaxed);
+	popWaiters.store(0, std::memory_order_relaxed);
+}
+
+
+template<class T>
+bool RingBuffer<T>::TryPush(const T &value) {
+	size_t pos = head.load(std::memory_order_relaxed);
+	for (;;) {
+		Cell &cell = cells[pos & mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		long long diff = (long long)seq - (long long)pos;
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				cell.value = value;
+				cell.sequence.store(pos+1, std::memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			return false;						// full
+		} else {
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+template<class T>
+bool RingBuffer<T>::TryPop(T &value) {
+	size_t pos = tail.load(std::memory_order_relaxed);
+	for (;;) {
+		Cell &cell = cells[pos & mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		long long diff = (long long)seq - (long long)(pos+1);
+		if (diff == 0) {
+			if (tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+				value = cell.value;
+				cell.sequence.store(pos+mask+1, std::memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			return false;						// empty
+		} else {
+			pos = tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+// the waiter count is raised before the last try and read after the cell is
+// taken, both behind a full fence, so either the sleeper sees the change or
+// the other side sees the sleeper and no wake is lost
+template<class T>
+void RingBuffer<T>::Notify(std::atomic<size_t> &waiters, std::condition_variable &cv) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!waiters.load(std::memory_order_relaxed)) return;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	cv.notify_one();
+}
+
+
+template<class T>
+bool RingBuffer<T>::Push(const T &value, const std::atomic<bool> &abort) {
+	for (int i = 0; !TryPush(value); ++i) {
+		if (abort.load(std::memory_order_relaxed)) return false;
+		if (i < SpinCount) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		pushWaiters.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool pushed = false;
+		notFull.wait(lock, [&]() {
+			return abort.load(std::memory_order_relaxed) || (pushed = TryPush(value));
+		});
+		pushWaiters.fetch_sub(1, std::memory_order_relaxed);
+		if (pushed) break;
+	}
+	Notify(popWaiters, notEmpty);
+	return true;
+}
+
+
+template<class T>
+bool RingBuffer<T>::Pop(T &value, const std::atomic<bool> &abort) {
+	for (int i = 0; !TryPop(value); ++i) {
+		if (abort.load(std::memory_order_relaxed)) return false;
+		if (i < SpinCount) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		popWaiters.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool popped = false;
+		notEmpty.wait(lock, [&]() {
+			return abort.load(std::memory_order_relaxed) || (popped = TryPop(value));
+		});
+		popWaiters.fetch_sub(1, std::memory_order_relaxed);
+		if (popped) break;
+	}
+	Notify(pushWaiters, notFull);
+	return true;
+}
+
+
+template<class T>
+void RingBuffer<T>::Wake() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	notFull.notify_all();
+	notEmpty.notify_all();
+}
+
+#endif
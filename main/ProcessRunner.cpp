@@ -0,0 +1,186 @@
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <set>
+#include <new>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ProcessRunner.h"
+
+
+//--------------------------------------------------
+//					ProcessRunner
+//--------------------------------------------------
+
+ProcessRunner::ProcessRunner(size_t workers_, size_t retries_) {
+	workers = workers_ ? workers_ : 1;
+	retries = retries_;
+}
+
+
+ProcessRunner::~ProcessRunner() {
+}
+
+
+void ProcessRunner::Run(const std::vector<std::string> &names, const Init &init, const Task &task, const Collect &collect) {
+	size_t tasks = names.size();
+	if (!tasks) return;
+
+	// unlinked right after mapping, the forked workers share the mapping and
+	// nothing is left behind when this process dies
+	std::string shmName = "/sim-runner-" + std::to_string(getpid());
+	int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) throw std::runtime_error("Error: open shared memory " + shmName + ".");
+	size_t bytes = tasks * sizeof(Slot);
+	void *memory = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	shm_unlink(shmName.c_str());
+	if (memory == MAP_FAILED) throw std::runtime_error("Error: map shared memory " + shmName + ".");
+	Slot *slots = (Slot*)memory;
+	for (size_t i = 0; i != tasks; ++i) {
+		new (&slots[i].state) std::atomic<int>(Pending);
+		slots[i].size = 0;
+	}
+
+	std::set<int> live;
+	std::vector<bool> ended(tasks, false);
+	std::vector<size_t> attempts(tasks, 0);
+	std::vector<std::string> errors;
+	size_t endedTasks = 0;
+	// a worker failing before its first task would be replaced forever
+	size_t spawns = workers + tasks * (retries + 1);
+	try {
+		for (size_t w = 0; w != std::min(workers, tasks); ++w) {
+			live.insert(Spawn(slots, tasks, init, task));
+			--spawns;
+		}
+		while (endedTasks != tasks) {
+			for (size_t i = 0; i != tasks; ++i) {
+				if (ended[i]) continue;
+				int state = slots[i].state.load(std::memory_order_acquire);
+				if (state != Done && state != Failed) continue;
+				ended[i] = true;
+				++endedTasks;
+				std::string text(slots[i].result, slots[i].size);
+				if (state == Done) {
+					collect(i, text);
+				} else {
+					errors.push_back(names[i] + ": " + text);
+				}
+			}
+			if (endedTasks == tasks) break;
+
+			int status;
+			int pid = waitpid(-1, &status, WNOHANG);
+			if (pid > 0 && live.erase(pid)) {
+				// a worker exits by itself only without any task pending
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+					std::string reason = WIFSIGNALED(status)
+						? "killed by signal " + std::to_string(WTERMSIG(status))
+						: "exited with " + std::to_string(WEXITSTATUS(status));
+					for (size_t i = 0; i != tasks; ++i) {
+						if (slots[i].state.load(std::memory_order_acquire) != pid) continue;
+						if (++attempts[i] > retries) {
+							Finish(slots[i], "worker " + reason + " " + std::to_string(attempts[i]) + " times", Failed);
+						} else {
+							std::cerr << "Worker " << pid << " of " << names[i] << " " << reason << ", run it again." << std::endl;
+							slots[i].state.store(Pending, std::memory_order_release);
+						}
+					}
+				}
+				// the results of the worker are complete now
+				continue;
+			}
+
+			size_t pending = 0;
+			for (size_t i = 0; i != tasks; ++i) {
+				if (slots[i].state.load(std::memory_order_acquire) == Pending) ++pending;
+			}
+			if (pending && live.size() < workers) {
+				if (!spawns) throw std::runtime_error("Error: worker processes keep failing before their tasks.");
+				live.insert(Spawn(slots, tasks, init, task));
+				--spawns;
+				continue;
+			}
+			if (!pending && live.empty()) throw std::runtime_error("Error: tasks left without worker processes.");
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	} catch (...) {
+		for (int pid : live) kill(pid, SIGKILL);
+		for (int pid : live) waitpid(pid, nullptr, 0);
+		munmap(memory, bytes);
+		throw;
+	}
+	// the workers find no task left and exit
+	for (int pid : live) waitpid(pid, nullptr, 0);
+	munmap(memory, bytes);
+
+	if (errors.size()) {
+		for (auto &error : errors) std::cerr << error << std::endl;
+		throw std::runtime_error("Error: " + std::to_string(errors.size()) + " of " + std::to_string(tasks) + " tasks failed in the worker processes.");
+	}
+}
+
+
+int ProcessRunner::Spawn(Slot *slots, size_t tasks, const Init &init, const Task &task) {
+	// the buffered output would be written by both processes
+	std::cout.flush();
+	std::cerr.flush();
+	std::fflush(nullptr);
+	int pid = fork();
+	if (pid < 0) throw std::runtime_error("Error: fork worker process.");
+	if (pid) return pid;
+
+	int code = 0;
+	try {
+		Work(slots, tasks, init, task);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		code = 1;
+	}
+	std::cout.flush();
+	std::cerr.flush();
+	std::fflush(nullptr);
+	// no exit handlers and destructors on the state copied from the parent
+	_exit(code);
+}
+
+
+void ProcessRunner::Work(Slot *slots, size_t tasks, const Init &init, const Task &task) {
+	int self = getpid();
+	init();
+	for (;;) {
+		size_t index = tasks;
+		for (size_t i = 0; i != tasks; ++i) {
+			int expected = Pending;
+			if (slots[i].state.compare_exchange_strong(expected, self, std::memory_order_acq_rel)) {
+				index = i;
+				break;
+			}
+		}
+		if (index == tasks) return;
+		try {
+			std::string result = task(index);
+			if (result.size() > ResultBytes) throw std::runtime_error("Error: result of the task longer than " + std::to_string(ResultBytes) + " bytes.");
+			Finish(slots[index], result, Done);
+		} catch (const std::exception &e) {
+			Finish(slots[index], e.what(), Failed);
+		}
+	}
+}
+
+
+void ProcessRunner::Finish(Slot &slot, const std::string &text, int state) {
+	slot.size = (unsigned int)std::min(text.size(), ResultBytes);
+	std::memcpy(slot.result, text.data(), slot.size);
+	slot.state.store(state, std::memory_order_release);
+}
@@ -0,0 +1,72 @@
+#ifndef __PROCESSRUNNER_H__
+#define __PROCESSRUNNER_H__
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <atomic>
+
+
+// Tasks of a sweep in worker processes
+//  The workers are forked after the configurations are set up, so each one has
+//  its own copy of them and of the ROOT state. The tasks are claimed in order
+//  from a table in POSIX shared memory, and each worker writes the state and
+//  the result of its task into the slot of it. This process polls the table,
+//  collects the results as they finish and replaces the workers that die: the
+//  task of a worker killed by a signal or exiting with an error runs again in
+//  a new worker, at most retries times.
+
+class ProcessRunner {
+public:
+	/*
+	 * constructor
+	 *  @workers_: Worker processes, at least 1.
+	 *  @retries_: Runs of a task again after its worker died.
+	 */
+	ProcessRunner(size_t workers_, size_t retries_);
+	virtual ~ProcessRunner();
+
+	// called in each worker after the fork
+	using Init = std::function<void()>;
+	// runs the task of the index in a worker and returns its result
+	using Task = std::function<std::string(size_t)>;
+	// called in this process with the result of each finished task
+	using Collect = std::function<void(size_t, const std::string&)>;
+
+	/*
+	 * Run
+	 *  @names: Name of each task in the messages, the tasks are claimed in this order.
+	 *  @init: Called once in each worker before its first task.
+	 *  @task: Called in the workers, an exception fails the task without retrying it.
+	 *  @collect: Called here as the tasks finish.
+	 *  @return: Throws after all tasks ended if any of them failed.
+	 */
+	virtual void Run(const std::vector<std::string> &names, const Init &init, const Task &task, const Collect &collect);
+
+	// bytes of the result of a task at most
+	static constexpr size_t ResultBytes = 1024;
+private:
+	// slot of a task in the shared memory
+	struct Slot {
+		// Pending, Done, Failed, or the pid of the worker running it
+		std::atomic<int> state;
+		unsigned int size;
+		char result[ResultBytes];
+	};
+	static constexpr int Pending = 0;
+	static constexpr int Done = -1;
+	static constexpr int Failed = -2;
+	static_assert(std::atomic<int>::is_always_lock_free, "shared state needs lock free atomics");
+
+	// fork a worker claiming tasks until none is pending
+	int Spawn(Slot *slots, size_t tasks, const Init &init, const Task &task);
+	// claim and run the tasks, in the worker
+	static void Work(Slot *slots, size_t tasks, const Init &init, const Task &task);
+	// the message or the result into the slot and then the state
+	static void Finish(Slot &slot, const std::string &text, int state);
+
+	size_t workers;
+	size_t retries;
+};
+
+#endif
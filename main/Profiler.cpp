@@ -0,0 +1,211 @@
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "Profiler.h"
+#include "../lib/json.hpp"
+
+
+//--------------------------------------------------
+//					Profiler
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @stages_: Names of the stages, the index is used by Mark.
+ *  @sample_: Profile 1 in sample_ entries, 0 for none.
+ */
+Profiler::Profiler(const std::vector<std::string> &stages_, unsigned int sample_):
+stages(stages_), sample(sample_) {
+	active = false;
+	last = 0;
+	size_t n = stages.size();
+	current.assign(n, 0);
+	touched.assign(n, false);
+	histograms.assign(n, std::vector<unsigned long long>(Buckets, 0));
+	counts.assign(n, 0);
+	sums.assign(n, 0);
+	maxs.assign(n, 0);
+	// calibrate before the hot loop
+	if (sample) NsPerTick();
+}
+
+
+Profiler::~Profiler() {
+}
+
+
+// finish the entry and record the stages it passed
+void Profiler::End() {
+	if (!active) return;
+	for (size_t s = 0; s != stages.size(); ++s) {
+		if (!touched[s]) continue;
+		unsigned long long ticks = current[s];
+		++counts[s];
+		sums[s] += ticks;
+#ifdef SIM_PROFILE
+		++histograms[s][Bucket(ticks)];
+		maxs[s] = ticks > maxs[s] ? ticks : maxs[s];
+#endif
+		current[s] = 0;
+		touched[s] = false;
+	}
+	active = false;
+	return;
+}
+
+
+// Merge the profiler of another thread, the stages must be the same
+void Profiler::Merge(const Profiler &other) {
+	if (other.stages != stages) {
+		throw std::runtime_error("Error: merge profilers of different stages.");
+	}
+	for (size_t s = 0; s != stages.size(); ++s) {
+		for (size_t b = 0; b != Buckets; ++b) {
+			histograms[s][b] += other.histograms[s][b];
+		}
+		counts[s] += other.counts[s];
+		sums[s] += other.sums[s];
+		maxs[s] = other.maxs[s] > maxs[s] ? other.maxs[s] : maxs[s];
+	}
+	return;
+}
+
+
+// Tick
+//  Read the TSC on x86, it's invariant on the CPUs we run on. Others use the
+//  steady clock in ns.
+unsigned long long Profiler::Tick() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+#endif
+}
+
+
+// NsPerTick
+//  Calibrate the TSC against the steady clock over 20 ms, only once.
+double Profiler::NsPerTick() {
+	static double nsPerTick = 1.0;
+	static std::once_flag calibrated;
+	std::call_once(calibrated, [] {
+#if defined(__x86_64__) || defined(__i386__)
+		auto start = std::chrono::steady_clock::now();
+		unsigned long long startTick = Tick();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		auto stop = std::chrono::steady_clock::now();
+		unsigned long long stopTick = Tick();
+		double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+		if (stopTick > startTick) nsPerTick = ns / double(stopTick - startTick);
+#endif
+	});
+	return nsPerTick;
+}
+
+
+// bucket of the ticks, linear below SubBuckets and log-linear above
+size_t Profiler::Bucket(unsigned long long ticks) {
+	if (ticks < SubBuckets) return ticks;
+	size_t exponent = 63 - __builtin_clzll(ticks);					// ticks in [2^e, 2^(e+1))
+	size_t sub = (ticks >> (exponent - 3)) & (SubBuckets - 1);		// next 3 bits
+	return (exponent - 2) * SubBuckets + sub;
+}
+
+
+// lower edge of the bucket in ticks
+unsigned long long Profiler::BucketLow(size_t bucket) {
+	if (bucket < SubBuckets) return bucket;
+	size_t exponent = bucket / SubBuckets + 2;
+	size_t sub = bucket % SubBuckets;
+	return (1ull << exponent) + ((unsigned long long)sub << (exponent - 3));
+}
+
+
+// percentile of the stage latency in ns, the lower edge of the bucket
+double Profiler::Percentile(size_t stage, double p) const {
+	if (!counts[stage]) return 0.0;
+	unsigned long long target = (unsigned long long)(p * double(counts[stage]));
+	if (target >= counts[stage]) target = counts[stage] - 1;
+	unsigned long long seen = 0;
+	for (size_t b = 0; b != Buckets; ++b) {
+		seen += histograms[stage][b];
+		if (seen > target) return BucketLow(b) * NsPerTick();
+	}
+	return Max(stage);
+}
+
+
+double Profiler::Max(size_t stage) const {
+	return maxs[stage] * NsPerTick();
+}
+
+
+double Profiler::Mean(size_t stage) const {
+	if (!counts[stage]) return 0.0;
+	return double(sums[stage]) / double(counts[stage]) * NsPerTick();
+}
+
+
+unsigned long long Profiler::Count(size_t stage) const {
+	return counts[stage];
+}
+
+
+// Summary in table for the run summary, latency in ns, the percentiles only with SIM_PROFILE
+std::string Profiler::Summary() const {
+	std::stringstream ss;
+#ifdef SIM_PROFILE
+	ss << "stage   samples   mean(ns)  p50(ns)   p99(ns)   max(ns)" << std::endl;
+#else
+	ss << "stage   samples   mean(ns)" << std::endl;
+#endif
+	ss << std::left << std::fixed << std::setprecision(0);
+	for (size_t s = 0; s != stages.size(); ++s) {
+		ss << std::setw(8) << stages[s] << std::setw(10) << counts[s];
+#ifdef SIM_PROFILE
+		ss << std::setw(10) << Mean(s) << std::setw(10) << Percentile(s, 0.5) << std::setw(10) << Percentile(s, 0.99);
+		ss << Max(s) << std::endl;
+#else
+		ss << Mean(s) << std::endl;
+#endif
+	}
+	return ss.str();
+}
+
+
+// Write the summary in json
+//  @file: json file name
+//  @name: name of the profiled configuration
+void Profiler::Write(const std::string &file, const std::string &name) const {
+	nlohmann::json js;
+	js["Configuration"] = name;
+	js["Sample"] = sample;
+	js["NsPerTick"] = NsPerTick();
+	for (size_t s = 0; s != stages.size(); ++s) {
+		nlohmann::json stage;
+		stage["Samples"] = counts[s];
+		stage["p50"] = Percentile(s, 0.5);
+		stage["p99"] = Percentile(s, 0.99);
+		stage["Max"] = Max(s);
+		stage["Mean"] = Mean(s);
+		js["Stages"][stages[s]] = stage;
+	}
+	std::ofstream output(file);
+	if (!output.good()) {
+		throw std::runtime_error("Error: open profile file " + file + " failed.");
+	}
+	output << std::setw(4) << js << std::endl;
+	output.close();
+	return;
+}
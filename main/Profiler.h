@@ -0,0 +1,80 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <vector>
+#include <string>
+
+
+// Sampled stage profiler
+//  Reads the TSC (or the steady clock on other CPUs) at the stage boundaries
+//  of 1-in-N entries and counts the samples and the time of each stage, which
+//  is always on since it's a few adds per sampled entry. With SIM_PROFILE
+//  defined (DEFINES in Makefile) the per-entry latency of each stage is also
+//  recorded in a log-linear histogram for the percentiles and the max. A
+//  sample of 0 turns it off, the marks are then a branch without clock reads.
+
+#define PROFILE_BEGIN(profiler, entry) (profiler).Begin(entry)
+#define PROFILE_MARK(profiler, stage) (profiler).Mark(stage)
+#define PROFILE_END(profiler) (profiler).End()
+
+
+class Profiler {
+public:
+	Profiler(const std::vector<std::string> &stages_, unsigned int sample_ = 64);
+	virtual ~Profiler();
+
+	// start an entry, it's profiled if it's sampled
+	inline void Begin(unsigned long long entry) {
+		active = sample && entry % sample == 0;
+		if (active) last = Tick();
+	}
+	// add the time since the last mark to the stage
+	inline void Mark(size_t stage) {
+		if (!active) return;
+		unsigned long long now = Tick();
+		current[stage] += now - last;
+		touched[stage] = true;
+		last = now;
+	}
+	// finish the entry and record the stages it passed
+	void End();
+	// add the statistics of another profiler with the same stages
+	void Merge(const Profiler &other);
+
+	// percentile of the stage latency in ns, e.g. 0.5, 0.99, 0 without SIM_PROFILE
+	virtual double Percentile(size_t stage, double p) const;
+	// 0 without SIM_PROFILE
+	virtual double Max(size_t stage) const;
+	virtual double Mean(size_t stage) const;
+	virtual unsigned long long Count(size_t stage) const;
+	virtual std::string Summary() const;
+	// write the summary in json, name is the profiled configuration
+	virtual void Write(const std::string &file, const std::string &name) const;
+
+	// ticks of the TSC or ns of the steady clock
+	static unsigned long long Tick();
+	// ns of one tick, calibrated once against the steady clock
+	static double NsPerTick();
+private:
+	// log-linear buckets, 8 sub-buckets in each power of 2
+	static constexpr size_t SubBuckets = 8;
+	static constexpr size_t Buckets = 64 * SubBuckets;
+	static size_t Bucket(unsigned long long ticks);
+	static unsigned long long BucketLow(size_t bucket);
+
+	std::vector<std::string> stages;
+	unsigned int sample;
+
+	bool active;
+	unsigned long long last;
+	std::vector<unsigned long long> current;
+	std::vector<bool> touched;
+
+	// statistics in ticks
+	std::vector<std::vector<unsigned long long>> histograms;
+	std::vector<unsigned long long> counts;
+	std::vector<unsigned long long> sums;
+	std::vector<unsigned long long> maxs;
+};
+
+#endif
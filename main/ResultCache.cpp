@@ -0,0 +1,231 @@
+#include <stdexcept>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <cstdio>
+
+#include "ResultCache.h"
+// SIM_VERSION, generated by make
+#include "version.h"
+
+namespace fs = std::filesystem;
+
+
+static const unsigned long long FNVOffset = 1469598103934665603ull;
+static const unsigned long long FNVPrime = 1099511628211ull;
+
+// FNV-1a hash of the bytes, continued from hash
+static unsigned long long FNV(const char *data, size_t size, unsigned long long hash = FNVOffset) {
+	for (size_t i = 0; i != size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= FNVPrime;
+	}
+	return hash;
+}
+
+
+static std::string Hex(unsigned long long value) {
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%016llx", value);
+	return buffer;
+}
+
+
+//--------------------------------------------------
+//					ResultCache
+//--------------------------------------------------
+
+ResultCache::ResultCache(const std::string &path_, unsigned long long maxBytes_) {
+	path = path_;
+	if (path.size() && path.back() != '/') path += "/";
+	maxBytes = maxBytes_;
+	std::error_code error;
+	fs::create_directories(path, error);
+	if (error) throw std::runtime_error("Error: create cache directory " + path + ".");
+}
+
+
+ResultCache::~ResultCache() {
+}
+
+
+// Key of the description, two hashes of different seeds to make collisions unlikely
+std::string ResultCache::Key(const std::string &description) {
+	std::string text = description + "\nversion " + SIM_VERSION + "\nformat " + std::to_string(Format);
+	unsigned long long first = FNV(text.data(), text.size());
+	unsigned long long second = FNV(text.data(), text.size(), first ^ 0x9e3779b97f4a7c15ull);
+	return Hex(first) + Hex(second);
+}
+
+
+// The head of the file tells a replaced file of the same size and time apart
+std::string ResultCache::FileIdentity(const std::string &fileName) {
+	std::error_code error;
+	fs::path file = fs::absolute(fileName, error);
+	auto size = fs::file_size(file, error);
+	if (error) throw std::runtime_error("Error: read identity of file " + fileName + ".");
+	auto time = fs::last_write_time(file, error).time_since_epoch().count();
+
+	std::ifstream input(file, std::ios::binary);
+	std::vector<char> head(64 * 1024);
+	input.read(head.data(), head.size());
+	unsigned long long hash = FNV(head.data(), size_t(input.gcount()));
+
+	return file.string() + " " + std::to_string(size) + " " + std::to_string(time) + " " + Hex(hash);
+}
+
+
+/*
+ * Restore
+ *  Every file is copied into a temporary one and checked by the size and the
+ *  hash in the manifest, only a consistent entry replaces the output files.
+ */
+bool ResultCache::Restore(const std::string &key, const std::string &stem, nlohmann::json *extra) {
+	fs::path entry = fs::path(path) / key;
+	fs::path manifestFile = entry / "manifest.json";
+	std::error_code error;
+	if (!fs::exists(manifestFile, error)) return false;
+
+	nlohmann::json manifest;
+	std::vector<std::pair<fs::path, fs::path>> restored;
+	bool consistent = true;
+	try {
+		std::ifstream input(manifestFile);
+		input >> manifest;
+		if (int(manifest["Format"]) != Format) consistent = false;
+		for (auto &file : manifest["Files"]) {
+			if (!consistent) break;
+			// the name of the file in the entry is its extension
+			std::string name = file["Name"];
+			fs::path to = stem + name;
+			fs::path temporary = to;
+			temporary += ".restore";
+			restored.emplace_back(temporary, to);
+			unsigned long long bytes = 0;
+			unsigned long long hash = Copy((entry / name).string(), temporary.string(), bytes);
+			if (bytes != (unsigned long long)(file["Bytes"]) || Hex(hash) != std::string(file["Hash"])) {
+				consistent = false;
+			}
+		}
+	} catch (const std::exception &) {
+		consistent = false;
+	}
+
+	if (!consistent) {
+		for (auto &file : restored) fs::remove(file.first, error);
+		fs::remove_all(entry, error);
+		return false;
+	}
+	for (auto &file : restored) fs::rename(file.first, file.second);
+	if (extra) *extra = manifest.contains("Extra") ? manifest["Extra"] : nlohmann::json::object();
+	// the time of the manifest is the last use of the eviction
+	fs::last_write_time(manifestFile, fs::file_time_type::clock::now(), error);
+	return true;
+}
+
+
+/*
+ * Store
+ *  The entry is written in a temporary directory and renamed, so a run killed
+ *  while storing leaves no entry and the parallel runs never see half of one.
+ *
+ *  @key: Key of the configuration.
+ *  @description: Description of the key, kept for the inspection.
+ *  @stem: Path of the output files without the extension.
+ *  @files: Output files of the run, the missing ones are skipped.
+ *  @extra: Extra results restored with the files.
+ */
+void ResultCache::Store(const std::string &key, const std::string &description, const std::string &stem, const std::vector<std::string> &files, const nlohmann::json &extra) {
+	fs::path entry = fs::path(path) / key;
+	fs::path temporary = fs::path(path) / (key + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())));
+	std::error_code error;
+	fs::remove_all(temporary, error);
+	fs::create_directories(temporary);
+
+	nlohmann::json manifest;
+	manifest["Format"] = Format;
+	manifest["Version"] = SIM_VERSION;
+	manifest["Description"] = description;
+	manifest["Files"] = nlohmann::json::array();
+	for (auto &file : files) {
+		if (!fs::exists(file, error)) continue;
+		if (file.compare(0, stem.size(), stem) != 0) {
+			fs::remove_all(temporary, error);
+			throw std::runtime_error("Error: cached file " + file + " is not an output of " + stem + ".");
+		}
+		std::string name = file.substr(stem.size());
+		unsigned long long bytes = 0;
+		unsigned long long hash = Copy(file, (temporary / name).string(), bytes);
+		manifest["Files"].push_back({{"Name", name}, {"Bytes", bytes}, {"Hash", Hex(hash)}});
+	}
+	manifest["Extra"] = extra;
+	std::ofstream output(temporary / "manifest.json");
+	output << manifest.dump(1, '\t') << std::endl;
+	output.close();
+	if (!output) {
+		fs::remove_all(temporary, error);
+		throw std::runtime_error("Error: write cache entry " + key + ".");
+	}
+
+	// the entry of another run of the same key is replaced
+	fs::remove_all(entry, error);
+	fs::rename(temporary, entry, error);
+	if (error) fs::remove_all(temporary, error);
+}
+
+
+// Remove the entries by the time of the last use, the oldest first
+void ResultCache::Evict() {
+	if (!maxBytes) return;
+	struct Entry {
+		fs::path path;
+		fs::file_time_type used;
+		unsigned long long bytes;
+	};
+	std::vector<Entry> entries;
+	unsigned long long total = 0;
+	std::error_code error;
+	for (auto &directory : fs::directory_iterator(path, error)) {
+		if (!directory.is_directory()) continue;
+		fs::path manifestFile = directory.path() / "manifest.json";
+		Entry entry{directory.path(), fs::file_time_type::min(), 0};
+		// temporary or broken entries are the first evicted
+		if (fs::exists(manifestFile, error)) entry.used = fs::last_write_time(manifestFile, error);
+		for (auto &file : fs::directory_iterator(directory.path(), error)) {
+			entry.bytes += file.is_regular_file() ? (unsigned long long)file.file_size(error) : 0;
+		}
+		total += entry.bytes;
+		entries.push_back(entry);
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.used < b.used;
+	});
+	for (auto &entry : entries) {
+		if (total <= maxBytes) break;
+		fs::remove_all(entry.path, error);
+		total -= entry.bytes;
+	}
+}
+
+
+unsigned long long ResultCache::Copy(const std::string &from, const std::string &to, unsigned long long &bytes) {
+	std::ifstream input(from, std::ios::binary);
+	if (!input.good()) throw std::runtime_error("Error: open file " + from + ".");
+	std::ofstream output(to, std::ios::binary | std::ios::trunc);
+	if (!output.good()) throw std::runtime_error("Error: create file " + to + ".");
+	std::vector<char> buffer(1 << 20);
+	unsigned long long hash = FNVOffset;
+	bytes = 0;
+	while (input) {
+		input.read(buffer.data(), buffer.size());
+		size_t count = size_t(input.gcount());
+		if (!count) break;
+		hash = FNV(buffer.data(), count, hash);
+		output.write(buffer.data(), count);
+		bytes += count;
+	}
+	if (!output) throw std::runtime_error("Error: write file " + to + ".");
+	return hash;
+}
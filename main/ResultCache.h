@@ -0,0 +1,58 @@
+#ifndef __RESULTCACHE_H__
+#define __RESULTCACHE_H__
+
+#include <vector>
+#include <string>
+
+#include "../lib/json.hpp"
+
+
+// Content addressed cache of the simulation results
+//  An entry is a directory named by the hash of the description of the
+//  configuration: identity of the trace file, entries, filters, pickers and
+//  options, and the code version. It keeps the output files of the run and a
+//  manifest with the size and hash of each file, checked on every restore.
+//  The least recently restored entries are evicted when the cache is too big.
+
+class ResultCache {
+public:
+	/*
+	 * constructor
+	 *  @path_: Directory of the cache, created if missing.
+	 *  @maxBytes_: Bytes of all entries kept by Evict, 0 for no limit.
+	 */
+	ResultCache(const std::string &path_, unsigned long long maxBytes_);
+	virtual ~ResultCache();
+
+	// key of the description and the code version
+	static std::string Key(const std::string &description);
+	// identity of a file by its path, size, modification time and a hash of its head
+	static std::string FileIdentity(const std::string &fileName);
+
+	/*
+	 * Restore
+	 *  Copy the files of the entry to the outputs of this run.
+	 *
+	 *  @key: Key of the configuration.
+	 *  @stem: Path of the output files without the extension, the name of the
+	 *    configuration may differ from the one stored.
+	 *  @extra: Filled with the extra results stored with the files, if not null.
+	 *  @return: False if the entry is missing or inconsistent, it's removed then.
+	 */
+	virtual bool Restore(const std::string &key, const std::string &stem, nlohmann::json *extra = nullptr);
+	// store the output files of the run, all starting with the stem, and the extra results as the entry of the key
+	virtual void Store(const std::string &key, const std::string &description, const std::string &stem, const std::vector<std::string> &files, const nlohmann::json &extra = nlohmann::json::object());
+	// remove the least recently used entries until the cache fits
+	virtual void Evict();
+
+	// format of the entries, entries of other formats are never hit
+	static constexpr int Format = 1;
+private:
+	// copy the file and return the FNV-1a hash of its bytes
+	static unsigned long long Copy(const std::string &from, const std::string &to, unsigned long long &bytes);
+
+	std::string path;
+	unsigned long long maxBytes;
+};
+
+#endif
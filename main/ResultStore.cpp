@@ -0,0 +1,954 @@
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <functional>
+
+#include "TKey.h"
+#include "TLeaf.h"
+#include "TBranch.h"
+
+#ifdef SIM_RNTUPLE
+#include <ROOT/REntry.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleFillStatus.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#endif
+
+#include "ResultStore.h"
+
+
+// read one value of the type in double
+static double ValueAt(const char *p, char type) {
+	switch (type) {
+		case 'b': { std::uint8_t v; std::memcpy(&v, p, 1); return v; }
+		case 'B': { std::int8_t v; std::memcpy(&v, p, 1); return v; }
+		case 'O': { bool v; std::memcpy(&v, p, 1); return v; }
+		case 's': { std::uint16_t v; std::memcpy(&v, p, 2); return v; }
+		case 'S': { std::int16_t v; std::memcpy(&v, p, 2); return v; }
+		case 'i': { std::uint32_t v; std::memcpy(&v, p, 4); return v; }
+		case 'I': { std::int32_t v; std::memcpy(&v, p, 4); return v; }
+		case 'l': { std::uint64_t v; std::memcpy(&v, p, 8); return double(v); }
+		case 'L': { std::int64_t v; std::memcpy(&v, p, 8); return double(v); }
+		case 'F': { float v; std::memcpy(&v, p, 4); return v; }
+		case 'D': { double v; std::memcpy(&v, p, 8); return v; }
+	}
+	throw std::runtime_error(std::string("Error: invalid column type ") + type + ".");
+}
+
+
+// elements of the array in the row, limited by the length of the column
+static size_t ArrayLength(const char *row, const ResultColumn &column, const std::vector<ResultColumn> &columns) {
+	const ResultColumn &countColumn = columns[column.count];
+	double len = ValueAt(row + countColumn.offset, countColumn.type);
+	if (len <= 0.0) return 0;
+	return size_t(len) < column.length ? size_t(len) : column.length;
+}
+
+
+size_t ResultColumn::TypeSize(char type) {
+	switch (type) {
+		case 'b': case 'B': case 'O':
+			return 1;
+		case 's': case 'S':
+			return 2;
+		case 'i': case 'I': case 'F':
+			return 4;
+		case 'l': case 'L': case 'D':
+			return 8;
+	}
+	throw std::runtime_error(std::string("Error: invalid column type ") + type + ".");
+}
+
+
+//--------------------------------------------------
+//					ResultWriter
+//--------------------------------------------------
+
+ResultWriter::ResultWriter(const ResultOptions &options_) {
+	options = options_;
+	stride = 0;
+}
+
+
+ResultWriter::~ResultWriter() {
+}
+
+
+void ResultWriter::EndCluster() {
+}
+
+
+TTree *ResultWriter::GetTree() {
+	return nullptr;
+}
+
+
+bool ResultWriter::Resume(TFile *, const std::string &, const std::vector<ResultColumn> &, size_t, size_t) {
+	return false;
+}
+
+
+bool ResultWriter::Checkpoint() {
+	return false;
+}
+
+
+std::unique_ptr<ResultWriter> ResultWriter::Create(const std::string &backend, const ResultOptions &options) {
+	if (backend == "ttree") return std::make_unique<TTreeResultWriter>(options);
+	if (backend == "columnar") return std::make_unique<ColumnarResultWriter>(options);
+	if (backend == "rntuple") {
+#ifdef SIM_RNTUPLE
+		return std::make_unique<RNTupleResultWriter>(options);
+#else
+		throw std::runtime_error("Error: rntuple backend needs SIM_RNTUPLE defined.");
+#endif
+	}
+	throw std::runtime_error("Error: invalid output backend " + backend + ".");
+}
+
+
+bool ResultWriter::HasBackend(const std::string &backend) {
+	if (backend == "ttree" || backend == "columnar") return true;
+#ifdef SIM_RNTUPLE
+	if (backend == "rntuple") return true;
+#endif
+	return false;
+}
+
+
+// replace .root by .col
+std::string ResultWriter::ColumnarName(const std::string &fileName) {
+	std::string name = fileName;
+	if (name.size() > 5 && name.substr(name.size()-5) == ".root") {
+		name.resize(name.size()-5);
+	}
+	return name + ".col";
+}
+
+
+
+//--------------------------------------------------
+//				TTreeResultWriter
+//--------------------------------------------------
+
+TTreeResultWriter::TTreeResultWriter(const ResultOptions &options_): ResultWriter(options_) {
+	tree = nullptr;
+	clusterZipBytes = 0;
+}
+
+
+TTreeResultWriter::~TTreeResultWriter() {
+}
+
+
+void TTreeResultWriter::Open(TFile *file, const std::string &, const std::vector<ResultColumn> &columns_, size_t stride_) {
+	columns = columns_;
+	stride = stride_;
+	row.assign(stride, 0);
+
+	file->SetCompressionSettings(options.compression);
+	file->cd();
+	tree = new TTree("tree", "result table");
+	for (const auto &column : columns) {
+		std::string leaflist = column.leaf.empty() ? column.name : column.leaf;
+		if (column.count >= 0) {
+			const ResultColumn &countColumn = columns[column.count];
+			leaflist += "[" + (countColumn.leaf.empty() ? countColumn.name : countColumn.leaf) + "]";
+		}
+		leaflist += "/";
+		leaflist += column.type;
+		tree->Branch(column.name.c_str(), row.data()+column.offset, leaflist.c_str());
+	}
+	SetBranches();
+}
+
+
+/*
+ * Append
+ *  The batch is filled branch by branch instead of row by row, so only the
+ *  basket of one branch is touched at a time. A branch reads the value of the
+ *  row buffer, and an array also its count. The clusters are cut between
+ *  batches once they have the zipped bytes of the options, since the auto
+ *  flush of TTree::Fill is not used.
+ */
+void TTreeResultWriter::Append(const void *rows, size_t count) {
+	if (!count) return;
+	const char *data = static_cast<const char*>(rows);
+	for (size_t c = 0; c != columns.size(); ++c) {
+		const ResultColumn &column = columns[c];
+		size_t size = ResultColumn::TypeSize(column.type);
+		for (size_t r = 0; r != count; ++r) {
+			const char *source = data + r * stride;
+			size_t bytes = size;
+			if (column.count >= 0) {
+				const ResultColumn &countColumn = columns[column.count];
+				std::memcpy(row.data() + countColumn.offset, source + countColumn.offset, ResultColumn::TypeSize(countColumn.type));
+				bytes *= ArrayLength(source, column, columns);
+			}
+			std::memcpy(row.data() + column.offset, source + column.offset, bytes);
+			branches[c]->Fill();
+		}
+	}
+	tree->SetEntries(-1);
+	if (tree->GetZipBytes() - clusterZipBytes >= options.clusterBytes) EndCluster();
+}
+
+
+// replace the key of the last checkpoint
+void TTreeResultWriter::Close() {
+	if (tree) tree->Write("", TObject::kOverwrite);
+}
+
+
+// flush the baskets and start a new cluster
+void TTreeResultWriter::EndCluster() {
+	if (!tree) return;
+	tree->FlushBaskets(true);
+	clusterZipBytes = tree->GetZipBytes();
+}
+
+
+TTree *TTreeResultWriter::GetTree() {
+	return tree;
+}
+
+
+// The tree saved by the checkpoint, the branches read the row buffer again
+bool TTreeResultWriter::Resume(TFile *file, const std::string &, const std::vector<ResultColumn> &columns_, size_t stride_, size_t entries) {
+	TTree *saved = (TTree*)file->Get("tree");
+	if (!saved || size_t(saved->GetEntries()) != entries) return false;
+	for (const auto &column : columns_) {
+		if (!saved->GetBranch(column.name.c_str())) return false;
+	}
+	columns = columns_;
+	stride = stride_;
+	row.assign(stride, 0);
+	for (const auto &column : columns) {
+		saved->SetBranchAddress(column.name.c_str(), row.data()+column.offset);
+	}
+	tree = saved;
+	SetBranches();
+	return true;
+}
+
+
+void TTreeResultWriter::SetBranches() {
+	branches.clear();
+	for (const auto &column : columns) branches.push_back(tree->GetBranch(column.name.c_str()));
+	clusterZipBytes = tree->GetZipBytes();
+}
+
+
+// write the baskets and the tree header, the file header is saved with it
+bool TTreeResultWriter::Checkpoint() {
+	if (!tree) return false;
+	tree->AutoSave("SaveSelf");
+	return true;
+}
+
+
+
+//--------------------------------------------------
+//				ColumnarResultWriter
+//--------------------------------------------------
+
+constexpr char ColumnarResultWriter::Magic[9];
+
+
+ColumnarResultWriter::ColumnarResultWriter(const ResultOptions &options_): ResultWriter(options_) {
+}
+
+
+ColumnarResultWriter::~ColumnarResultWriter() {
+}
+
+
+void ColumnarResultWriter::Open(TFile *, const std::string &fileName, const std::vector<ResultColumn> &columns_, size_t stride_) {
+	columns = columns_;
+	stride = stride_;
+
+	std::string name = ColumnarName(fileName);
+	output.open(name, std::ios::binary | std::ios::trunc);
+	if (!output.good()) throw std::runtime_error("Error: open columnar file " + name + " failed.");
+
+	// header
+	output.write(Magic, 8);
+	std::uint32_t n = std::uint32_t(columns.size());
+	output.write(reinterpret_cast<const char*>(&n), sizeof(n));
+	for (const auto &column : columns) {
+		std::uint16_t len = std::uint16_t(column.name.size());
+		std::int32_t count = column.count;
+		std::uint32_t length = std::uint32_t(column.length);
+		output.write(reinterpret_cast<const char*>(&len), sizeof(len));
+		output.write(column.name.data(), len);
+		output.write(&column.type, 1);
+		output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+	}
+}
+
+
+// one block of the batch, the values of a column are contiguous
+void ColumnarResultWriter::Append(const void *rows, size_t count) {
+	const char *data = static_cast<const char*>(rows);
+	std::uint64_t n = count;
+	output.write(reinterpret_cast<const char*>(&n), sizeof(n));
+	for (const auto &column : columns) {
+		size_t size = ResultColumn::TypeSize(column.type);
+		buffer.clear();
+		if (column.count < 0) {
+			buffer.resize(count * size);
+			for (size_t r = 0; r != count; ++r) {
+				std::memcpy(buffer.data() + r * size, data + r * stride + column.offset, size);
+			}
+		} else {
+			for (size_t r = 0; r != count; ++r) {
+				const char *row = data + r * stride;
+				size_t len = ArrayLength(row, column, columns);
+				buffer.insert(buffer.end(), row + column.offset, row + column.offset + len * size);
+			}
+		}
+		std::uint64_t bytes = buffer.size();
+		output.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+		output.write(buffer.data(), buffer.size());
+	}
+	if (!output.good()) throw std::runtime_error("Error: write columnar file failed.");
+}
+
+
+void ColumnarResultWriter::Close() {
+	if (output.is_open()) output.close();
+}
+
+
+
+#ifdef SIM_RNTUPLE
+//--------------------------------------------------
+//				RNTupleResultWriter
+//--------------------------------------------------
+
+struct RNTupleResultWriter::Impl {
+	std::unique_ptr<ROOT::RNTupleWriter> writer;
+	// entry of the batch, the scalar fields read the row buffer directly
+	std::unique_ptr<ROOT::REntry> entry;
+	std::vector<char> row;
+	// bind the field to the entry
+	std::vector<std::function<void(ROOT::REntry&)>> binds;
+	// copy the array of the row into the vector field
+	std::vector<std::function<void(const char*)>> arrays;
+};
+
+
+template<class T>
+static void AddField(ROOT::RNTupleModel &model, const ResultColumn &column, const std::vector<ResultColumn> &columns, char *row, std::vector<std::function<void(ROOT::REntry&)>> &binds, std::vector<std::function<void(const char*)>> &arrays) {
+	std::string name = column.name;
+	if (column.count < 0) {
+		model.MakeField<T>(name);
+		char *value = row + column.offset;
+		binds.push_back([name, value](ROOT::REntry &entry) {
+			entry.BindRawPtr(name, value);
+		});
+		return;
+	}
+	// arrays are vector fields
+	model.MakeField<std::vector<T>>(name);
+	auto value = std::make_shared<std::vector<T>>();
+	binds.push_back([name, value](ROOT::REntry &entry) {
+		entry.BindValue<std::vector<T>>(name, value);
+	});
+	arrays.push_back([value, column, columns](const char *row) {
+		size_t len = ArrayLength(row, column, columns);
+		value->resize(len);
+		for (size_t i = 0; i != len; ++i) {
+			T v;
+			std::memcpy(&v, row + column.offset + i * sizeof(T), sizeof(T));
+			(*value)[i] = v;
+		}
+	});
+}
+
+
+RNTupleResultWriter::RNTupleResultWriter(const ResultOptions &options_): ResultWriter(options_) {
+	impl = std::make_unique<Impl>();
+}
+
+
+RNTupleResultWriter::~RNTupleResultWriter() {
+}
+
+
+void RNTupleResultWriter::Open(TFile *file, const std::string &, const std::vector<ResultColumn> &columns_, size_t stride_) {
+	columns = columns_;
+	stride = stride_;
+	impl->row.assign(stride, 0);
+
+	auto model = ROOT::RNTupleModel::Create();
+	char *row = impl->row.data();
+	auto &binds = impl->binds;
+	auto &arrays = impl->arrays;
+	for (const auto &column : columns) {
+		switch (column.type) {
+			case 'b': AddField<std::uint8_t>(*model, column, columns, row, binds, arrays); break;
+			case 'B': AddField<std::int8_t>(*model, column, columns, row, binds, arrays); break;
+			case 'O': AddField<bool>(*model, column, columns, row, binds, arrays); break;
+			case 's': AddField<std::uint16_t>(*model, column, columns, row, binds, arrays); break;
+			case 'S': AddField<std::int16_t>(*model, column, columns, row, binds, arrays); break;
+			case 'i': AddField<std::uint32_t>(*model, column, columns, row, binds, arrays); break;
+			case 'I': AddField<std::int32_t>(*model, column, columns, row, binds, arrays); break;
+			case 'l': AddField<std::uint64_t>(*model, column, columns, row, binds, arrays); break;
+			case 'L': AddField<std::int64_t>(*model, column, columns, row, binds, arrays); break;
+			case 'F': AddField<float>(*model, column, columns, row, binds, arrays); break;
+			case 'D': AddField<double>(*model, column, columns, row, binds, arrays); break;
+			default:
+				throw std::runtime_error(std::string("Error: invalid column type ") + column.type + ".");
+		}
+	}
+
+	ROOT::RNTupleWriteOptions writeOptions;
+	writeOptions.SetCompression(options.compression);
+	writeOptions.SetApproxZippedClusterSize(options.clusterBytes);
+	impl->writer = ROOT::RNTupleWriter::Append(std::move(model), "tree", *file, writeOptions);
+	impl->entry = impl->writer->CreateEntry();
+	for (auto &bind : impl->binds) bind(*impl->entry);
+}
+
+
+/*
+ * Append
+ *  The batch is filled without flushing, one copy of each row and the
+ *  arrays, and the cluster is committed between the batches only, so a
+ *  batch of the shared table is never split.
+ */
+void RNTupleResultWriter::Append(const void *rows, size_t count) {
+	const char *data = static_cast<const char*>(rows);
+	ROOT::RNTupleFillStatus status;
+	for (size_t r = 0; r != count; ++r) {
+		const char *row = data + r * stride;
+		std::memcpy(impl->row.data(), row, stride);
+		for (auto &array : impl->arrays) array(row);
+		impl->writer->FillNoFlush(*impl->entry, status);
+	}
+	if (count && status.ShouldFlushCluster()) impl->writer->CommitCluster();
+}
+
+
+// the dataset is committed when the writer is destroyed
+void RNTupleResultWriter::Close() {
+	impl->writer.reset();
+}
+
+
+void RNTupleResultWriter::EndCluster() {
+	impl->writer->CommitCluster();
+}
+#endif
+
+
+
+//--------------------------------------------------
+//				SharedResultTable
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @fileName_: Path of the ROOT file of the sweep.
+ *  @backend: Backend of the table.
+ *  @options_: Options of the writer, clusterRows is the rows of a cluster.
+ */
+SharedResultTable::SharedResultTable(const std::string &fileName_, const std::string &backend, const ResultOptions &options_) {
+	fileName = fileName_;
+	options = options_;
+	file = new TFile(fileName.c_str(), "recreate");
+	if (file->IsZombie()) throw std::runtime_error("Error: create shared table " + fileName + " failed.");
+	writer = ResultWriter::Create(backend, options);
+	columnCount = 0;
+	stride = 0;
+	rows = 0;
+}
+
+
+SharedResultTable::~SharedResultTable() {
+}
+
+
+unsigned int SharedResultTable::AddConfig(const std::string &name) {
+	std::lock_guard<std::mutex> lock(mutex);
+	names.push_back(name);
+	pending.emplace_back();
+	return (unsigned int)(names.size() - 1);
+}
+
+
+void SharedResultTable::Open(const std::vector<ResultColumn> &columns, size_t stride_) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (columnCount) {
+		if (columns.size() != columnCount) {
+			throw std::runtime_error("Error: columns of the configurations in the shared table are different.");
+		}
+		return;
+	}
+	writer->Open(file, fileName, columns, stride_);
+	columnCount = columns.size();
+	stride = stride_;
+}
+
+
+// the rows of a configuration are kept until there are clusterRows of them,
+// which are one cluster, so a reader of the configuration only reads its
+// clusters
+void SharedResultTable::Append(unsigned int config, const void *data, size_t count) {
+	if (!count) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	const char *bytes = static_cast<const char*>(data);
+	std::vector<char> &buffer = pending[config];
+	if (buffer.empty() && count >= options.clusterRows) {
+		Write(config, bytes, count);
+		writer->EndCluster();
+		return;
+	}
+	buffer.insert(buffer.end(), bytes, bytes + count * stride);
+	if (buffer.size() >= options.clusterRows * stride) {
+		Write(config, buffer.data(), buffer.size() / stride);
+		writer->EndCluster();
+		buffer.clear();
+		buffer.shrink_to_fit();
+	}
+}
+
+
+void SharedResultTable::Write(unsigned int config, const char *data, size_t count) {
+	writer->Append(data, count);
+	clusterConfigs.push_back(config);
+	clusters.push_back(std::make_pair(rows, count));
+	rows += count;
+}
+
+
+void SharedResultTable::WriteHistograms(unsigned int config, const std::vector<TH1*> &histograms) {
+	std::lock_guard<std::mutex> lock(mutex);
+	TDirectory *directory = file->GetDirectory(names[config].c_str());
+	if (!directory) directory = file->mkdir(names[config].c_str());
+	directory->cd();
+	for (auto histogram : histograms) {
+		if (histogram) histogram->Write();
+	}
+}
+
+
+void SharedResultTable::Close() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file) return;
+	file->cd();
+	if (columnCount) {
+		// the rest of the configurations share the last clusters
+		for (size_t i = 0; i != pending.size(); ++i) {
+			if (pending[i].empty()) continue;
+			Write((unsigned int)i, pending[i].data(), pending[i].size() / stride);
+			pending[i].clear();
+		}
+		writer->Close();
+	}
+
+	// configurations
+	TTree *configTree = new TTree("configs", "configurations of the shared table");
+	UInt_t index;
+	char name[256];
+	configTree->Branch("index", &index, "index/i");
+	configTree->Branch("name", name, "name/C");
+	for (size_t i = 0; i != names.size(); ++i) {
+		index = UInt_t(i);
+		std::strncpy(name, names[i].c_str(), sizeof(name)-1);
+		name[sizeof(name)-1] = 0;
+		configTree->Fill();
+	}
+	configTree->Write();
+
+	// rows of each cluster
+	TTree *clusterTree = new TTree("clusters", "rows of the configurations");
+	UInt_t config;
+	Long64_t first, count;
+	clusterTree->Branch("config", &config, "config/i");
+	clusterTree->Branch("first", &first, "first/L");
+	clusterTree->Branch("rows", &count, "rows/L");
+	for (size_t i = 0; i != clusters.size(); ++i) {
+		config = clusterConfigs[i];
+		first = Long64_t(clusters[i].first);
+		count = Long64_t(clusters[i].second);
+		clusterTree->Fill();
+	}
+	clusterTree->Write();
+
+	file->Close();
+	delete file;
+	file = nullptr;
+}
+
+
+const ResultOptions &SharedResultTable::GetOptions() const {
+	return options;
+}
+
+
+
+//--------------------------------------------------
+//					ResultReader
+//--------------------------------------------------
+
+ResultReader::~ResultReader() {
+}
+
+
+std::vector<double> ResultReader::ReadColumn(const std::string &name) {
+	return ReadColumn(name, 0, GetEntries());
+}
+
+
+std::vector<double> ResultReader::ReadColumn(const std::string &name, const ResultConfig &config) {
+	std::vector<double> values;
+	for (const auto &cluster : config.clusters) {
+		std::vector<double> part = ReadColumn(name, cluster.first, cluster.second);
+		values.insert(values.end(), part.begin(), part.end());
+	}
+	return values;
+}
+
+
+std::unique_ptr<ResultReader> ResultReader::Open(const std::string &fileName) {
+	if (fileName.size() > 4 && fileName.substr(fileName.size()-4) == ".col") {
+		return std::make_unique<ColumnarResultReader>(fileName);
+	}
+
+	// the class of the key tells the TTree from the RNTuple
+	std::string className;
+	TFile *file = new TFile(fileName.c_str(), "read");
+	if (!file->IsZombie()) {
+		TKey *key = file->GetKey("tree");
+		if (key) className = key->GetClassName();
+	}
+	file->Close();
+	delete file;
+
+	if (className == "TTree") return std::make_unique<TTreeResultReader>(fileName);
+	if (className.find("RNTuple") != std::string::npos) {
+#ifdef SIM_RNTUPLE
+		return std::make_unique<RNTupleResultReader>(fileName);
+#else
+		throw std::runtime_error("Error: read rntuple " + fileName + " needs SIM_RNTUPLE defined.");
+#endif
+	}
+	throw std::runtime_error("Error: no result table in " + fileName + ".");
+}
+
+
+bool ResultReader::IsResultFile(const std::string &fileName) {
+	std::filesystem::path path(fileName);
+	if (path.extension() == ".col") return true;
+	if (path.extension() != ".root") return false;
+	return !std::filesystem::exists(ResultWriter::ColumnarName(fileName));
+}
+
+
+// The metadata is in the ROOT file, also for the columnar table
+std::vector<ResultConfig> ResultReader::ReadConfigs(const std::string &fileName) {
+	std::vector<ResultConfig> configs;
+	std::string rootName = fileName;
+	if (rootName.size() > 4 && rootName.substr(rootName.size()-4) == ".col") {
+		rootName = rootName.substr(0, rootName.size()-4) + ".root";
+	}
+	TFile *file = new TFile(rootName.c_str(), "read");
+	if (file->IsZombie()) {
+		delete file;
+		return configs;
+	}
+	TTree *configTree = (TTree*)file->Get("configs");
+	TTree *clusterTree = (TTree*)file->Get("clusters");
+	if (configTree && clusterTree) {
+		UInt_t index;
+		char name[256];
+		configTree->SetBranchAddress("index", &index);
+		configTree->SetBranchAddress("name", name);
+		for (Long64_t i = 0; i != configTree->GetEntries(); ++i) {
+			configTree->GetEntry(i);
+			if (index >= configs.size()) configs.resize(index+1);
+			configs[index].name = name;
+		}
+
+		UInt_t config;
+		Long64_t first, count;
+		clusterTree->SetBranchAddress("config", &config);
+		clusterTree->SetBranchAddress("first", &first);
+		clusterTree->SetBranchAddress("rows", &count);
+		for (Long64_t i = 0; i != clusterTree->GetEntries(); ++i) {
+			clusterTree->GetEntry(i);
+			if (config >= configs.size()) continue;
+			configs[config].clusters.push_back(std::make_pair(size_t(first), size_t(count)));
+			configs[config].entries += size_t(count);
+		}
+	}
+	file->Close();
+	delete file;
+	return configs;
+}
+
+
+
+//--------------------------------------------------
+//				TTreeResultReader
+//--------------------------------------------------
+
+TTreeResultReader::TTreeResultReader(const std::string &fileName) {
+	file = new TFile(fileName.c_str(), "read");
+	if (file->IsZombie()) throw std::runtime_error("Error: open file " + fileName + " failed.");
+	tree = (TTree*)file->Get("tree");
+	if (!tree) throw std::runtime_error("Error: no tree in " + fileName + ".");
+}
+
+
+TTreeResultReader::~TTreeResultReader() {
+	file->Close();
+	delete file;
+}
+
+
+size_t TTreeResultReader::GetEntries() const {
+	return size_t(tree->GetEntries());
+}
+
+
+bool TTreeResultReader::HasColumn(const std::string &name) const {
+	return tree->GetBranch(name.c_str()) != nullptr;
+}
+
+
+// read only this branch, and the count branch of the array
+std::vector<double> TTreeResultReader::ReadColumn(const std::string &name, size_t first, size_t count) {
+	TBranch *branch = tree->GetBranch(name.c_str());
+	if (!branch) throw std::runtime_error("Error: no column " + name + ".");
+	TLeaf *leaf = (TLeaf*)branch->GetListOfLeaves()->At(0);
+	TLeaf *countLeaf = leaf->GetLeafCount();
+
+	std::vector<double> values;
+	Long64_t last = std::min(Long64_t(first + count), tree->GetEntries());
+	if (Long64_t(first) < last) values.reserve(last - first);
+	for (Long64_t i = Long64_t(first); i < last; ++i) {
+		if (countLeaf) countLeaf->GetBranch()->GetEntry(i);
+		branch->GetEntry(i);
+		int len = leaf->GetLen();
+		for (int k = 0; k != len; ++k) values.push_back(leaf->GetValue(k));
+	}
+	return values;
+}
+
+
+
+//--------------------------------------------------
+//				ColumnarResultReader
+//--------------------------------------------------
+
+// read the header and scan the blocks, the values are read later
+ColumnarResultReader::ColumnarResultReader(const std::string &fileName) {
+	input.open(fileName, std::ios::binary);
+	if (!input.good()) throw std::runtime_error("Error: open columnar file " + fileName + " failed.");
+
+	char magic[8];
+	input.read(magic, 8);
+	if (!input.good() || std::memcmp(magic, ColumnarResultWriter::Magic, 8)) {
+		throw std::runtime_error("Error: " + fileName + " is not a columnar file.");
+	}
+	std::uint32_t n = 0;
+	input.read(reinterpret_cast<char*>(&n), sizeof(n));
+	for (std::uint32_t c = 0; c != n; ++c) {
+		ResultColumn column;
+		std::uint16_t len = 0;
+		std::int32_t count = -1;
+		std::uint32_t length = 1;
+		input.read(reinterpret_cast<char*>(&len), sizeof(len));
+		column.name.resize(len);
+		input.read(&column.name[0], len);
+		input.read(&column.type, 1);
+		input.read(reinterpret_cast<char*>(&count), sizeof(count));
+		input.read(reinterpret_cast<char*>(&length), sizeof(length));
+		column.offset = 0;
+		column.count = count;
+		column.length = length;
+		columns.push_back(column);
+	}
+	if (!input.good()) throw std::runtime_error("Error: read header of " + fileName + " failed.");
+
+	std::streamoff headerEnd = input.tellg();
+	input.seekg(0, std::ios::end);
+	std::streamoff fileSize = input.tellg();
+	input.seekg(headerEnd);
+
+	entries = 0;
+	std::uint64_t rows = 0;
+	while (input.read(reinterpret_cast<char*>(&rows), sizeof(rows))) {
+		Block block;
+		block.first = entries;
+		block.rows = rows;
+		for (size_t c = 0; c != columns.size(); ++c) {
+			std::uint64_t bytes = 0;
+			input.read(reinterpret_cast<char*>(&bytes), sizeof(bytes));
+			std::streamoff position = input.tellg();
+			if (!input.good() || position + std::streamoff(bytes) > fileSize) {
+				throw std::runtime_error("Error: truncated block in " + fileName + ".");
+			}
+			block.columns.push_back(std::make_pair(position, size_t(bytes)));
+			input.seekg(bytes, std::ios::cur);
+		}
+		entries += rows;
+		blocks.push_back(block);
+	}
+	input.clear();
+}
+
+
+ColumnarResultReader::~ColumnarResultReader() {
+}
+
+
+size_t ColumnarResultReader::GetEntries() const {
+	return entries;
+}
+
+
+bool ColumnarResultReader::HasColumn(const std::string &name) const {
+	for (const auto &column : columns) {
+		if (column.name == name) return true;
+	}
+	return false;
+}
+
+
+/*
+ * ReadColumn
+ *  Read only the blocks with the rows. A scalar column seeks to the first row
+ *  in the block, an array column counts the values before it by the counts.
+ */
+std::vector<double> ColumnarResultReader::ReadColumn(const std::string &name, size_t first, size_t count) {
+	size_t c = 0;
+	while (c != columns.size() && columns[c].name != name) ++c;
+	if (c == columns.size()) throw std::runtime_error("Error: no column " + name + ".");
+	const ResultColumn &column = columns[c];
+	size_t size = ResultColumn::TypeSize(column.type);
+	size_t last = std::min(first + count, entries);
+
+	std::vector<double> values;
+	std::vector<char> bytes;
+	std::vector<char> countBytes;
+	for (const auto &block : blocks) {
+		size_t begin = std::max(first, block.first);
+		size_t end = std::min(last, block.first + block.rows);
+		if (begin >= end) continue;
+
+		size_t skip = begin - block.first;
+		size_t take = end - begin;
+		if (column.count >= 0) {
+			const ResultColumn &countColumn = columns[column.count];
+			size_t countSize = ResultColumn::TypeSize(countColumn.type);
+			ReadBlock(column.count, block, countBytes);
+			size_t skipValues = 0;
+			size_t takeValues = 0;
+			for (size_t r = 0; r != end - block.first; ++r) {
+				double len = ValueAt(countBytes.data() + r * countSize, countColumn.type);
+				size_t n = len <= 0.0 ? 0 : std::min(size_t(len), column.length);
+				if (r < skip) skipValues += n;
+				else takeValues += n;
+			}
+			skip = skipValues;
+			take = takeValues;
+		}
+
+		bytes.resize(take * size);
+		input.seekg(block.columns[c].first + std::streamoff(skip * size));
+		input.read(bytes.data(), bytes.size());
+		if (!input.good()) throw std::runtime_error("Error: read column " + name + " failed.");
+		for (size_t i = 0; i != take; ++i) values.push_back(ValueAt(bytes.data() + i * size, column.type));
+	}
+	return values;
+}
+
+
+void ColumnarResultReader::ReadBlock(size_t column, const Block &block, std::vector<char> &bytes) {
+	bytes.resize(block.columns[column].second);
+	input.seekg(block.columns[column].first);
+	input.read(bytes.data(), bytes.size());
+	if (!input.good()) throw std::runtime_error("Error: read column " + columns[column].name + " failed.");
+}
+
+
+
+#ifdef SIM_RNTUPLE
+//--------------------------------------------------
+//				RNTupleResultReader
+//--------------------------------------------------
+
+struct RNTupleResultReader::Impl {
+	std::unique_ptr<ROOT::RNTupleReader> reader;
+};
+
+
+template<class T>
+static void ReadField(ROOT::RNTupleReader &reader, const std::string &name, bool array, size_t first, size_t last, std::vector<double> &values) {
+	if (!array) {
+		auto view = reader.GetView<T>(name);
+		for (size_t i = first; i < last; ++i) values.push_back(double(view(i)));
+	} else {
+		auto view = reader.GetView<std::vector<T>>(name);
+		for (size_t i = first; i < last; ++i) {
+			for (auto v : view(i)) values.push_back(double(v));
+		}
+	}
+}
+
+
+RNTupleResultReader::RNTupleResultReader(const std::string &fileName) {
+	impl = std::make_unique<Impl>();
+	impl->reader = ROOT::RNTupleReader::Open("tree", fileName);
+}
+
+
+RNTupleResultReader::~RNTupleResultReader() {
+}
+
+
+size_t RNTupleResultReader::GetEntries() const {
+	return size_t(impl->reader->GetNEntries());
+}
+
+
+bool RNTupleResultReader::HasColumn(const std::string &name) const {
+	return impl->reader->GetDescriptor().FindFieldId(name) != ROOT::kInvalidDescriptorId;
+}
+
+
+std::vector<double> RNTupleResultReader::ReadColumn(const std::string &name, size_t first, size_t count) {
+	const auto &descriptor = impl->reader->GetDescriptor();
+	auto id = descriptor.FindFieldId(name);
+	if (id == ROOT::kInvalidDescriptorId) throw std::runtime_error("Error: no column " + name + ".");
+	std::string type = descriptor.GetFieldDescriptor(id).GetTypeName();
+	bool array = type.substr(0, 12) == "std::vector<";
+	if (array) type = type.substr(12, type.size()-13);
+
+	std::vector<double> values;
+	size_t last = std::min(first + count, GetEntries());
+	auto &reader = *impl->reader;
+	if (type == "std::uint8_t") ReadField<std::uint8_t>(reader, name, array, first, last, values);
+	else if (type == "std::int8_t") ReadField<std::int8_t>(reader, name, array, first, last, values);
+	else if (type == "bool") ReadField<bool>(reader, name, array, first, last, values);
+	else if (type == "std::uint16_t") ReadField<std::uint16_t>(reader, name, array, first, last, values);
+	else if (type == "std::int16_t") ReadField<std::int16_t>(reader, name, array, first, last, values);
+	else if (type == "std::uint32_t") ReadField<std::uint32_t>(reader, name, array, first, last, values);
+	else if (type == "std::int32_t") ReadField<std::int32_t>(reader, name, array, first, last, values);
+	else if (type == "std::uint64_t") ReadField<std::uint64_t>(reader, name, array, first, last, values);
+	else if (type == "std::int64_t") ReadField<std::int64_t>(reader, name, array, first, last, values);
+	else if (type == "float") ReadField<float>(reader, name, array, first, last, values);
+	else if (type == "double") ReadField<double>(reader, name, array, first, last, values);
+	else throw std::runtime_error("Error: invalid field type " + type + " of " + name + ".");
+	return values;
+}
+#endif
@@ -0,0 +1,273 @@
+#ifndef __RESULTSTORE_H__
+#define __RESULTSTORE_H__
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <mutex>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TH1.h"
+
+
+// Output backends of the result tables
+//  The simulators and single write their rows in batches through a
+//  ResultWriter, the readers of single and tres read whole columns back. The
+//  backends are the TTree, the RNTuple (only with SIM_RNTUPLE, ROOT 6.36 or
+//  later) and a raw columnar binary file written next to the ROOT file.
+//  A sweep could write all configurations into one table through the
+//  SharedResultTable, clusterRows rows of a configuration are one cluster and
+//  the "clusters" table gives the rows of each configuration.
+
+
+// one column of the table, the value is at offset of each row
+struct ResultColumn {
+	std::string name;			// branch or field name
+	std::string leaf;			// leaf name of the TTree, the name if empty
+	char type;					// type code of the TTree leaf, s S i I l L F D O b
+	size_t offset;				// offset of the value in the row
+	int count = -1;				// index of the count column of an array, -1 for scalars
+	size_t length = 1;			// max length of the array
+
+	// size of the type in bytes
+	static size_t TypeSize(char type);
+};
+
+
+// tuning of the writers
+struct ResultOptions {
+	long long clusterBytes = 32 * 1024 * 1024;	// approximate bytes of one cluster
+	int compression = 505;						// ROOT compression settings, zstd 5
+	size_t clusterRows = 65536;					// rows of one configuration in a cluster of the shared table
+};
+
+
+// rows of one configuration in the shared table
+struct ResultConfig {
+	std::string name;
+	std::vector<std::pair<size_t, size_t>> clusters;	// first row and rows
+	size_t entries = 0;
+};
+
+
+class ResultWriter {
+public:
+	virtual ~ResultWriter();
+
+	/*
+	 * create the table
+	 *  @file: ROOT file of the simulation, the columnar backend writes next to it.
+	 *  @fileName: Path of the ROOT file.
+	 *  @columns: Columns of the table.
+	 *  @stride: Bytes of one row.
+	 */
+	virtual void Open(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns, size_t stride) = 0;
+	// append rows in one batch, rows are stride bytes apart
+	virtual void Append(const void *rows, size_t count) = 0;
+	// write the table
+	virtual void Close() = 0;
+	// end the current cluster, rows after it are in another one
+	virtual void EndCluster();
+	// the tree of the TTree backend, null for others
+	virtual TTree *GetTree();
+	/*
+	 * continue the table saved by Checkpoint in the file
+	 *  @entries: Rows of the table at the checkpoint.
+	 *  @return: False if the backend can't resume or the table doesn't match.
+	 */
+	virtual bool Resume(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns, size_t stride, size_t entries);
+	// save the rows appended so far so a later run could resume, false if the backend can't
+	virtual bool Checkpoint();
+
+	// create the writer of the backend, "ttree", "rntuple" or "columnar"
+	static std::unique_ptr<ResultWriter> Create(const std::string &backend, const ResultOptions &options = ResultOptions());
+	// the backend is known and compiled in, rntuple only with SIM_RNTUPLE
+	static bool HasBackend(const std::string &backend);
+	// path of the columnar file of the ROOT file
+	static std::string ColumnarName(const std::string &fileName);
+protected:
+	ResultWriter(const ResultOptions &options_);
+
+	ResultOptions options;
+	std::vector<ResultColumn> columns;
+	size_t stride;
+};
+
+
+class TTreeResultWriter: public ResultWriter {
+public:
+	TTreeResultWriter(const ResultOptions &options_);
+	virtual ~TTreeResultWriter();
+	virtual void Open(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns_, size_t stride_) override;
+	virtual void Append(const void *rows, size_t count) override;
+	virtual void Close() override;
+	virtual void EndCluster() override;
+	virtual TTree *GetTree() override;
+	virtual bool Resume(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns_, size_t stride_, size_t entries) override;
+	virtual bool Checkpoint() override;
+private:
+	// the branches of the columns, filled one after the other over a batch
+	void SetBranches();
+
+	TTree *tree;
+	std::vector<TBranch*> branches;
+	std::vector<char> row;		// branch addresses point into it
+	Long64_t clusterZipBytes;	// zipped bytes of the tree at the start of the cluster
+};
+
+
+// Raw columnar file
+//  Header "SIMCOLS1", columns, then one block per batch: rows and the values
+//  of each column in turn, arrays only keep the counted values. The reader
+//  only scans the block headers and reads the blocks of the rows it needs.
+class ColumnarResultWriter: public ResultWriter {
+public:
+	ColumnarResultWriter(const ResultOptions &options_);
+	virtual ~ColumnarResultWriter();
+	virtual void Open(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns_, size_t stride_) override;
+	virtual void Append(const void *rows, size_t count) override;
+	virtual void Close() override;
+
+	static constexpr char Magic[9] = "SIMCOLS1";
+private:
+	std::ofstream output;
+	std::vector<char> buffer;	// values of one column of the batch
+};
+
+
+#ifdef SIM_RNTUPLE
+class RNTupleResultWriter: public ResultWriter {
+public:
+	RNTupleResultWriter(const ResultOptions &options_);
+	virtual ~RNTupleResultWriter();
+	virtual void Open(TFile *file, const std::string &fileName, const std::vector<ResultColumn> &columns_, size_t stride_) override;
+	virtual void Append(const void *rows, size_t count) override;
+	virtual void Close() override;
+	virtual void EndCluster() override;
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+};
+#endif
+
+
+
+// Table of all configurations of a sweep
+//  The simulators of the configurations append to it from their threads.
+//  Rows have a "config" column, the histograms of each configuration are in
+//  its directory and the "configs" and "clusters" tables are the metadata.
+class SharedResultTable {
+public:
+	SharedResultTable(const std::string &fileName_, const std::string &backend, const ResultOptions &options_);
+	virtual ~SharedResultTable();
+
+	// add a configuration and return its index
+	virtual unsigned int AddConfig(const std::string &name);
+	// create the table by the first caller, the others must have the same columns
+	virtual void Open(const std::vector<ResultColumn> &columns, size_t stride_);
+	// append rows of one configuration, a cluster is cut every clusterRows rows of it
+	virtual void Append(unsigned int config, const void *rows, size_t count);
+	// write the histograms in the directory of the configuration
+	virtual void WriteHistograms(unsigned int config, const std::vector<TH1*> &histograms);
+	// write the metadata and the table, close the file
+	virtual void Close();
+	virtual const ResultOptions &GetOptions() const;
+private:
+	// write rows of one configuration and record them
+	void Write(unsigned int config, const char *data, size_t count);
+
+	std::mutex mutex;
+	std::string fileName;
+	ResultOptions options;
+	TFile *file;
+	std::unique_ptr<ResultWriter> writer;
+	size_t columnCount;
+	size_t stride;
+	size_t rows;
+	std::vector<std::string> names;
+	std::vector<std::vector<char>> pending;				// rows of each configuration not written yet
+	std::vector<unsigned int> clusterConfigs;
+	std::vector<std::pair<size_t, size_t>> clusters;
+};
+
+
+
+class ResultReader {
+public:
+	virtual ~ResultReader();
+
+	virtual size_t GetEntries() const = 0;
+	virtual bool HasColumn(const std::string &name) const = 0;
+	// read all values of the column, arrays are flattened
+	virtual std::vector<double> ReadColumn(const std::string &name);
+	// read the values of rows from first, arrays are flattened
+	virtual std::vector<double> ReadColumn(const std::string &name, size_t first, size_t count) = 0;
+	// read the rows of one configuration of a shared table
+	virtual std::vector<double> ReadColumn(const std::string &name, const ResultConfig &config);
+
+	// open the result file with the reader of its backend
+	static std::unique_ptr<ResultReader> Open(const std::string &fileName);
+	// whether the file is a result table, the ROOT file of a columnar one is not
+	static bool IsResultFile(const std::string &fileName);
+	// configurations of a shared table, empty for the table of one configuration
+	static std::vector<ResultConfig> ReadConfigs(const std::string &fileName);
+};
+
+
+class TTreeResultReader: public ResultReader {
+public:
+	TTreeResultReader(const std::string &fileName);
+	virtual ~TTreeResultReader();
+	virtual size_t GetEntries() const override;
+	virtual bool HasColumn(const std::string &name) const override;
+	virtual std::vector<double> ReadColumn(const std::string &name, size_t first, size_t count) override;
+	using ResultReader::ReadColumn;
+private:
+	TFile *file;
+	TTree *tree;
+};
+
+
+class ColumnarResultReader: public ResultReader {
+public:
+	ColumnarResultReader(const std::string &fileName);
+	virtual ~ColumnarResultReader();
+	virtual size_t GetEntries() const override;
+	virtual bool HasColumn(const std::string &name) const override;
+	virtual std::vector<double> ReadColumn(const std::string &name, size_t first, size_t count) override;
+	using ResultReader::ReadColumn;
+private:
+	// block of one batch, the position and bytes of each column in the file
+	struct Block {
+		size_t first;
+		size_t rows;
+		std::vector<std::pair<std::streamoff, size_t>> columns;
+	};
+	// read the bytes of the column in the block
+	void ReadBlock(size_t column, const Block &block, std::vector<char> &bytes);
+
+	std::ifstream input;
+	std::vector<ResultColumn> columns;
+	std::vector<Block> blocks;
+	size_t entries;
+};
+
+
+#ifdef SIM_RNTUPLE
+class RNTupleResultReader: public ResultReader {
+public:
+	RNTupleResultReader(const std::string &fileName);
+	virtual ~RNTupleResultReader();
+	virtual size_t GetEntries() const override;
+	virtual bool HasColumn(const std::string &name) const override;
+	virtual std::vector<double> ReadColumn(const std::string &name, size_t first, size_t count) override;
+	using ResultReader::ReadColumn;
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+};
+#endif
+
+#endif
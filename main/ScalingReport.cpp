@@ -0,0 +1,80 @@
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "ScalingReport.h"
+#include "../lib/json.hpp"
+
+
+//--------------------------------------------------
+//					ScalingReport
+//--------------------------------------------------
+
+ScalingReport::ScalingReport(size_t nodes_, size_t threads_) {
+	nodes.resize(nodes_ ? nodes_ : 1);
+	threads = threads_;
+}
+
+
+ScalingReport::~ScalingReport() {
+}
+
+
+void ScalingReport::Add(size_t node, unsigned long long entries, double seconds) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Node &n = nodes[node < nodes.size() ? node : 0];
+	++n.tasks;
+	n.entries += entries;
+	n.busy += seconds;
+}
+
+
+// The throughput of a node is over the wall time, so the nodes add up to the
+// total, and the busy rate is over the busy time of its threads.
+std::string ScalingReport::Summary(double wall) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::stringstream ss;
+	ss << "node  tasks     entries       busy(s)   entries/s     entries/busy-s" << std::endl;
+	ss << std::left << std::fixed << std::setprecision(1);
+	unsigned long long tasks = 0, entries = 0;
+	double busy = 0.0;
+	for (size_t i = 0; i != nodes.size(); ++i) {
+		const Node &n = nodes[i];
+		ss << std::setw(6) << i << std::setw(10) << n.tasks << std::setw(14) << n.entries;
+		ss << std::setw(10) << n.busy << std::setw(14) << (wall > 0.0 ? n.entries / wall : 0.0);
+		ss << (n.busy > 0.0 ? n.entries / n.busy : 0.0) << std::endl;
+		tasks += n.tasks;
+		entries += n.entries;
+		busy += n.busy;
+	}
+	ss << std::setw(6) << "all" << std::setw(10) << tasks << std::setw(14) << entries;
+	ss << std::setw(10) << busy << std::setw(14) << (wall > 0.0 ? entries / wall : 0.0);
+	ss << (busy > 0.0 ? entries / busy : 0.0) << std::endl;
+	ss << "threads " << threads << "  wall " << wall << " s  utilization ";
+	ss << std::setprecision(2) << (wall > 0.0 && threads ? busy / (wall * threads) : 0.0) << std::endl;
+	return ss.str();
+}
+
+
+void ScalingReport::Write(const std::string &file, double wall) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	nlohmann::json js;
+	js["Threads"] = threads;
+	js["Wall"] = wall;
+	js["Nodes"] = nlohmann::json::array();
+	for (const Node &n : nodes) {
+		js["Nodes"].push_back({
+			{"Tasks", n.tasks},
+			{"Entries", n.entries},
+			{"Busy", n.busy},
+			{"Throughput", wall > 0.0 ? n.entries / wall : 0.0}
+		});
+	}
+	std::ofstream output(file);
+	if (!output.good()) {
+		throw std::runtime_error("Error: open scaling report " + file + " failed.");
+	}
+	output << std::setw(4) << js << std::endl;
+	output.close();
+}
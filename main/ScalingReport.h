@@ -0,0 +1,36 @@
+#ifndef __SCALINGREPORT_H__
+#define __SCALINGREPORT_H__
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+
+// Throughput of a sweep on each NUMA node
+//  The tasks add the entries they ran and their time on the node of their
+//  thread, the busy time of a node is the sum over its threads. Entries over
+//  the wall time of the sweep show how the throughput scales with the nodes.
+
+class ScalingReport {
+public:
+	ScalingReport(size_t nodes_, size_t threads_);
+	virtual ~ScalingReport();
+
+	// thread safe
+	virtual void Add(size_t node, unsigned long long entries, double seconds);
+	// table of the nodes and the total, wall is the time of the sweep in s
+	virtual std::string Summary(double wall) const;
+	virtual void Write(const std::string &file, double wall) const;
+private:
+	struct Node {
+		unsigned long long tasks = 0;
+		unsigned long long entries = 0;
+		double busy = 0.0;
+	};
+
+	size_t threads;
+	mutable std::mutex mutex;
+	std::vector<Node> nodes;
+};
+
+#endif
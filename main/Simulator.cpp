@@ -3,20 +3,40 @@
 #include <iomanip>
 #include <chrono>
 #include <sys/wait.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
 
 #include "TString.h"
-#include "TGraph.h"
 #include "TLegend.h"
 #include "TH1D.h"
 #include "TROOT.h"
 
 #include "Simulator.h"
+#include "Profiler.h"
+#include "Pipeline.h"
 
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::microseconds;
 
 
+// stages of the profiler, indexes of profileStages
+enum ProfileStage {
+	ProfileRead = 0,
+	ProfileScreen,
+	ProfileFast,
+	ProfileSlow,
+	ProfileCFD,
+	ProfilePick,
+	ProfileOther
+};
+const std::vector<std::string> profileStages = {"read", "screen", "fast", "slow", "cfd", "pick", "other"};
+
+
 //--------------------------------------------------
 //			Simulator::RunFlag
 //--------------------------------------------------
@@ -59,10 +79,14 @@ Simulator::Simulator() {
 	slowPicker = nullptr;
 	fastPicker = nullptr;
 	cfdPicker = nullptr;
+	pileupPicker = nullptr;
+	hitPicker = nullptr;
+	screen = nullptr;
 	file = nullptr;
 	path = "";
 	fileName = "";
 	zeroPoint = 0;
+	profileSample = 64;
 	verbose = true;
 }
 
@@ -70,6 +94,20 @@ Simulator::~Simulator() {
 	if (file) file->Close();
 }
 
+
+void Simulator::Close() {
+	if (!file) return;
+	file->Close();
+	delete file;
+	file = nullptr;
+}
+
+// The reader is added again before the next run
+void Simulator::Release() {
+	reader.reset();
+}
+
+
 void Simulator::AddReader(std::unique_ptr<TraceReader> reader_) {
 	reader = std::move(reader_);
 	return;
@@ -109,6 +147,28 @@ void Simulator::AddCFDPicker(std::unique_ptr<Picker> picker_) {
 }
 
 
+// Add the pile-up inspector, it runs right after the fast filter
+void Simulator::AddPileupPicker(std::unique_ptr<Picker> picker_) {
+	pileupPicker = std::move(picker_);
+	return;
+}
+
+
+// Add the multi-hit picker, it finds all triggers in the fast filter and
+// the slow and cfd pickers pick each hit from the same filter outputs
+void Simulator::AddHitPicker(std::unique_ptr<MultiHitPicker> picker_) {
+	hitPicker = std::move(picker_);
+	return;
+}
+
+
+// Add the trace screen, it checks the raw trace before any filter runs
+void Simulator::AddScreen(std::unique_ptr<TraceScreen> screen_) {
+	screen = std::move(screen_);
+	return;
+}
+
+
 // Set file path
 void Simulator::SetPath(const char *p) {
 	path = TString(p);
@@ -136,36 +196,67 @@ void Simulator::SetVerbose(bool verbose_) {
 }
 
 
+// Set the sampling of the profiler
+void Simulator::SetProfileSample(unsigned int sample) {
+	profileSample = sample;
+	return;
+}
 
-//--------------------------------------------------
-//				BaseSimulator
-//--------------------------------------------------
 
-// constructor, assign null pointer
-BaseSimulator::BaseSimulator(): Simulator() {
+// Set the gate of the slow or cfd stage
+void Simulator::SetGate(RunFlag stage, const Gate &gate) {
+	if (stage == RunFlag::SlowFilter) {
+		if (gate.energy) throw std::runtime_error("Error: slow stage can't be gated by the energy.");
+		slowGate = gate;
+	} else if (stage == RunFlag::CFDFilter) {
+		cfdGate = gate;
+	} else {
+		throw std::runtime_error("Error: only slow and cfd stages can be gated.");
+	}
+	return;
 }
 
 
-// deconstructor, do nothing
-BaseSimulator::~BaseSimulator() {
+// Reading and the parts of the stages running, the picks of multi-hit
+// mode are counted once since the hits are searched on the same data.
+double Simulator::Cost(RunFlag flag, size_t samples) const {
+	double cost = double(samples);
+	if (screen) cost += double(samples);
+	bool fastRun = ((flag & RunFlag::FastFilter) != 0) || ((flag & RunFlag::CFDFilter) != 0);
+	if (fastRun && fastFilter && fastPicker) {
+		cost += fastFilter->Cost(samples) + fastPicker->Cost(samples);
+		if (pileupPicker) cost += pileupPicker->Cost(samples);
+		if (hitPicker) cost += hitPicker->Cost(samples);
+	}
+	if ((flag & RunFlag::SlowFilter) != 0 && slowFilter && slowPicker) {
+		cost += slowFilter->Cost(samples) + slowPicker->Cost(samples);
+	}
+	if ((flag & RunFlag::CFDFilter) != 0 && cfdFilter && cfdPicker) {
+		cost += cfdFilter->Cost(samples) + cfdPicker->Cost(samples);
+	}
+	return cost;
 }
 
-// run the simulation
-void BaseSimulator::Run(unsigned int times, RunFlag flag) {
-// std::cout << "run " << std::endl;
-	// check trace reader
+
+// Check the parts and gates needed by the run flag
+void Simulator::Check(RunFlag flag) const {
 	if (!reader) throw std::runtime_error("Error: trace reader not found.");
+	CheckStages(flag);
+}
+
+
+void Simulator::CheckStages(RunFlag flag) const {
 	// check slow filter
 	if ((flag & RunFlag::SlowFilter) != 0) {
 		if (!slowFilter) throw std::runtime_error("Error: slow filter not found.");
 		if (!slowPicker) throw std::runtime_error("Error: slow picker not found.");
 	}
 	// check fast filter
-	if ((flag & RunFlag::FastFilter) != 0){
+	if ((flag & RunFlag::FastFilter) != 0) {
 		if (!fastFilter) throw std::runtime_error("Error: fast filter not found.");
 		if (!fastPicker) throw std::runtime_error("Error: fast picker not found.");
 	}
-
+	// check cfd filter
 	if ((flag & RunFlag::CFDFilter) != 0) {
 		if (!fastFilter) throw std::runtime_error("Error: fast filter not found.");
 		if (!fastPicker) throw std::runtime_error("Error: fast picker not found.");
@@ -173,6 +264,62 @@ void BaseSimulator::Run(unsigned int times, RunFlag flag) {
 		if (!cfdPicker) throw std::runtime_error("Error: CFD picker not found.");
 	}
 
+	// check gates
+	bool fastRun = ((flag & RunFlag::FastFilter) != 0) || ((flag & RunFlag::CFDFilter) != 0);
+	bool slowRun = (flag & RunFlag::SlowFilter) != 0;
+	if (slowRun && slowGate.trigger && !fastRun) {
+		throw std::runtime_error("Error: slow stage gated by the trigger without fast filter.");
+	}
+	if ((slowGate.pileup || cfdGate.pileup) && (!fastRun || !pileupPicker)) {
+		throw std::runtime_error("Error: stage gated by the pile-up without fast filter or pile-up inspector.");
+	}
+	if (hitPicker && !fastRun) {
+		throw std::runtime_error("Error: multi-hit picker without fast filter.");
+	}
+	if ((flag & RunFlag::CFDFilter) != 0 && cfdGate.energy && !slowRun) {
+		throw std::runtime_error("Error: cfd stage gated by the energy without slow filter.");
+	}
+	return;
+}
+
+
+// Whether the stage with this gate should run
+//  @gate: gate of the stage
+//  @status: results of the earlier stages
+bool Simulator::Pass(const Gate &gate, const Status &status) const {
+	if (gate.trigger && !status.triggered) return false;
+	if (gate.pileup && status.pileup) return false;
+	if (gate.energy) {
+		if (!status.hasEnergy) return false;
+		if (status.energy < gate.energyMin || status.energy > gate.energyMax) return false;
+	}
+	return true;
+}
+
+
+
+//--------------------------------------------------
+//				BaseSimulator
+//--------------------------------------------------
+
+// constructor, assign null pointer
+BaseSimulator::BaseSimulator(): Simulator() {
+}
+
+
+// deconstructor, do nothing
+BaseSimulator::~BaseSimulator() {
+}
+
+// add the debug dump, it replaces the graph of each trace
+void BaseSimulator::AddDebugDump(std::unique_ptr<DebugDump> dump_) {
+	dump = std::move(dump_);
+}
+
+// run the simulation
+void BaseSimulator::Run(unsigned int times, RunFlag flag) {
+	Check(flag);
+
 	// open file
 	if (!file) {
 		if (!path.Length()) throw std::runtime_error("Error: simulation file path is empty.");
@@ -182,74 +329,73 @@ void BaseSimulator::Run(unsigned int times, RunFlag flag) {
 
 	// get period, dt
 	unsigned int dt = reader->GetPeriod();
-	// make the x positions of data
-	std::vector<double> pointX;
+	if (dump) dump->Open(file, dt);
+	// outputs of the stages for the dump, indexed by DebugDump::Stage
+	std::vector<const std::vector<double>*> outputs(DebugDump::Stages, nullptr);
 	energy.clear();
 	timestamp.clear();
 	for (unsigned int t = 0; t != times; ++t) {
 		auto &rawData = reader->Read();
 
-		// record to files
-		if (t == 0) {
-			size_t dsize = rawData.size();
-			double px = 0.0;
-			for (size_t i = 0; i != dsize; ++i) {
-				pointX.push_back(px);
-				px += dt;
-			}
-		}
-		// open file
-		file->cd();
-		// trace
-		TGraph *gTrace = new TGraph(rawData.size(), pointX.data(), rawData.data());
-		gTrace->SetLineColor(kBlack);
-		gTrace->Write(TString::Format("Trace%d", t));
-
 		// std::cout << "Simulation " << t << "  ";
 
-		if ((flag & RunFlag::SlowFilter) != 0) {
-			auto &slowData = slowFilter->Filter(rawData);
-
-			// write slow filter
-			file->cd();
-			TGraph *gSlow = new TGraph(slowData.size(), pointX.data(), slowData.data());
-			gSlow->SetLineColor(kRed);
-			gSlow->Write(TString::Format("Slow%d", t));
-
-			// calculate energy
-			energy.push_back(slowPicker->Pick(slowData));
-		}
+		Status status;
+		// any pick failed, selects the entry in the failed mode
+		bool failed = false;
+		outputs.assign(DebugDump::Stages, nullptr);
+		outputs[DebugDump::Trace] = &rawData;
 
 		if (((flag & RunFlag::FastFilter) != 0) || ((flag & RunFlag::CFDFilter) != 0)) {
 			auto &fastData = fastFilter->Filter(rawData);
-
-			// open file
-			file->cd();
-			// write fast filter
-			TGraph *gFast = new TGraph(fastData.size(), pointX.data(), fastData.data());
-			gFast->SetLineColor(kBlue);
-			gFast->Write(TString::Format("Fast%d", t));
+			outputs[DebugDump::Fast] = &fastData;
 
 			// calculate timestamp
-			timestamp.push_back(int(fastPicker->Pick(fastData)));
+			double pick = fastPicker->Pick(fastData);
+			int ts = int(pick);
+			status.triggered = fastPicker->Triggered(pick, fastData.size());
+			if (!status.triggered) failed = true;
+			timestamp.push_back(status.triggered ? ts : SkippedTime);
+
+			// pile-up inspection
+			if (pileupPicker) status.pileup = pileupPicker->Pick(fastData) > 1.0;
 		}
 
+		if ((flag & RunFlag::SlowFilter) != 0) {
+			if (Pass(slowGate, status)) {
+				auto &slowData = slowFilter->Filter(rawData);
+				outputs[DebugDump::Slow] = &slowData;
+
+				// calculate energy
+				status.energy = slowPicker->Pick(slowData);
+				status.hasEnergy = true;
+				if (status.energy <= 0.0) failed = true;
+				energy.push_back(status.energy);
+			} else {
+				energy.push_back(SkippedEnergy);
+			}
+		}
 
 		if ((flag & RunFlag::CFDFilter) != 0) {
-			auto &cfdData = cfdFilter->Filter(rawData);
-
-			// open file and store the graph
-			file->cd();
-			TGraph *gCFD = new TGraph(cfdData.size(), pointX.data(), cfdData.data());
-			gCFD->SetLineColor(kGreen);
-			gCFD->Write(TString::Format("CFD%d", t));
-
-			// calcute cfd fraction
-			cfd.push_back(cfdPicker->Pick(cfdData));
+			if (Pass(cfdGate, status)) {
+				auto &cfdData = cfdFilter->Filter(rawData);
+				outputs[DebugDump::CFD] = &cfdData;
+
+				// calcute cfd fraction
+				cfd.push_back(cfdPicker->Pick(cfdData));
+				if (cfd.back() < 0.0) failed = true;
+			} else {
+				cfd.push_back(SkippedCFD);
+			}
 		}
 
+		// the outputs are still in the buffers of the filters
+		if (dump && dump->Select(t, failed)) dump->Add(t, outputs);
 	}
 
+	if (dump) {
+		dump->Close();
+		if (verbose) std::cout << "dump   " << dump->GetDumped() << " traces" << std::endl;
+	}
 
 	return;
 }
@@ -296,215 +442,790 @@ std::vector<double> &BaseSimulator::GetCFD() {
 
 // constructor
 TTreeSimulator::TTreeSimulator() {
-	tree = nullptr;
-	energy = 0;
-	timestamp = 0;
-	cfd = 0.0;
-	cfdPoint = 0;
+	writer = nullptr;
+	backend = "ttree";
+	shared = nullptr;
+	configIndex = 0;
+	energyBins = 500;
+	energyLow = 2000.0;
+	energyHigh = 3500.0;
+	energySamples = 0;
+	ranking = nullptr;
+	checkpoint = nullptr;
+	checkpointEntries = 0;
+	workers = 0;
+	batch = 64;
 }
 
 // deconstructor
 TTreeSimulator::~TTreeSimulator() {
 }
 
+
+/*
+ * SetPipeline
+ *  Run in three stages connected by bounded ring buffers: one thread reads the
+ *  traces in batches, the workers filter and pick them with their own clones
+ *  of the filters and pickers, and the calling thread writes the results in
+ *  the entry order. The result table is the same as the serial run.
+ *
+ *  @workers_: Threads of filters and pickers, 0 to run serially.
+ *  @batch_: Traces in one batch passed between the threads.
+ */
+void TTreeSimulator::SetPipeline(size_t workers_, size_t batch_) {
+	workers = workers_;
+	batch = batch_ ? batch_ : 1;
+}
+
+
+/*
+ * SetOutput
+ *  @backend_: Backend of the result table, "ttree", "rntuple" or "columnar".
+ *  @options_: Cluster size and compression of the writer.
+ */
+void TTreeSimulator::SetOutput(const std::string &backend_, const ResultOptions &options_) {
+	backend = backend_;
+	outputOptions = options_;
+}
+
+
+/*
+ * SetSharedOutput
+ *  The rows are appended to the shared table in clusters of clusterRows rows
+ *  and the histograms are written in the directory of the name.
+ *
+ *  @table: The table of the sweep, closed by the owner after all runs.
+ *  @name: Name of this configuration.
+ */
+void TTreeSimulator::SetSharedOutput(SharedResultTable *table, const std::string &name) {
+	shared = table;
+	configIndex = shared->AddConfig(name);
+}
+
+
+/*
+ * SetEnergyHistogram
+ *  @bins: Bins of the energy histogram.
+ *  @low: Lower edge, not used for the auto range.
+ *  @high: Upper edge, not used for the auto range.
+ *  @samples: Energies of a thread fixing the auto range, 0 for the fixed range.
+ */
+void TTreeSimulator::SetEnergyHistogram(size_t bins, double low, double high, size_t samples) {
+	if (!bins) throw std::runtime_error("Error: energy histogram has no bins.");
+	if (!samples && !(high > low)) throw std::runtime_error("Error: energy histogram has invalid range.");
+	energyBins = bins;
+	energyLow = low;
+	energyHigh = high;
+	energySamples = samples;
+}
+
+
+/*
+ * SetRanking
+ *  @ranking_: Ranking of the sweep, printed by the owner after all runs.
+ *  @name: Name of this configuration in the ranking.
+ */
+void TTreeSimulator::SetRanking(ResolutionRanking *ranking_, const std::string &name) {
+	ranking = ranking_;
+	rankName = name;
+}
+
+
+/*
+ * SetCheckpoint
+ *  The run stops at every interval entries, all threads finished, and saves
+ *  the rows and histograms so far. Only the ttree backend resumes from them,
+ *  the others start again.
+ *
+ *  @checkpoint_: Journal of the sweep.
+ *  @name: Name of this configuration in the journal.
+ *  @interval: Entries between two checkpoints.
+ */
+void TTreeSimulator::SetCheckpoint(SweepCheckpoint *checkpoint_, const std::string &name, unsigned int interval) {
+	checkpoint = checkpoint_;
+	checkpointName = name;
+	checkpointEntries = interval;
+}
+
+
+void TTreeSimulator::SetFollowers(const std::vector<TTreeSimulator*> &followers_) {
+	followers = followers_;
+}
+
+
 void TTreeSimulator::Run(unsigned int entries, RunFlag flag) {
+	Check(flag);
+	if (followers.size()) {
+		RunFused(entries, flag);
+		return;
+	}
 
-	if (!reader) throw std::runtime_error("Error: Trace reader not found.");
-	// check slow filter
-	if ((flag & RunFlag::SlowFilter) != 0) {
-		if (!slowFilter) throw std::runtime_error("Error: slow filter not found.");
-		if (!slowPicker) throw std::runtime_error("Error: slow picker not found.");
+
+	// shard 0 for this thread and one for each worker
+	NewHistograms(workers + 1);
+	unsigned int first = Resume(entries, flag);
+	Open(flag);
+
+
+	auto runStart = std::chrono::steady_clock::now();
+
+	// the screen tags the entries of different size instead of throwing
+	if (screen) reader->SetStrictSize(false);
+
+	// filters and pickers of this thread, the sampled stage profiler is in it
+	Stages stages = CloneStages();
+	Counters counters;
+
+	if (verbose) {
+		if (first) std::cout << "resume from entry " << first << std::endl;
+		std::cout << "run   0%";
+		std::cout.flush();
 	}
-	// check fast filter
-	if ((flag & RunFlag::FastFilter) != 0) {
-		if (!fastFilter) throw std::runtime_error("Error: fast filter not found.");
-		if (!fastPicker) throw std::runtime_error("Error: fast picker not found.");
+	// the threads stop at each checkpoint, so the histograms have only the saved entries
+	unsigned int interval = checkpoint && checkpointEntries ? checkpointEntries : entries;
+	for (unsigned int begin = first; begin < entries;) {
+		unsigned int end = entries - begin > interval ? begin + interval : entries;
+		if (workers) {
+			RunPipeline(begin, end, entries, flag, stages, counters);
+		} else {
+			RunSerial(begin, end, entries, flag, stages, counters);
+		}
+		if (end != entries) SaveCheckpoint(end);
+		begin = end;
 	}
-	// check cfd filter
-	if ((flag & RunFlag::CFDFilter) != 0) {
-		if (!fastFilter) throw std::runtime_error("Error: fast filter not found.");
-		if (!fastPicker) throw std::runtime_error("Error: fast picker not found.");
-		if (!cfdFilter) throw std::runtime_error("Error: CFD filter not found.");
-		if (!cfdPicker) throw std::runtime_error("Error: CFD picker not found.");
+	if (verbose){
+		std::cout << "\b\b\b\b100%" << std::endl;
 	}
 
+	Finish(reader->GetPeriod());
 
-	// open file
-	if (!file) {
-		if (!path.Length()) throw std::runtime_error("Error: simulation file path is empty.");
-		if (!fileName.Length()) throw std::runtime_error("Error: simulation file name is empty.");
-		file = new TFile(path+fileName, "recreate");
-// std::cout << "open file " << path+fileName << std::endl;
+#ifdef SIM_PROFILE
+	// write the stage latency next to the output file, only the detailed profile
+	std::string profileFile = std::string((path+fileName).Data());
+	if (profileFile.size() > 5 && profileFile.substr(profileFile.size()-5) == ".root") {
+		profileFile.resize(profileFile.size()-5);
 	}
+	profileFile += ".prof.json";
+	if (profileSample) stages.profiler->Write(profileFile, std::string(fileName.Data()));
+#endif
 
-
-	if (!tree) {
-		tree = new TTree("tree", "tree of simulation energy");
-		if ((flag & RunFlag::SlowFilter) != 0) {
-			tree->Branch("e", &energy, "energy/s");
-		}
-		if ((flag & RunFlag::FastFilter) != 0) {
-			tree->Branch("lts", &timestamp, "lts/S");
-		}
-		if ((flag & RunFlag::CFDFilter) != 0) {
-			tree->Branch("cfd", &cfd, "cfd/D");
-			tree->Branch("cfdp", &cfdPoint, "cfdp/S");
+	if (verbose) {
+		auto totalTime = std::chrono::steady_clock::now() - runStart;
+		std::cout << "total  " << duration_cast<microseconds>(totalTime).count() << " us";
+		if (workers) std::cout << "  (" << workers << " workers)";
+		std::cout << std::endl;
+		if (profileSample) std::cout << stages.profiler->Summary();
+		std::cout << "skip   slow " << counters.slowSkipped << "  cfd " << counters.cfdSkipped << std::endl;
+		if (pileupPicker) std::cout << "pileup " << counters.pileup << std::endl;
+		if (screen) {
+			std::cout << "screen length " << counters.screened[0] << "  saturated " << counters.screened[1]
+				<< "  baseline " << counters.screened[2] << (screen->IsSkip() ? "  (skipped)" : "  (tagged)") << std::endl;
 		}
 	}
 
-
-	TH1D *hEnergy = nullptr;
-	TH1D *hTime = nullptr;
-	TH1D *hCFD = nullptr;
-	TH1D *hCFDP = nullptr;
+	return;
+}
 
 
-	auto start = std::chrono::high_resolution_clock::now();
-	auto stop = start;
-	auto readTime = duration_cast<microseconds>(stop - start);
-	auto slowFilterTime = duration_cast<microseconds>(stop - start);
-	auto fastFilterTime = duration_cast<microseconds>(stop - start);
-	auto cfdFilterTime = duration_cast<microseconds>(stop -start);
-	auto pickerTime = duration_cast<microseconds>(stop -start);
-	auto otherTime = duration_cast<microseconds>(stop - start);
+/*
+ * RunFused
+ *  Each trace is read once and goes through this and the followers one after
+ *  another. Their stages share one memo, so the filter outputs of the same
+ *  signature are computed once for the trace, e.g. the fast filter of all of
+ *  them, the cfd from the same fast filter output and the xia slow filters of
+ *  the same windows from the same running sums. The followers use the
+ *  reader of this one, and all of them start from the first entry.
+ */
+void TTreeSimulator::RunFused(unsigned int entries, RunFlag flag) {
+	std::vector<TTreeSimulator*> members{this};
+	members.insert(members.end(), followers.begin(), followers.end());
+	auto memo = std::make_shared<FilterMemo>();
+	std::vector<Stages> stages;
+	std::vector<Counters> counters(members.size());
+	for (auto member : members) {
+		member->CheckStages(flag);
+		member->NewHistograms(1);
+		member->Open(flag);
+		if (member->screen) reader->SetStrictSize(false);
+		stages.push_back(member->CloneStages(memo));
+	}
 
-	unsigned int entries100 = entries / 100 + 1;
+	auto runStart = std::chrono::steady_clock::now();
 	if (verbose) {
 		std::cout << "run   0%";
 		std::cout.flush();
 	}
+	TraceResult r = TraceResult();
 	for (unsigned int t = 0; t != entries; ++t) {
+		const std::vector<double> &rawData = reader->Read();
+		size_t rawSize = reader->GetRawSize();
+		memo->Next();
+		for (size_t i = 0; i != members.size(); ++i) {
+			PROFILE_BEGIN(*stages[i].profiler, t);
+			members[i]->Process(stages[i], rawData, rawSize, flag, r);
+			members[i]->FillHistograms(stages[i], r);
+			members[i]->Record(r, counters[i]);
+			PROFILE_END(*stages[i].profiler);
+		}
+		PrintProgress(t, entries);
+	}
+	if (verbose){
+		std::cout << "\b\b\b\b100%" << std::endl;
+	}
 
-		stop = std::chrono::high_resolution_clock::now();
-		start = stop;
-		otherTime += duration_cast<microseconds>(stop - start);
+	for (auto member : members) member->Finish(reader->GetPeriod());
 
-		// read raw data
-		const std::vector<double> &rawData = reader->Read();
+	if (verbose) {
+		auto totalTime = std::chrono::steady_clock::now() - runStart;
+		std::cout << "total  " << duration_cast<microseconds>(totalTime).count() << " us  ("
+			<< members.size() << " configurations, " << memo->Nodes() << " filters, "
+			<< memo->Hits() << " outputs shared)" << std::endl;
+	}
+	return;
+}
+
+
+// the tree of the writer is deleted with the file
+void TTreeSimulator::Close() {
+	writer.reset();
+	Simulator::Close();
+}
+
+
+// The histograms are created again by the next run
+void TTreeSimulator::Release() {
+	Simulator::Release();
+	followers.clear();
+	for (auto h : {&hEnergy, &hTime, &hCFD, &hCFDP, &hCFDTime}) h->reset();
+	std::vector<TraceResult>().swap(rows);
+}
 
-		stop = std::chrono::high_resolution_clock::now();
-		readTime += duration_cast<microseconds>(stop - start);
-		start = stop;
 
-		// slow filter
+TTree *TTreeSimulator::Tree() {
+	return writer ? writer->GetTree() : nullptr;
+}
+
+
+// Columns of the result table, the same branches as the tree of older runs
+std::vector<ResultColumn> TTreeSimulator::Columns(RunFlag flag) const {
+	std::vector<ResultColumn> columns;
+	if ((flag & RunFlag::SlowFilter) != 0) {
+		columns.push_back({"e", "energy", 's', offsetof(TraceResult, energy)});
+	}
+	if ((flag & RunFlag::FastFilter) != 0) {
+		columns.push_back({"lts", "", 'S', offsetof(TraceResult, timestamp)});
+	}
+	if ((flag & RunFlag::CFDFilter) != 0) {
+		columns.push_back({"cfd", "", 'D', offsetof(TraceResult, cfd)});
+		columns.push_back({"cfdp", "", 'S', offsetof(TraceResult, cfdPoint)});
+	}
+	if (pileupPicker && (flag & (RunFlag::FastFilter | RunFlag::CFDFilter)) != 0) {
+		columns.push_back({"pileup", "", 'O', offsetof(TraceResult, pileup)});
+	}
+	if (screen) {
+		columns.push_back({"quality", "", 'b', offsetof(TraceResult, quality)});
+	}
+	if (shared) {
+		columns.push_back({"config", "", 'i', offsetof(TraceResult, config)});
+	}
+	if (hitPicker) {
+		int count = int(columns.size());
+		columns.push_back({"hit", "", 's', offsetof(TraceResult, hits)});
+		columns.push_back({"hitlts", "", 'S', offsetof(TraceResult, hitTime), count, MaxHits});
 		if ((flag & RunFlag::SlowFilter) != 0) {
+			columns.push_back({"hite", "", 's', offsetof(TraceResult, hitEnergy), count, MaxHits});
+		}
+		if ((flag & RunFlag::CFDFilter) != 0) {
+			columns.push_back({"hitcfd", "", 'D', offsetof(TraceResult, hitCFD), count, MaxHits});
+			columns.push_back({"hitcfdp", "", 'S', offsetof(TraceResult, hitCFDPoint), count, MaxHits});
+		}
+	}
+	return columns;
+}
 
-			auto &slowData = slowFilter->Filter(rawData);
+
+// Clone the filters and pickers for one thread, they keep buffers inside,
+// the cfd filter takes the fast filter output if it has the same parameters
+TTreeSimulator::Stages TTreeSimulator::CloneStages(std::shared_ptr<FilterMemo> memo) const {
+	Stages stages;
+	stages.memo = memo ? memo : std::make_shared<FilterMemo>();
+	if (slowFilter) stages.slowNode = stages.memo->Add(*slowFilter);
+	if (fastFilter) stages.fastNode = stages.memo->Add(*fastFilter);
+	if (cfdFilter) stages.cfdNode = stages.memo->Add(*cfdFilter);
+	if (slowPicker) stages.slowPicker = slowPicker->Clone();
+	if (fastPicker) stages.fastPicker = fastPicker->Clone();
+	if (cfdPicker) stages.cfdPicker = cfdPicker->Clone();
+	if (pileupPicker) stages.pileupPicker = pileupPicker->Clone();
+	if (hitPicker) {
+		stages.hitPicker.reset(static_cast<MultiHitPicker*>(hitPicker->Clone().release()));
+	}
+	if (screen) stages.screen = screen->Clone();
+	stages.profiler = std::make_unique<Profiler>(profileStages, profileSample);
+	return stages;
+}
 
 
-			stop = std::chrono::high_resolution_clock::now();
-			slowFilterTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+/*
+ * Process
+ *  Run one trace through the screen, fast, slow and cfd stages and the
+ *  multi-hit picks. It only touches the stages and the result, so the
+ *  workers run it at the same time with their own stages.
+ *
+ *  @stages: Filters and pickers of this thread.
+ *  @rawData: The raw trace.
+ *  @rawSize: Points of the entry before the reader fit it to the trace size.
+ *  @flag: Stages to run.
+ *  @r: Result of the trace.
+ */
+void TTreeSimulator::Process(Stages &stages, const std::vector<double> &rawData, size_t rawSize, RunFlag flag, TraceResult &r) const {
+	r.fastRan = false;
+	r.slowRan = false;
+	r.cfdRan = false;
+	r.slowSkipped = false;
+	r.cfdSkipped = false;
+	r.pileup = false;
+	r.hits = 0;
+	r.quality = TraceScreen::Good;
+
+	// screen the trace before any filter
+	if (stages.screen) {
+		r.quality = UChar_t(stages.screen->Check(rawData, rawSize));
+		PROFILE_MARK(*stages.profiler, ProfileScreen);
+		if (r.quality != TraceScreen::Good && stages.screen->IsSkip()) {
+			// skip all stages
+			r.timestamp = SkippedTime;
+			r.energy = SkippedEnergy;
+			r.cfd = SkippedCFD;
+			r.cfdPoint = SkippedCFDPoint;
+			return;
+		}
+	}
 
+	// results used by the gates
+	Status status;
+	// filter outputs shared by the hits
+	const std::vector<double> *slowOutput = nullptr;
+	const std::vector<double> *cfdOutput = nullptr;
 
-			double e = slowPicker->Pick(slowData);
-			energy = UShort_t(e);
-// std::cout << "energy  " << energy << std::endl;
 
-			stop = std::chrono::high_resolution_clock::now();
-			pickerTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+	// fast filter, runs first since the gates of other stages need the trigger
+	if (((flag & RunFlag::FastFilter) != 0) || (flag & RunFlag::CFDFilter) != 0) {
+		auto &fastData = stages.memo->Get(stages.fastNode, rawData);
 
+		PROFILE_MARK(*stages.profiler, ProfileFast);
 
-			if (!hEnergy) hEnergy = new TH1D("he", "energy spectrum", 500, 2000, 3500);
-			hEnergy->Fill(e);
 
-			stop = std::chrono::high_resolution_clock::now();
-			otherTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+		double pick = stages.fastPicker->Pick(fastData);
+		int ts = int(pick);
+		status.triggered = stages.fastPicker->Triggered(pick, fastData.size());
+		// no trigger gates the later stages, and has no time
+		r.timestamp = status.triggered ? Short_t(ts-zeroPoint) : SkippedTime;
+		r.fastRan = true;
 
+		// pile-up inspection on the same fast filter output
+		if (stages.pileupPicker) {
+			status.pileup = stages.pileupPicker->Pick(fastData) > 1.0;
+			r.pileup = status.pileup;
 		}
 
+		// all hits
+		if (stages.hitPicker) stages.hitPicker->Pick(fastData);
 
-		if (((flag & RunFlag::FastFilter) != 0) || (flag & RunFlag::CFDFilter) != 0) {
-			auto &fastData = fastFilter->Filter(rawData);
+		PROFILE_MARK(*stages.profiler, ProfilePick);
+	}
+
+
+	// slow filter
+	if ((flag & RunFlag::SlowFilter) != 0) {
+		if (Pass(slowGate, status)) {
+
+			auto &slowData = stages.memo->Get(stages.slowNode, rawData);
 
-			stop = std::chrono::high_resolution_clock::now();
-			fastFilterTime += duration_cast<microseconds>(stop - start);
-			start = stop;
 
+			PROFILE_MARK(*stages.profiler, ProfileSlow);
 
-			int ts = fastPicker->Pick(fastData);
-// if (t<10) std::cout << "==========ts: " << ts  << std::endl;
-			timestamp = Short_t(ts-zeroPoint);
 
-			stop = std::chrono::high_resolution_clock::now();
-			pickerTime += duration_cast<microseconds>(stop -start);
-			start = stop;
+			slowOutput = &slowData;
+			double e = stages.slowPicker->Pick(slowData);
+			status.energy = e;
+			status.hasEnergy = true;
+			r.e = e;
+			r.energy = UShort_t(e);
+			r.slowRan = true;
 
-			if (!hTime) hTime = new TH1D("ht", "local time distribution", 200, -100, 100);
-			hTime->Fill(timestamp);
+			PROFILE_MARK(*stages.profiler, ProfilePick);
 
-			stop = std::chrono::high_resolution_clock::now();
-			otherTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+		} else {
+			r.energy = SkippedEnergy;
+			r.slowSkipped = true;
 		}
+	}
 
 
-		if ((flag & RunFlag::CFDFilter) != 0) {
-			auto &cfdData = cfdFilter->Filter(rawData);
+	if ((flag & RunFlag::CFDFilter) != 0) {
+		if (Pass(cfdGate, status)) {
+			auto &cfdData = stages.memo->Get(stages.cfdNode, rawData);
 
-			stop = std::chrono::high_resolution_clock::now();
-			cfdFilterTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+			PROFILE_MARK(*stages.profiler, ProfileCFD);
 
 			// calcute cfd fraction
-			cfd = cfdPicker->Pick(cfdData);
-			cfdPoint = int(cfd) - zeroPoint;
-			cfd -= int(cfd);
-// std::cout << "cfd  " << cfd << "  " << cfdPoint << std::endl;
+			cfdOutput = &cfdData;
+			double c = stages.cfdPicker->Pick(cfdData);
+			r.cfdPoint = int(c) - zeroPoint;
+			r.cfd = c - int(c);
+			r.cfdRan = true;
+
+			PROFILE_MARK(*stages.profiler, ProfilePick);
+
+		} else {
+			r.cfd = SkippedCFD;
+			r.cfdPoint = SkippedCFDPoint;
+			r.cfdSkipped = true;
+		}
+	}
+
+
+	// pick every hit from the filter outputs above, each one in its window up
+	// to the next trigger, the shift-based pickers shift from the first hit
+	if (stages.hitPicker && stages.hitPicker->GetHits().size()) {
+		const std::vector<size_t> &hitPoints = stages.hitPicker->GetHits();
+		r.hits = UShort_t(hitPoints.size());
+		for (size_t h = 0; h != hitPoints.size(); ++h) {
+			long long shift = (long long)hitPoints[h] - (long long)hitPoints[0];
+			// the window of the hit ends at the next one
+			size_t begin = hitPoints[h];
+			size_t end = h + 1 != hitPoints.size() ? hitPoints[h+1] : rawData.size();
+			r.hitTime[h] = Short_t((long long)hitPoints[h] - zeroPoint);
+			if (slowOutput) {
+				double e = stages.slowPicker->PickHit(*slowOutput, shift, begin, end);
+				r.hitEnergy[h] = e < 0.0 ? SkippedEnergy : UShort_t(e);
+			} else {
+				r.hitEnergy[h] = SkippedEnergy;
+			}
+			if (cfdOutput) {
+				double c = stages.cfdPicker->PickHit(*cfdOutput, shift, begin, end);
+				r.hitCFDPoint[h] = int(c) - zeroPoint;
+				r.hitCFD[h] = c - int(c);
+			} else {
+				r.hitCFD[h] = SkippedCFD;
+				r.hitCFDPoint[h] = SkippedCFDPoint;
+			}
+		}
+
+		PROFILE_MARK(*stages.profiler, ProfilePick);
+	}
+
+	return;
+}
+
 
-			stop = std::chrono::high_resolution_clock::now();
-			pickerTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+// Fill the histograms without lock, each thread fills its own shard
+void TTreeSimulator::FillHistograms(const Stages &stages, const TraceResult &r) const {
+	if (r.fastRan && r.timestamp != SkippedTime) hTime->Fill(stages.shard, r.timestamp);
+	if (r.slowRan) hEnergy->Fill(stages.shard, r.e);
+	if (r.cfdRan) {
+		hCFD->Fill(stages.shard, r.cfd);
+		hCFDP->Fill(stages.shard, r.cfdPoint);
+		hCFDTime->Fill(stages.shard, r.cfdPoint + r.cfd);
+	}
+	return;
+}
+
+
+// Record one result in the table, only in the calling thread
+void TTreeSimulator::Record(const TraceResult &r, Counters &counters) {
+	rows.push_back(r);
+	rows.back().config = configIndex;
 
+	if (r.slowSkipped) ++counters.slowSkipped;
+	if (r.cfdSkipped) ++counters.cfdSkipped;
+	if (r.pileup) ++counters.pileup;
+	for (size_t i = 0; i != TraceScreen::Reasons; ++i) {
+		if (r.quality & (1u << i)) ++counters.screened[i];
+	}
 
-			if (!hCFD) hCFD = new TH1D("hcfd", "cfd distribution", 1000, 0, 1);
-			hCFD->Fill(cfd);
+	if (rows.size() >= (shared ? shared->GetOptions().clusterRows : batch)) Flush();
+	return;
+}
 
-			if (!hCFDP) hCFDP = new TH1D("hcfdp", "cfd point distribution", 200, -100, 100);
-			hCFDP->Fill(cfdPoint);
 
-			stop = std::chrono::high_resolution_clock::now();
-			otherTime += duration_cast<microseconds>(stop - start);
-			start = stop;
+// the writer appends the whole batch at once
+void TTreeSimulator::Flush() {
+	if (rows.empty()) return;
+	if (shared) {
+		shared->Append(configIndex, rows.data(), rows.size());
+	} else {
+		writer->Append(rows.data(), rows.size());
+	}
+	rows.clear();
+	return;
+}
+
+
+void TTreeSimulator::NewHistograms(size_t shards) {
+	hTime = std::make_unique<ShardedHistogram>("ht", "local time distribution", 200, -100.0, 100.0, shards);
+	if (energySamples) {
+		hEnergy = std::make_unique<ShardedHistogram>("he", "energy spectrum", energyBins, energySamples, shards);
+	} else {
+		hEnergy = std::make_unique<ShardedHistogram>("he", "energy spectrum", energyBins, energyLow, energyHigh, shards);
+	}
+	hCFD = std::make_unique<ShardedHistogram>("hcfd", "cfd distribution", 1000, 0.0, 1.0, shards);
+	hCFDP = std::make_unique<ShardedHistogram>("hcfdp", "cfd point distribution", 200, -100.0, 100.0, shards);
+	hCFDTime = std::make_unique<ShardedHistogram>("hcfdt", "cfd time distribution", 4000, -100.0, 100.0, shards);
+	return;
+}
+
+
+// the file and the writer are already there if the run resumed
+void TTreeSimulator::Open(RunFlag flag) {
+	if (shared) {
+		shared->Open(Columns(flag), sizeof(TraceResult));
+	} else {
+		// open file
+		if (!file) {
+			if (!path.Length()) throw std::runtime_error("Error: simulation file path is empty.");
+			if (!fileName.Length()) throw std::runtime_error("Error: simulation file name is empty.");
+			file = new TFile(path+fileName, "recreate");
 		}
 
+		if (!writer) {
+			writer = ResultWriter::Create(backend, outputOptions);
+			writer->Open(file, std::string((path+fileName).Data()), Columns(flag), sizeof(TraceResult));
+		}
+	}
+	rows.clear();
+	rows.reserve(shared ? shared->GetOptions().clusterRows : batch);
+	return;
+}
+
+
+void TTreeSimulator::Finish(double period) {
+	Flush();
+	WriteHistograms();
+	if (!shared) writer->Close();
+	// estimate from the merged histograms, no need to read the table again
+	if (ranking) ranking->Add(rankName, *hEnergy, *hCFDTime, period);
+	return;
+}
+
 
-		tree->Fill();
-		if (verbose && (t % entries100 == 0)) {
-			std::cout << "\b\b\b\b" << std::setw(3) << t/entries100 << "%";
-			std::cout.flush();
+/*
+ * Resume
+ *  The file is opened for update and the table continues from the entries of
+ *  the journal, if the backend could resume and the saved table has them.
+ *  Otherwise the file is recreated by the run.
+ */
+unsigned int TTreeSimulator::Resume(unsigned int entries, RunFlag flag) {
+	if (!checkpoint || shared) return 0;
+	unsigned long long saved = checkpoint->GetProgress(checkpointName);
+	if (!saved || saved >= entries) return 0;
+
+	file = new TFile(path+fileName, "update");
+	writer = ResultWriter::Create(backend, outputOptions);
+	if (file->IsZombie() || !writer->Resume(file, std::string((path+fileName).Data()), Columns(flag), sizeof(TraceResult), saved)) {
+		writer.reset();
+		Simulator::Close();
+		return 0;
+	}
+	for (auto h : {hEnergy.get(), hTime.get(), hCFD.get(), hCFDP.get(), hCFDTime.get()}) {
+		TH1 *histogram = (TH1*)file->Get(h->GetName().c_str());
+		if (histogram) h->Restore(*histogram);
+	}
+	reader->Seek(saved);
+	return (unsigned int)saved;
+}
+
+
+// The histograms are written before the tree, the auto save of the tree saves
+// the keys of the file, then the journal points to them.
+void TTreeSimulator::SaveCheckpoint(unsigned int done) {
+	if (!checkpoint || shared) return;
+	Flush();
+	WriteHistograms();
+	if (!writer->Checkpoint()) return;
+	checkpoint->SetProgress(checkpointName, done);
+}
+
+
+// The TH1D are only created here and detached from any file, the ones of the
+// shared table are written by the table since the other threads write in it.
+void TTreeSimulator::WriteHistograms() {
+	std::vector<TH1*> histograms;
+	for (auto h : {hEnergy.get(), hTime.get(), hCFD.get(), hCFDP.get(), hCFDTime.get()}) {
+		h->Merge();
+		if (h->GetEntries()) histograms.push_back(h->ToTH1D());
+	}
+	if (shared) {
+		shared->WriteHistograms(configIndex, histograms);
+	} else {
+		// replace the ones of the last checkpoint
+		file->cd();
+		for (auto h : histograms) h->Write("", TObject::kOverwrite);
+	}
+	for (auto h : histograms) delete h;
+	return;
+}
+
+
+void TTreeSimulator::RunSerial(unsigned int begin, unsigned int end, unsigned int entries, RunFlag flag, Stages &stages, Counters &counters) {
+	TraceResult r = TraceResult();
+	for (unsigned int t = begin; t != end; ++t) {
+
+		PROFILE_BEGIN(*stages.profiler, t);
+
+		// read raw data
+		const std::vector<double> &rawData = reader->Read();
+		stages.memo->Next();
+
+		PROFILE_MARK(*stages.profiler, ProfileRead);
+
+		Process(stages, rawData, reader->GetRawSize(), flag, r);
+		FillHistograms(stages, r);
+		Record(r, counters);
+
+		PROFILE_MARK(*stages.profiler, ProfileOther);
+		PROFILE_END(*stages.profiler);
+
+		PrintProgress(t, entries);
+	}
+	return;
+}
+
+
+/*
+ * RunPipeline
+ *  The reader thread fills free batches, the workers process them and the
+ *  calling thread records them in the order of the batch index, then puts
+ *  them back to the free queue. The fixed number of batches bounds the memory
+ *  and blocks the reader when the writer falls behind. Any exception aborts
+ *  all threads and is thrown again here.
+ */
+void TTreeSimulator::RunPipeline(unsigned int begin, unsigned int end, unsigned int entries, RunFlag flag, Stages &stages, Counters &counters) {
+	size_t totalBatches = (size_t(end - begin) + batch - 1) / batch;
+	// two batches for each thread so none of them waits for the others
+	size_t poolSize = 2 * (workers + 2);
+	std::vector<TraceBatch> batches(poolSize);
+	RingBuffer<TraceBatch*> freeQueue(poolSize);
+	RingBuffer<TraceBatch*> readQueue(poolSize + workers);
+	RingBuffer<TraceBatch*> doneQueue(poolSize);
+	for (auto &b : batches) {
+		b.traces.resize(batch);
+		b.rawSizes.resize(batch);
+		b.results.resize(batch);
+		freeQueue.TryPush(&b);
+	}
+
+	std::atomic<bool> abort(false);
+	std::exception_ptr error = nullptr;
+	std::mutex errorMutex;
+	auto fail = [&]() {
+		std::lock_guard<std::mutex> lock(errorMutex);
+		if (!error) error = std::current_exception();
+		abort.store(true);
+		// the stages sleeping on the queues check the abort
+		freeQueue.Wake();
+		readQueue.Wake();
+		doneQueue.Wake();
+	};
+
+
+	// reader
+	std::thread readThread([&]() {
+		try {
+			unsigned int t = begin;
+			for (size_t index = 0; index != totalBatches; ++index) {
+				TraceBatch *b = nullptr;
+				if (!freeQueue.Pop(b, abort)) return;
+				b->index = index;
+				b->count = std::min(batch, size_t(end - t));
+				for (size_t i = 0; i != b->count; ++i, ++t) {
+					// copy into the buffer of the batch, it keeps its capacity
+					b->traces[i] = reader->Read();
+					b->rawSizes[i] = reader->GetRawSize();
+				}
+				if (!readQueue.Push(b, abort)) return;
+			}
+			// a null batch stops one worker
+			for (size_t w = 0; w != workers; ++w) {
+				if (!readQueue.Push(nullptr, abort)) return;
+			}
+		} catch (...) {
+			fail();
 		}
+	});
 
 
+	// workers
+	std::vector<Stages> workerStages;
+	for (size_t w = 0; w != workers; ++w) {
+		workerStages.push_back(CloneStages());
+		workerStages.back().shard = w + 1;
 	}
-	if (verbose){
-		std::cout << "\b\b\b\b100%" << std::endl;
+	std::vector<std::thread> workThreads;
+	for (size_t w = 0; w != workers; ++w) {
+		workThreads.emplace_back([&, w]() {
+			try {
+				Stages &s = workerStages[w];
+				TraceBatch *b = nullptr;
+				while (readQueue.Pop(b, abort) && b) {
+					for (size_t i = 0; i != b->count; ++i) {
+						PROFILE_BEGIN(*s.profiler, begin + b->index * batch + i);
+						s.memo->Next();
+						Process(s, b->traces[i], b->rawSizes[i], flag, b->results[i]);
+						FillHistograms(s, b->results[i]);
+						PROFILE_END(*s.profiler);
+					}
+					if (!doneQueue.Push(b, abort)) return;
+				}
+				// the shards are merged with atomic adds, no lock between the workers
+				for (auto h : {hEnergy.get(), hTime.get(), hCFD.get(), hCFDP.get(), hCFDTime.get()}) h->MergeShard(s.shard);
+			} catch (...) {
+				fail();
+			}
+		});
 	}
 
-	file->cd();
-	if (hEnergy) hEnergy->Write();
-	if (hTime) hTime->Write();
-	if (hCFD) hCFD->Write();
-	if (hCFDP) hCFDP->Write();
-	tree->Write();
 
-	if (verbose) {
-		auto totalTime = readTime + slowFilterTime + fastFilterTime + cfdFilterTime + pickerTime + otherTime;
-		std::cout << "total  " << duration_cast<microseconds>(totalTime).count() << " us" << std::endl;
-		std::cout << "read   " << duration_cast<microseconds>(readTime).count() << " us" << std::endl;
-		std::cout << "slow   " << duration_cast<microseconds>(slowFilterTime).count() << " us" << std::endl;
-		std::cout << "fast   " << duration_cast<microseconds>(fastFilterTime).count() << " us" << std::endl;
-		std::cout << "cfd    " << duration_cast<microseconds>(cfdFilterTime).count() << " us" << std::endl;
-		std::cout << "pick   " << duration_cast<microseconds>(pickerTime).count() << " us" << std::endl;
-		std::cout << "other  " << duration_cast<microseconds>(otherTime).count() << " us" << std::endl;
+	// writer, in this thread since it owns the file and the result table
+	try {
+		std::map<size_t, TraceBatch*> pending;
+		size_t next = 0;
+		unsigned int t = begin;
+		while (next != totalBatches) {
+			TraceBatch *b = nullptr;
+			if (!doneQueue.Pop(b, abort)) break;
+			pending[b->index] = b;
+			// record the batches in order
+			for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+				TraceBatch *ready = it->second;
+				for (size_t i = 0; i != ready->count; ++i, ++t) {
+					Record(ready->results[i], counters);
+					PrintProgress(t, entries);
+				}
+				pending.erase(it);
+				++next;
+				freeQueue.Push(ready, abort);
+			}
+		}
+	} catch (...) {
+		fail();
 	}
 
+
+	readThread.join();
+	for (auto &thread : workThreads) thread.join();
+	if (error) std::rethrow_exception(error);
+
+	for (auto &s : workerStages) stages.profiler->Merge(*s.profiler);
 	return;
 }
 
 
-TTree *TTreeSimulator::Tree() {
-	return tree;
+void TTreeSimulator::PrintProgress(unsigned int t, unsigned int entries) {
+	unsigned int entries100 = entries / 100 + 1;
+	if (verbose && (t % entries100 == 0)) {
+		std::cout << "\b\b\b\b" << std::setw(3) << t/entries100 << "%";
+		std::cout.flush();
+	}
+	return;
 }
\ No newline at end of file
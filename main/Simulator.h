@@ -10,6 +10,14 @@
 #include "TraceReader.h"
 #include "FilterAlgorithm.h"
 #include "Picker.h"
+#include "TraceScreen.h"
+#include "Profiler.h"
+#include "DebugDump.h"
+#include "ResultStore.h"
+#include "Histogram.h"
+#include "OnlineResolution.h"
+#include "Checkpoint.h"
+#include "FilterMemo.h"
 
 
 class Simulator {
@@ -23,6 +31,34 @@ public:
 		CFDFilter = 4
 	};
 
+	// Gate of a stage, the stage runs only if the earlier results pass it.
+	// Stages run in the order fast, slow, cfd, so the slow stage can only be
+	// gated by the trigger and the cfd stage by the trigger and the energy.
+	struct Gate {
+		bool trigger = false;				// require the fast trigger
+		bool pileup = false;				// require no pile-up
+		bool energy = false;				// require the energy in range
+		double energyMin = 0.0;
+		double energyMax = 0.0;
+	};
+
+	// results of the earlier stages checked by the gates
+	struct Status {
+		bool triggered = false;
+		bool pileup = false;
+		bool hasEnergy = false;
+		double energy = 0.0;
+	};
+
+	// max hits recorded in the multi-hit mode
+	static constexpr size_t MaxHits = 16;
+
+	// values written by the skipped stages
+	static constexpr UShort_t SkippedEnergy = 0;
+	static constexpr Short_t SkippedTime = -32768;
+	static constexpr Double_t SkippedCFD = 0.0;
+	static constexpr Short_t SkippedCFDPoint = 0;
+
 	// Add parts of the simulator
 	virtual void AddReader(std::unique_ptr<TraceReader> reader_);
 	virtual void AddSlowFilter(std::unique_ptr<FilterAlgorithm> filter_);
@@ -32,17 +68,36 @@ public:
 	virtual void AddSlowPicker(std::unique_ptr<Picker> picker_);
 	virtual void AddFastPicker(std::unique_ptr<Picker> picker_);
 	virtual void AddCFDPicker(std::unique_ptr<Picker> picker_);
+	virtual void AddPileupPicker(std::unique_ptr<Picker> picker_);
+	virtual void AddHitPicker(std::unique_ptr<MultiHitPicker> picker_);
+	virtual void AddScreen(std::unique_ptr<TraceScreen> screen_);
 
 	virtual void SetPath(const char *p);
 	virtual void SetFileName(const char *name_);
 	virtual void SetZeroPoint(unsigned int zero_);
 	virtual void SetVerbose(bool verbose_ = true);
+	virtual void SetGate(RunFlag stage, const Gate &gate);
+	// profile 1 in sample entries, 0 for none, the latency histograms only with SIM_PROFILE defined
+	virtual void SetProfileSample(unsigned int sample);
 
 	virtual void Run(unsigned int, RunFlag) = 0;
+	// close the output file after the run, the files are complete on disk then
+	virtual void Close();
+	// free the reader and the buffers of the run after closing, the parts stay for another run
+	virtual void Release();
+	// rough operations for each entry of samples points, by the parts and the stages of the flag
+	virtual double Cost(RunFlag flag, size_t samples) const;
 
 protected:
 	Simulator();
 
+	// check the parts and gates needed by the run flag
+	virtual void Check(RunFlag flag) const;
+	// the same without the reader, for the parts running on the traces of another simulator
+	virtual void CheckStages(RunFlag flag) const;
+	// whether the stage with this gate should run
+	virtual bool Pass(const Gate &gate, const Status &status) const;
+
 	// parts of the simulator
 	std::unique_ptr<TraceReader> reader;
 	std::unique_ptr<FilterAlgorithm> slowFilter;
@@ -51,6 +106,9 @@ protected:
 	std::unique_ptr<Picker> slowPicker;
 	std::unique_ptr<Picker> fastPicker;
 	std::unique_ptr<Picker> cfdPicker;
+	std::unique_ptr<Picker> pileupPicker;			// optional, inspects the fast filter
+	std::unique_ptr<MultiHitPicker> hitPicker;		// optional, picks all hits
+	std::unique_ptr<TraceScreen> screen;			// optional, checks traces before filters
 
 	// record file
 	TFile *file;
@@ -61,6 +119,11 @@ protected:
 	bool verbose;
 
 	unsigned int zeroPoint;
+	unsigned int profileSample;
+
+	// gates
+	Gate slowGate;
+	Gate cfdGate;
 };
 
 
@@ -78,6 +141,8 @@ public:
 public:
 	// run several times of simulation
 	virtual void Run(unsigned int times, RunFlag flag);
+	// dump the stage outputs of the sampled traces, nothing is dumped without it
+	virtual void AddDebugDump(std::unique_ptr<DebugDump> dump_);
 	// get result
 	virtual std::string Result();
 	virtual std::vector<double> &GetEnergy();
@@ -87,6 +152,7 @@ private:
 	std::vector<double> energy;
 	std::vector<int> timestamp;
 	std::vector<double> cfd;
+	std::unique_ptr<DebugDump> dump;
 };
 
 
@@ -98,12 +164,141 @@ public:
 	// run
 	virtual void Run(unsigned int entries, RunFlag flag);
 	virtual TTree* Tree();
+	// run in pipeline, reader -> workers -> writer, 0 workers to run serially
+	virtual void SetPipeline(size_t workers_, size_t batch_ = 64);
+	// output backend, "ttree", "rntuple" or "columnar"
+	virtual void SetOutput(const std::string &backend_, const ResultOptions &options_ = ResultOptions());
+	// write into the table of all configurations of the sweep instead of the own file
+	virtual void SetSharedOutput(SharedResultTable *table, const std::string &name);
+	virtual void Close() override;
+	virtual void Release() override;
+	// binning of the energy histogram, samples non-zero for the auto range by the first samples energies
+	virtual void SetEnergyHistogram(size_t bins, double low, double high, size_t samples = 0);
+	// add the resolution estimate of this configuration to the ranking of the sweep
+	virtual void SetRanking(ResolutionRanking *ranking_, const std::string &name);
+	// save the table every interval entries and resume from the last save, only in the files mode
+	virtual void SetCheckpoint(SweepCheckpoint *checkpoint_, const std::string &name, unsigned int interval);
+	// run the followers in the same pass on the traces of this reader, serially and without
+	// checkpoints, the filter outputs of the same signature are computed once for all of them,
+	// the followers are closed and released by the caller
+	virtual void SetFollowers(const std::vector<TTreeSimulator*> &followers_);
+
+protected:
+	// results of one trace, a row of the result table
+	struct TraceResult {
+		UShort_t energy;		// simulation energy
+		Short_t timestamp;		// simulation local timestamp
+		Short_t cfdPoint;		// cfd and ts offset
+		Double_t cfd;			// cfd value
+		Bool_t pileup;			// pile-up flag
+		UChar_t quality;		// reason bits of the trace screen
+		// multi-hit
+		UShort_t hits;						// hits count
+		UShort_t hitEnergy[MaxHits];		// energy of each hit
+		Short_t hitTime[MaxHits];			// local timestamp of each hit
+		Double_t hitCFD[MaxHits];			// cfd value of each hit
+		Short_t hitCFDPoint[MaxHits];		// cfd point of each hit
+		UInt_t config;						// index in the shared table
+		// stages ran, not written
+		bool fastRan;
+		bool slowRan;
+		bool cfdRan;
+		bool slowSkipped;
+		bool cfdSkipped;
+		double e;				// energy before converting
+	};
+
+	// filters and pickers used by one thread, cloned from the simulator
+	struct Stages {
+		std::shared_ptr<FilterMemo> memo;			// filter outputs of the trace, owns the filters
+		size_t slowNode = 0;
+		size_t fastNode = 0;
+		size_t cfdNode = 0;
+		std::unique_ptr<Picker> slowPicker;
+		std::unique_ptr<Picker> fastPicker;
+		std::unique_ptr<Picker> cfdPicker;
+		std::unique_ptr<Picker> pileupPicker;
+		std::unique_ptr<MultiHitPicker> hitPicker;
+		std::unique_ptr<TraceScreen> screen;
+		std::unique_ptr<Profiler> profiler;			// stage counters, latency histograms with SIM_PROFILE
+		size_t shard = 0;							// shard of the histograms
+	};
+
+	// counters of the run summary
+	struct Counters {
+		unsigned int slowSkipped = 0;
+		unsigned int cfdSkipped = 0;
+		unsigned int pileup = 0;
+		unsigned int screened[TraceScreen::Reasons] = {0, 0, 0};
+	};
+
+	// batch of traces passed between the pipeline threads, recycled
+	struct TraceBatch {
+		size_t index;							// order of the batch
+		size_t count;							// traces in the batch
+		std::vector<std::vector<double>> traces;
+		std::vector<size_t> rawSizes;
+		std::vector<TraceResult> results;
+	};
+
+	// the filters are added to the memo, a new one if null
+	virtual Stages CloneStages(std::shared_ptr<FilterMemo> memo = nullptr) const;
+	// process one trace through all stages, thread safe with its own stages, after Next of the memo
+	virtual void Process(Stages &stages, const std::vector<double> &rawData, size_t rawSize, RunFlag flag, TraceResult &r) const;
+	// columns of the result table of the run flag
+	virtual std::vector<ResultColumn> Columns(RunFlag flag) const;
+	// fill the histograms in the shard of the stages, from any thread
+	virtual void FillHistograms(const Stages &stages, const TraceResult &r) const;
+	// fill the result table in entry order
+	virtual void Record(const TraceResult &r, Counters &counters);
+	// append the buffered rows to the result table
+	virtual void Flush();
+	// create the histograms with one shard for each thread
+	virtual void NewHistograms(size_t shards);
+	// open the result table or file of the run if not resumed
+	virtual void Open(RunFlag flag);
+	// write the rest of the table and the histograms, add the estimate with the sampling period
+	virtual void Finish(double period);
+	// merge the shards and write the filled histograms
+	virtual void WriteHistograms();
+	// reopen the table and histograms of the last checkpoint, return the entries saved, 0 to start again
+	virtual unsigned int Resume(unsigned int entries, RunFlag flag);
+	// save the table and histograms of the first done entries
+	virtual void SaveCheckpoint(unsigned int done);
+	// run the entries from begin to end of all entries
+	virtual void RunSerial(unsigned int begin, unsigned int end, unsigned int entries, RunFlag flag, Stages &stages, Counters &counters);
+	virtual void RunPipeline(unsigned int begin, unsigned int end, unsigned int entries, RunFlag flag, Stages &stages, Counters &counters);
+	// run this and the followers on all entries in one pass
+	virtual void RunFused(unsigned int entries, RunFlag flag);
+	virtual void PrintProgress(unsigned int t, unsigned int entries);
+
 private:
-	TTree *tree;			// simulation tree
-	UShort_t energy;		// simulation energy
-	Short_t timestamp;		// simulation local timestamp
-	Short_t cfdPoint;		// cfd and ts offset
-	Double_t cfd;			// cfd value
+	std::unique_ptr<ResultWriter> writer;		// result table
+	std::vector<TraceResult> rows;				// rows not written
+	std::string backend;
+	ResultOptions outputOptions;
+	SharedResultTable *shared;					// not owned
+	unsigned int configIndex;
+	std::unique_ptr<ShardedHistogram> hEnergy;
+	std::unique_ptr<ShardedHistogram> hTime;
+	std::unique_ptr<ShardedHistogram> hCFD;
+	std::unique_ptr<ShardedHistogram> hCFDP;
+	std::unique_ptr<ShardedHistogram> hCFDTime;	// cfd point and fraction
+	size_t energyBins;
+	double energyLow;
+	double energyHigh;
+	size_t energySamples;				// 0 for the fixed range
+	ResolutionRanking *ranking;			// not owned
+	std::string rankName;
+	SweepCheckpoint *checkpoint;		// not owned
+	std::string checkpointName;
+	unsigned int checkpointEntries;
+
+	// pipeline
+	size_t workers;
+	size_t batch;
+
+	std::vector<TTreeSimulator*> followers;		// not owned
 };
 
 
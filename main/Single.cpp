@@ -6,6 +6,8 @@
 #include <fstream>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <cstddef>
 
 #include "TFile.h"
 #include "TTree.h"
@@ -16,12 +18,16 @@
 #include "TCut.h"
 
 #include "../lib/json.hpp"
-#include "../lib/ThreadPool.h"
+#include "../lib/WorkStealingPool.h"
+#include "ResultStore.h"
+#include "Simulator.h"
 
 int fbw = 50;					// front back width
 int sw = 200;					// same side width
 bool verbose = false;
 bool multiThread = false;
+std::string outputBackend = "ttree";
+ResultOptions outputOptions;
 
 // task status
 const int StatusError = -1;		// error while running
@@ -41,6 +47,41 @@ struct Event {
 	bool used;
 };
 
+// row of the single hit table
+struct SingleHit {
+	Long64_t ft, bt;		// timestamp, ns
+	Double_t fe, be;		// energy
+	UShort_t fs, bs;		// strip
+	Short_t flts, blts;		// simulated local timestamp, ns
+	Double_t fct, bct;		// simulated cfd time, ns
+	Short_t fcp, bcp;		// simulated cfd point, ns
+};
+
+const std::vector<ResultColumn> singleColumns = {
+	{"ft", "", 'L', offsetof(SingleHit, ft)},
+	{"fe", "", 'D', offsetof(SingleHit, fe)},
+	{"fs", "", 's', offsetof(SingleHit, fs)},
+	{"flts", "", 'S', offsetof(SingleHit, flts)},
+	{"fct", "", 'D', offsetof(SingleHit, fct)},
+	{"fcp", "", 'S', offsetof(SingleHit, fcp)},
+	{"bt", "", 'L', offsetof(SingleHit, bt)},
+	{"be", "", 'D', offsetof(SingleHit, be)},
+	{"bs", "", 's', offsetof(SingleHit, bs)},
+	{"blts", "", 'S', offsetof(SingleHit, blts)},
+	{"bct", "", 'D', offsetof(SingleHit, bct)},
+	{"bcp", "", 'S', offsetof(SingleHit, bcp)}
+};
+// rows appended in one batch
+const size_t singleBatch = 4096;
+
+// one result file, or one configuration of a shared table
+struct SingleTask {
+	std::string input;
+	std::string output;
+	std::string label;
+	ResultConfig config;		// no clusters for the whole file
+};
+
 int stripCount[2] = {16, 16};
 
 double xPeaks[32][2];
@@ -76,15 +117,29 @@ void printMap(const std::multimap<Long64_t, Event> &events) {
 	}
 }
 
-void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFile, const std::string &outputFile, int *status = nullptr) {
+void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFile, const std::string &outputFile, int *status = nullptr, ResultConfig config = ResultConfig()) {
 	if (status) {
 		statusLock.lock();
 		*status = StatusRunning;				// running
 		statusLock.unlock();
 	}
-	TFile *ipf = new TFile(inputFile.c_str(), "read");
+	// simulation results of any backend, read by columns
+	std::unique_ptr<ResultReader> reader;
+	try {
+		reader = ResultReader::Open(inputFile);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		if (status) {
+			statusLock.lock();
+			*status = StatusError;
+			statusLock.unlock();
+		}
+		return;
+	}
+	// seperated trace tree, the same entries as the simulation
+	TFile *ipf = new TFile(sepFile.c_str(), "read");
 	if (!ipf) {
-		std::cerr << "Error open file " << inputFile << std::endl;
+		std::cerr << "Error open file " << sepFile << std::endl;
 		if (status) {
 			statusLock.lock();
 			*status = StatusError;
@@ -94,8 +149,6 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 	}
 	TTree *ipt = (TTree*)ipf->Get("tree");
 
-	ipt->AddFriend("st=tree", sepFile.c_str());
-
 	// output file
 	TFile *opf = new TFile(outputFile.c_str(), "recreate");
 	if (!opf) {
@@ -115,7 +168,7 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 		for (int strip = 0; strip != stripCount[side]; ++strip) {
 			TString hName;
 			hName.Form("he%c%d", "xy"[side], strip);
-			ipt->Draw("st.energy>>"+hName+"(200, 2200, 3200)", TString::Format("st.side==%d && st.strip==%d", side, strip));
+			ipt->Draw("energy>>"+hName+"(200, 2200, 3200)", TString::Format("side==%d && strip==%d", side, strip));
 			TH1 *hesi = (TH1*)gDirectory->Get(hName);
 
 			// use TSpectru to search peaks and save in the spectrum sub directory
@@ -196,13 +249,23 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 	Double_t cfd;
 
 
-	ipt->SetBranchAddress("st.ts", &ts);
-	ipt->SetBranchAddress("st.e", &energy);
-	ipt->SetBranchAddress("st.side", &side);
-	ipt->SetBranchAddress("st.s", &strip);
-	ipt->SetBranchAddress("lts", &lts);
-	ipt->SetBranchAddress("cfd", &cfd);
-	ipt->SetBranchAddress("cfdp", &cfdp);
+	ipt->SetBranchAddress("ts", &ts);
+	ipt->SetBranchAddress("e", &energy);
+	ipt->SetBranchAddress("side", &side);
+	ipt->SetBranchAddress("s", &strip);
+
+	// columns of the simulation, zero if the stage didn't run, only the
+	// clusters of the configuration in a shared table
+	bool whole = config.clusters.empty();
+	size_t simEntries = whole ? reader->GetEntries() : config.entries;
+	auto readColumn = [&](const char *name) {
+		if (!reader->HasColumn(name)) return std::vector<double>(simEntries, 0.0);
+		return whole ? reader->ReadColumn(name) : reader->ReadColumn(name, config);
+	};
+	std::vector<double> ltsColumn = readColumn("lts");
+	std::vector<double> cfdColumn = readColumn("cfd");
+	std::vector<double> cfdpColumn = readColumn("cfdp");
+	reader.reset();
 
 	std::multimap<Long64_t, Event> frontEvents;
 	std::multimap<Long64_t, Event> backEvents;
@@ -212,13 +275,17 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 		printf("Filling map   0%%");
 		fflush(stdout);
 	}
-	Long64_t nentry = ipt->GetEntries();
+	Long64_t nentry = Long64_t(simEntries);
 	Long64_t nentry100 = nentry / 100 + 1;
 	for (Long64_t jentry = 0; jentry != nentry; ++jentry) {
 		ipt->GetEntry(jentry);
+		lts = Short_t(ltsColumn[jentry]);
+		cfd = cfdColumn[jentry];
+		cfdp = Short_t(cfdpColumn[jentry]);
 
 		Long64_t nts = ts * 10;
-		Short_t nlts = lts * 10;
+		// the skipped time stays the mark
+		Short_t nlts = lts == Simulator::SkippedTime ? lts : lts * 10;
 		Double_t ncfd = cfd * 10.0;
 		Short_t ncfdp = cfdp * 10;
 
@@ -242,28 +309,12 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 		printMap(backEvents);
 	}
 
-	opf->cd();
-	TTree *opt = new TTree("tree", "single hit tree");
-
-	Double_t fe, be;		// energy
-	UShort_t fs, bs;		// strip
-	Long64_t ft, bt;		// timestamp, ns
-	Short_t flts, blts;		// simulated local timestamp, ns
-	Double_t fct, bct;		// simulated cfd time, ns
-	Short_t fcp, bcp;		// simulated cfd point, ns
-
-	opt->Branch("ft", &ft, "ft/L");
-	opt->Branch("fe", &fe, "fe/D");
-	opt->Branch("fs", &fs, "fs/s");
-	opt->Branch("flts", &flts, "flts/S");
-	opt->Branch("fct", &fct, "fct/D");
-	opt->Branch("fcp", &fcp, "fcp/S");
-	opt->Branch("bt", &bt, "bt/L");
-	opt->Branch("be", &be, "be/D");
-	opt->Branch("bs", &bs, "bs/s");
-	opt->Branch("blts", &blts, "blts/S");
-	opt->Branch("bct", &bct, "bct/D");
-	opt->Branch("bcp", &bcp, "bcp/S");
+	// single hit table of the backend
+	std::unique_ptr<ResultWriter> writer = ResultWriter::Create(outputBackend, outputOptions);
+	writer->Open(opf, outputFile, singleColumns, sizeof(SingleHit));
+	std::vector<SingleHit> hits;
+	hits.reserve(singleBatch);
+	SingleHit hit = SingleHit();
 
 	if (verbose) {
 		printf("Filling new tree   0%%");
@@ -275,12 +326,12 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 	nentry = 0;
 	for (auto ievent = frontEvents.begin(); ievent != frontEvents.end(); ++ievent) {
 		if (ievent->second.used) continue;
-		ft = ievent->first;
-		fe = ievent->second.energy;
-		fs = ievent->second.strip;
-		flts = ievent->second.lts;
-		fct = ievent->second.cfd;
-		fcp = ievent->second.cfdp;
+		hit.ft = ievent->first;
+		hit.fe = ievent->second.energy;
+		hit.fs = ievent->second.strip;
+		hit.flts = ievent->second.lts;
+		hit.fct = ievent->second.cfd;
+		hit.fcp = ievent->second.cfdp;
 		bool frontSingle = true;
 
 		// check front single hit
@@ -299,19 +350,23 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 				backSingle = false;
 				continue;
 			}
-			bt = jevent->first;
-			be = jevent->second.energy;
-			bs = jevent->second.strip;
-			blts = jevent->second.lts;
-			bct = jevent->second.cfd;
-			bcp = jevent->second.cfdp;
+			hit.bt = jevent->first;
+			hit.be = jevent->second.energy;
+			hit.bs = jevent->second.strip;
+			hit.blts = jevent->second.lts;
+			hit.bct = jevent->second.cfd;
+			hit.bcp = jevent->second.cfdp;
 
 			if (!backHit) backSingle = true;
 			backHit = true;
 		}
 
 		if (backSingle && frontSingle) {
-			opt->Fill();
+			hits.push_back(hit);
+			if (hits.size() == singleBatch) {
+				writer->Append(hits.data(), hits.size());
+				hits.clear();
+			}
 			++nentry;
 		}
 		if (!backHit) {
@@ -336,7 +391,9 @@ void SingleFileSingleHit(const std::string &inputFile, const std::string &sepFil
 	}
 
 
-	opt->Write();
+	if (hits.size()) writer->Append(hits.data(), hits.size());
+	opf->cd();
+	writer->Close();
 	opf->Close();
 	ipf->Close();
 
@@ -380,46 +437,56 @@ int main(int argc, char **argv) {
 	sw = js["sw"];
 	verbose = js["Verbose"];
 	multiThread = js["MultiThread"];
+	if (js.contains("OutputBackend")) outputBackend = js["OutputBackend"];
+	if (js.contains("ClusterBytes")) outputOptions.clusterBytes = js["ClusterBytes"];
+	if (js.contains("Compression")) outputOptions.compression = js["Compression"];
+
+	// tasks of the result files, a shared table has one task of each configuration
+	std::vector<SingleTask> tasks;
+	for (const auto &entry : std::filesystem::directory_iterator(simPath)) {
+		if (entry.is_directory()) continue;
+		if (!ResultReader::IsResultFile(entry.path())) continue;
+		auto &path = entry.path();
+		std::string inputFileName = std::string(path);
+		std::vector<ResultConfig> configs = ResultReader::ReadConfigs(inputFileName);
+		if (configs.empty()) {
+			std::string outputFileName = singlePath + path.stem().string() + ".root";
+			tasks.push_back(SingleTask{inputFileName, outputFileName, path.filename(), ResultConfig()});
+		}
+		for (const auto &config : configs) {
+			std::string outputFileName = singlePath + config.name + ".root";
+			tasks.push_back(SingleTask{inputFileName, outputFileName, config.name, config});
+		}
+	}
 
 	if (multiThread) {
-		ThreadPool pool(js["Threads"]);
-		// count of files
-		unsigned int totalTasks = 0;
-		for (const auto &entry : std::filesystem::directory_iterator(simPath)) {
-			if (entry.is_directory()) continue;
-			++totalTasks;
-		}
+		// "none", "core" or "node"
+		std::string affinity = js.contains("Affinity") ? std::string(js["Affinity"]) : "none";
+		WorkStealingPool pool(js["Threads"], WorkStealingPool::ParseAffinity(affinity));
+		// count of tasks
+		unsigned int totalTasks = tasks.size();
 		int *taskStatus = new int[totalTasks];
 		for (size_t i = 0; i != totalTasks; ++i) {
 			taskStatus[i] = StatusInitial;
 		}
-		std::vector<std::string> fileNames;
-		size_t index = 0;
-		for (const auto &entry : std::filesystem::directory_iterator(simPath)) {
-			if (entry.is_directory()) continue;
-			auto &path = entry.path();
-			std::string inputFileName = std::string(path);
-			std::string outputFileName = singlePath + std::string(path.filename());
-			fileNames.emplace_back(path.filename());
-			pool.enqueue(SingleFileSingleHit, inputFileName, sepFileName, outputFileName, taskStatus+index);
-			++index;
+		for (size_t index = 0; index != totalTasks; ++index) {
+			const SingleTask &task = tasks[index];
+			pool.enqueue(SingleFileSingleHit, task.input, sepFileName, task.output, taskStatus+index, task.config);
 		}
 
 		unsigned int checkTasks = 0;
 		while (checkTasks < totalTasks) {
 			statusLock.lock();
-			index = 0;
 			for (size_t i = 0; i != totalTasks; ++i) {
 				if (taskStatus[i] == StatusFinished) {
 					taskStatus[i] = StatusChecked;
 					++checkTasks;
-					std::cout << "[" << checkTasks << "/" << totalTasks << "]" << "  " << fileNames[index] << "  finished." << std::endl;
+					std::cout << "[" << checkTasks << "/" << totalTasks << "]" << "  " << tasks[i].label << "  finished." << std::endl;
 				} else if (taskStatus[i] == StatusError) {
 					taskStatus[i] = StatusChecked;
 					++checkTasks;
-					std::cout << "[" << checkTasks << "/" << totalTasks << "]" << "  " << fileNames[index] << "  ERROR!!!" << std::endl;
+					std::cout << "[" << checkTasks << "/" << totalTasks << "]" << "  " << tasks[i].label << "  ERROR!!!" << std::endl;
 				}
-				++index;
 			}
 			statusLock.unlock();
 			std::this_thread::sleep_for(std::chrono::milliseconds(300));
@@ -430,16 +497,10 @@ int main(int argc, char **argv) {
 
 	} else {
 
-		for (const auto &entry : std::filesystem::directory_iterator(simPath)) {
-			if (entry.is_directory()) continue;
-			auto &path = entry.path();
-			std::string inputFileName = std::string(path);
-			std::string outputFileName = singlePath + std::string(path.filename());
-
-			SingleFileSingleHit(inputFileName, sepFileName, outputFileName);
+		for (const auto &task : tasks) {
+			SingleFileSingleHit(task.input, sepFileName, task.output, nullptr, task.config);
 		}
 	}
 
-
 	return 0;
 }
\ No newline at end of file
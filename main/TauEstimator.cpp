@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cmath>
+
+#include "TauEstimator.h"
+
+
+//--------------------------------------------------
+//					TauEstimator
+//--------------------------------------------------
+
+TauEstimator::TauEstimator(size_t baseLen_, size_t skip_, double fraction_, size_t minPoints_) {
+	baseLen = baseLen_ ? baseLen_ : 1;
+	skip = skip_;
+	fraction = fraction_;
+	minPoints = minPoints_ > 2 ? minPoints_ : 2;
+}
+
+
+TauEstimator::~TauEstimator() {
+}
+
+
+/*
+ * Estimate
+ *  Log-linear least squares on the tail. The time sums of the points 0..n-1
+ *  are closed forms, so the loop over the tail only sums the logs and the
+ *  logs weighted by the time, with no branch in it.
+ *
+ *  @trace: The raw trace.
+ *  @return: Decay constant in points, 0 if the tail is too short or rising.
+ */
+double TauEstimator::Estimate(const std::vector<double> &trace) {
+	const double *d = trace.data();
+	size_t vsize = trace.size();
+	if (vsize <= baseLen + skip + minPoints) return 0.0;
+
+	double base = 0.0;
+	for (size_t i = 0; i != baseLen; ++i) base += d[i];
+	base /= double(baseLen);
+
+	size_t peak = baseLen;
+	for (size_t i = baseLen; i != vsize; ++i) {
+		peak = d[i] > d[peak] ? i : peak;
+	}
+	double amplitude = d[peak] - base;
+	if (amplitude <= 0.0) return 0.0;
+
+	// the tail from skip after the peak to the first point below the fraction
+	size_t begin = peak + skip;
+	double limit = base + fraction * amplitude;
+	size_t end = begin;
+	while (end < vsize && d[end] > limit) ++end;
+	size_t n = end > begin ? end - begin : 0;
+	if (n < minPoints) return 0.0;
+
+	logs.resize(n);
+	for (size_t i = 0; i != n; ++i) logs[i] = std::log(d[begin+i] - base);
+	double sy = 0.0;
+	double sty = 0.0;
+	for (size_t i = 0; i != n; ++i) {
+		sy += logs[i];
+		sty += double(i) * logs[i];
+	}
+	double dn = double(n);
+	double st = dn * (dn - 1.0) / 2.0;
+	double stt = (dn - 1.0) * dn * (2.0 * dn - 1.0) / 6.0;
+	double slope = (dn * sty - st * sy) / (dn * stt - st * st);
+	return slope < 0.0 ? -1.0 / slope : 0.0;
+}
+
+
+TauEstimator::Result TauEstimator::Run(TraceReader &reader, size_t count, unsigned int dt) {
+	Result result;
+	std::vector<double> taus;
+	taus.reserve(count);
+	for (size_t t = 0; t != count; ++t) {
+		double tau = Estimate(reader.Read());
+		++result.traces;
+		if (tau > 0.0) taus.push_back(tau * double(dt));
+	}
+	result.fitted = taus.size();
+	if (taus.empty()) return result;
+
+	std::sort(taus.begin(), taus.end());
+	auto quantile = [&](double q) {
+		return taus[size_t(q * double(taus.size() - 1) + 0.5)];
+	};
+	result.tau = quantile(0.5);
+	result.low = quantile(0.25);
+	result.high = quantile(0.75);
+	return result;
+}
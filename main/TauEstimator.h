@@ -0,0 +1,50 @@
+#ifndef __TAUESTIMATOR_H__
+#define __TAUESTIMATOR_H__
+
+#include <vector>
+#include <string>
+
+#include "TraceReader.h"
+
+
+// Decay constant (pole-zero) estimate from the tails of the pulses
+//  Fits ln(trace - baseline) of the tail after the peak with a straight line,
+//  the slope is -1/tau. The tail ends where the pulse falls below a fraction
+//  of its amplitude, the noise bends the log below that. The estimate of a
+//  sample of traces is the median, so the pile-up and saturated ones don't
+//  move it, and the quartiles show the spread.
+
+class TauEstimator {
+public:
+	// estimate of a sample of traces, decay constants in ns
+	struct Result {
+		double tau = 0.0;				// median
+		double low = 0.0;				// first quartile
+		double high = 0.0;				// third quartile
+		size_t traces = 0;				// traces read
+		size_t fitted = 0;				// traces with a tail to fit
+	};
+
+	/*
+	 * constructor
+	 *  @baseLen_: Points from the beginning to calculate the baseline.
+	 *  @skip_: Points after the peak before the tail, the rise and the top of the shaper.
+	 *  @fraction_: The tail ends below this fraction of the amplitude.
+	 *  @minPoints_: Fewer tail points than this are not fitted.
+	 */
+	TauEstimator(size_t baseLen_, size_t skip_, double fraction_, size_t minPoints_ = 20);
+	virtual ~TauEstimator();
+
+	// decay constant of the trace in points, 0 if it has no tail to fit
+	virtual double Estimate(const std::vector<double> &trace);
+	// estimate from count traces of the reader, with the sampling period dt in ns
+	virtual Result Run(TraceReader &reader, size_t count, unsigned int dt);
+private:
+	size_t baseLen;
+	size_t skip;
+	double fraction;
+	size_t minPoints;
+	std::vector<double> logs;			// log of the tail
+};
+
+#endif
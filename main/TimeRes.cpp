@@ -6,15 +6,21 @@
 #include <thread>
 #include <map>
 #include <fstream>
+#include <memory>
+#include <filesystem>
 
 #include "TFile.h"
 #include "TTree.h"
 #include "TCut.h"
 #include "TF1.h"
 #include "TH1.h"
+#include "TH1F.h"
 #include "TString.h"
+#include "TROOT.h"
 
 #include "../lib/json.hpp"
+#include "../lib/WorkStealingPool.h"
+#include "ResultStore.h"
 
 
 // task status
@@ -36,10 +42,24 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 		statusLock.unlock();
 	}
 
-	// input file and tree
-	TFile *ipf = new TFile(inputFile.c_str(), "read");
-	if (!ipf) {
-		std::cerr << "Error open file " << inputFile << "." << std::endl;
+	// single hit table of any backend, only the columns of the time difference
+	std::vector<double> values;
+	try {
+		std::unique_ptr<ResultReader> reader = ResultReader::Open(inputFile);
+		std::vector<double> ft = reader->ReadColumn("ft");
+		std::vector<double> bt = reader->ReadColumn("bt");
+		std::vector<double> fct = reader->ReadColumn("fct");
+		std::vector<double> bct = reader->ReadColumn("bct");
+		std::vector<double> fcp = reader->ReadColumn("fcp");
+		std::vector<double> bcp = reader->ReadColumn("bcp");
+		// ft-bt+fct-bct+fcp-bcp, with fct!=0 && bct != 0
+		values.reserve(ft.size());
+		for (size_t i = 0; i != ft.size(); ++i) {
+			if (fct[i] == 0.0 || bct[i] == 0.0) continue;
+			values.push_back(ft[i] - bt[i] + fct[i] - bct[i] + fcp[i] - bcp[i]);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
 		if (status) {
 			statusLock.lock();
 			*status = StatusError;
@@ -47,7 +67,6 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 		}
 		return;
 	}
-	TTree *tree = (TTree*)ipf->Get("tree");
 
 	// output file
 	TFile *opf = new TFile(outputFile.c_str(), "recreate");
@@ -60,10 +79,11 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 		}
 		return;
 	}
+	const char *expression = "ft-bt+fct-bct+fcp-bcp {fct!=0 && bct != 0}";
+
 	// fit 1
-	TCut stripCtCut = "fct!=0 && bct != 0";
-	tree->Draw("ft-bt+fct-bct+fcp-bcp>>hfbt1(200, -100, 100)", stripCtCut);
-	TH1 *hfbt1 = (TH1*)gDirectory->Get("hfbt1");
+	TH1 *hfbt1 = new TH1F("hfbt1", expression, 200, -100, 100);
+	for (double v : values) hfbt1->Fill(v);
 	TF1 *f1 = new TF1("f1", "gaus", -100, 100);
 	hfbt1->Fit(f1, "RQS+");
 
@@ -73,10 +93,8 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 	const int range = 4;
 	double left = mean - range*sigma;
 	double right = mean + range*sigma;
-	TString expStr;
-	expStr.Form("ft-bt+fct-bct+fcp-bcp>>hfbt2(%d, %d, %d)", int(range*sigma*5), int(left), int(right));
-	tree->Draw(expStr.Data(), stripCtCut);
-	TH1 *hfbt2 = (TH1*)gDirectory->Get("hfbt2");
+	TH1 *hfbt2 = new TH1F("hfbt2", expression, int(range*sigma*5), int(left), int(right));
+	for (double v : values) hfbt2->Fill(v);
 	TF1 *f2 = new TF1("f2", "gaus", int(mean-3*sigma), int(mean+3*sigma));
 	hfbt2->Fit(f2, "RQS+");
 
@@ -85,9 +103,8 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 	sigma = f2->GetParameter(2);
 	left = mean - 3*sigma;
 	right = mean + 3*sigma;
-	expStr.Form("ft-bt+fct-bct+fcp-bcp>>hfbt3(%d, %d, %d)", int(3*sigma*5), int(left), int(right));
-	tree->Draw(expStr.Data(), stripCtCut);
-	TH1 *hfbt3 = (TH1*)gDirectory->Get("hfbt3");
+	TH1 *hfbt3 = new TH1F("hfbt3", expression, int(3*sigma*5), int(left), int(right));
+	for (double v : values) hfbt3->Fill(v);
 	TF1 *f3 = new TF1("f3", "gaus", int(mean-3*sigma), int(mean+3*sigma));
 	hfbt3->Fit(f3, "RQS+");
 
@@ -96,7 +113,6 @@ void SingleFileTimeRes(std::string inputFile, std::string outputFile, int *statu
 	hfbt2->Write();
 	hfbt3->Write();
 	opf->Close();
-	ipf->Close();
 
 	double res = f3->GetParameter(2)*2.35;
 	resultLock.lock();
@@ -131,19 +147,33 @@ int main(int argc, char **argv) {
 	std::string singlePath = js["SinglePath"];
 	std::string resPath = js["TimeResPath"];
 
-#ifdef MULTI_THREAD
-
-
-#else
+	// input and output of each single hit file
+	std::vector<std::pair<std::string, std::string>> files;
 	for (const auto &entry : std::filesystem::directory_iterator(singlePath)) {
 		if (entry.is_directory()) continue;
+		if (!ResultReader::IsResultFile(entry.path())) continue;
 		auto &path = entry.path();
 		std::string inputFileName = std::string(path);
-		std::string outputFileName = resPath + std::string(path.filename());
+		std::string outputFileName = resPath + path.stem().string() + ".root";
+		files.emplace_back(inputFileName, outputFileName);
+	}
 
-		SingleFileTimeRes(inputFileName, outputFileName);
+	bool multiThread = js.contains("MultiThread") ? bool(js["MultiThread"]) : false;
+	if (multiThread) {
+		ROOT::EnableThreadSafety();
+		// the fit functions of the same names in the threads stay out of the global list
+		TF1::DefaultAddToGlobalList(false);
+		size_t threads = js.contains("Threads") ? size_t(js["Threads"]) : std::thread::hardware_concurrency();
+		// "none", "core" or "node"
+		std::string affinity = js.contains("Affinity") ? std::string(js["Affinity"]) : "none";
+		// the calling thread runs the files too
+		WorkStealingPool pool(threads > 1 ? threads - 1 : 1, WorkStealingPool::ParseAffinity(affinity));
+		pool.parallel_for(0, files.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i != end; ++i) SingleFileTimeRes(files[i].first, files[i].second);
+		});
+	} else {
+		for (const auto &file : files) SingleFileTimeRes(file.first, file.second);
 	}
-#endif
 
 
 	for (const auto &[file, res] : result) {
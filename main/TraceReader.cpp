@@ -1,3 +1,14 @@
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "TraceReader.h"
 #include "TRandom3.h"
 
@@ -37,6 +48,24 @@ void TraceReader::Reset() {
 	return;
 }
 
+
+// read and drop the entries before it
+void TraceReader::Seek(unsigned long long entry) {
+	Reset();
+	for (unsigned long long i = 0; i != entry; ++i) Read();
+	return;
+}
+
+
+size_t TraceReader::GetRawSize() const {
+	return data.size();
+}
+
+
+void TraceReader::SetStrictSize(bool) {
+	return;
+}
+
 //--------------------------------------------------
 //				FunctionTraceReader
 //--------------------------------------------------
@@ -101,8 +130,11 @@ TraceReader(dt_) {
 	// set branch address
 	tree->SetBranchAddress("dsize", &points);
 	tree->GetEntry(0);
-	rawData = new UShort_t[points];
+	// the buffer holds the longest entry, though entries should be the same size
+	size_t maxPoints = size_t(tree->GetMaximum("dsize"));
+	rawData = new UShort_t[maxPoints > points ? maxPoints : points];
 	tree->SetBranchAddress("data", rawData);
+	strict = true;
 	// tree->SetBranchAddress("base", &base);
 
 	// resize data
@@ -114,6 +146,7 @@ TraceReader(dt_) {
 TTreeTraceReader::~TTreeTraceReader() {
 	delete[] rawData;
 	file->Close();
+	delete file;
 }
 
 
@@ -126,9 +159,22 @@ std::unique_ptr<TraceReader> TTreeTraceReader::Clone() const {
 const std::vector<double>& TTreeTraceReader::Read() {
 	tree->GetEntry(jentry);
 	if (points != data.size()) {
-		std::string info("read data size ");
-		info += std::to_string(points) + " != " + std::to_string(data.size()) + " .";
-		throw std::runtime_error(info);
+		if (strict) {
+			std::string info("read data size ");
+			info += std::to_string(points) + " != " + std::to_string(data.size()) + " .";
+			throw std::runtime_error(info);
+		}
+		// fit to the trace size, pad with the last sample
+		size_t vsize = data.size();
+		size_t copy = points < vsize ? points : vsize;
+		for (size_t i = 0; i != copy; ++i) {
+			data[i] = double(rawData[i]);
+		}
+		for (size_t i = copy; i != vsize; ++i) {
+			data[i] = copy ? data[copy-1] : 0.0;
+		}
+		jentry++;
+		return data;
 	}
 	for (int i = 0; i != points; ++i) {
 		data[i] = double(rawData[i]);
@@ -174,6 +220,358 @@ void TTreeTraceReader::Reset() {
 }
 
 
+void TTreeTraceReader::Seek(unsigned long long entry) {
+	jentry = Long64_t(entry);
+	return;
+}
+
+
 Long64_t TTreeTraceReader::GetTreeEntries() const {
 	return tree->GetEntries();
-}
\ No newline at end of file
+}
+
+
+size_t TTreeTraceReader::GetRawSize() const {
+	return points;
+}
+
+
+void TTreeTraceReader::SetStrictSize(bool strict_) {
+	strict = strict_;
+	return;
+}
+
+
+//--------------------------------------------------
+//				StridedTraceReader
+//--------------------------------------------------
+
+
+// constructor
+StridedTraceReader::StridedTraceReader(std::unique_ptr<TraceReader> reader_, unsigned long long stride_, unsigned long long offset_):
+TraceReader(reader_->GetPeriod()) {
+	if (!stride_) throw std::runtime_error("Error: stride of the strided reader is 0.");
+	reader = std::move(reader_);
+	stride = stride_;
+	offset = offset_;
+	next = 0;
+}
+
+
+StridedTraceReader::~StridedTraceReader() {
+}
+
+
+std::unique_ptr<TraceReader> StridedTraceReader::Clone() const {
+	return std::make_unique<StridedTraceReader>(reader->Clone(), stride, offset);
+}
+
+
+// seek the entry of the subset in the inner reader
+const std::vector<double>& StridedTraceReader::Read() {
+	reader->Seek(offset + next * stride);
+	++next;
+	return reader->Read();
+}
+
+
+double StridedTraceReader::GetBase() {
+	return reader->GetBase();
+}
+
+
+void StridedTraceReader::Reset() {
+	next = 0;
+	return;
+}
+
+
+// the entry counts in the subset
+void StridedTraceReader::Seek(unsigned long long entry) {
+	next = entry;
+	return;
+}
+
+
+size_t StridedTraceReader::GetRawSize() const {
+	return reader->GetRawSize();
+}
+
+
+void StridedTraceReader::SetStrictSize(bool strict_) {
+	reader->SetStrictSize(strict_);
+	return;
+}
+
+
+
+//--------------------------------------------------
+//				SharedTraceReader
+//--------------------------------------------------
+
+
+// constructor
+SharedTraceReader::SharedTraceReader(const std::string &name_, const char *file_, const char *tree_, unsigned int dt_):
+SharedTraceReader(Attach(name_, file_, tree_), dt_) {
+}
+
+
+SharedTraceReader::SharedTraceReader(std::shared_ptr<Segment> segment_, unsigned int dt_):
+TraceReader(dt_) {
+	segment = segment_;
+	const char *base = (const char*)segment->memory;
+	const Header *header = (const Header*)base;
+	entries = header->entries;
+	stride = header->stride;
+	sizes = (const UShort_t*)(base + header->sizesOffset);
+	samples = (const UShort_t*)(base + header->samplesOffset);
+	jentry = 0;
+	strict = true;
+	points = entries ? sizes[0] : 0;
+	data.resize(points);
+}
+
+
+SharedTraceReader::~SharedTraceReader() {
+}
+
+
+SharedTraceReader::Segment::~Segment() {
+	if (memory) munmap(memory, bytes);
+	// not by the forked children
+	if (owner && owner == getpid()) shm_unlink(name.c_str());
+}
+
+
+std::unique_ptr<TraceReader> SharedTraceReader::Clone() const {
+	return std::unique_ptr<TraceReader>(new SharedTraceReader(segment, period));
+}
+
+
+// the same fitting as the tree reader
+const std::vector<double>& SharedTraceReader::Read() {
+	if (jentry >= entries) {
+		throw std::runtime_error("Error: read entry " + std::to_string(jentry) + " beyond the shared trace.");
+	}
+	points = sizes[jentry];
+	const UShort_t *raw = samples + jentry * stride;
+	if (points != data.size()) {
+		if (strict) {
+			std::string info("read data size ");
+			info += std::to_string(points) + " != " + std::to_string(data.size()) + " .";
+			throw std::runtime_error(info);
+		}
+		size_t vsize = data.size();
+		size_t copy = points < vsize ? points : vsize;
+		for (size_t i = 0; i != copy; ++i) {
+			data[i] = double(raw[i]);
+		}
+		for (size_t i = copy; i != vsize; ++i) {
+			data[i] = copy ? data[copy-1] : 0.0;
+		}
+		jentry++;
+		return data;
+	}
+	for (size_t i = 0; i != points; ++i) {
+		data[i] = double(raw[i]);
+	}
+	jentry++;
+	return data;
+}
+
+
+void SharedTraceReader::Reset() {
+	jentry = 0;
+	return;
+}
+
+
+void SharedTraceReader::Seek(unsigned long long entry) {
+	jentry = entry;
+	return;
+}
+
+
+size_t SharedTraceReader::GetRawSize() const {
+	return points;
+}
+
+
+void SharedTraceReader::SetStrictSize(bool strict_) {
+	strict = strict_;
+	return;
+}
+
+
+unsigned long long SharedTraceReader::GetEntries() const {
+	return entries;
+}
+
+
+// FNV-1a of the identity
+std::string SharedTraceReader::SegmentName(const std::string &identity) {
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : identity) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", hash);
+	return std::string("/sim-trace-") + hex;
+}
+
+
+/*
+ * Attach
+ *  Create the segment and load it, or open it read-only and wait for the
+ *  loader. A segment left by a loader that died, or created but never sized
+ *  or never given a loader in 10 s, is removed and the attach starts again,
+ *  or throws if it can't be removed.
+ */
+std::shared_ptr<SharedTraceReader::Segment> SharedTraceReader::Attach(const std::string &name, const char *file, const char *tree) {
+	bool loaded = false;
+	for (;;) {
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd >= 0) {
+			// readable by the runs of the other users
+			fchmod(fd, 0644);
+			try {
+				Load(fd, file, tree);
+			} catch (...) {
+				close(fd);
+				shm_unlink(name.c_str());
+				throw;
+			}
+			close(fd);
+			loaded = true;
+			continue;
+		}
+		if (errno != EEXIST) throw std::runtime_error("Error: create shared trace " + name + ".");
+		fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			// removed meanwhile
+			if (errno == ENOENT) continue;
+			throw std::runtime_error("Error: open shared trace " + name + ".");
+		}
+
+		bool stale = false;
+		bool waiting = false;
+		auto start = std::chrono::steady_clock::now();
+		for (;;) {
+			struct stat status;
+			if (fstat(fd, &status) != 0) {
+				close(fd);
+				throw std::runtime_error("Error: stat shared trace " + name + ".");
+			}
+			if (size_t(status.st_size) >= sizeof(Header)) {
+				void *memory = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+				if (memory == MAP_FAILED) {
+					close(fd);
+					throw std::runtime_error("Error: map shared trace " + name + ".");
+				}
+				const Header *header = (const Header*)memory;
+				bool ready = header->ready.load(std::memory_order_acquire);
+				int loader = header->loader;
+				munmap(memory, sizeof(Header));
+				if (ready) break;
+				if (loader > 0 && kill(loader, 0) != 0 && errno == ESRCH) {
+					stale = true;
+					break;
+				}
+				// sized by a loader that died before writing its pid
+				if (loader <= 0 && std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) {
+					stale = true;
+					break;
+				}
+				if (!waiting) {
+					std::cout << "Wait for process " << loader << " loading shared trace " << name << std::endl;
+					waiting = true;
+				}
+			} else if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) {
+				stale = true;
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		if (stale) {
+			close(fd);
+			// removed by another run meanwhile, or not ours to remove
+			if (shm_unlink(name.c_str()) != 0 && errno != ENOENT) {
+				throw std::runtime_error("Error: remove stale shared trace " + name + ", " + std::strerror(errno) + ".");
+			}
+			continue;
+		}
+
+		struct stat status;
+		fstat(fd, &status);
+		auto segment = std::make_shared<Segment>();
+		segment->name = name;
+		if (loaded) segment->owner = getpid();
+		segment->bytes = size_t(status.st_size);
+		segment->memory = mmap(nullptr, segment->bytes, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (segment->memory == MAP_FAILED) {
+			segment->bytes = 0;
+			segment->memory = nullptr;
+			throw std::runtime_error("Error: map shared trace " + name + ".");
+		}
+		const Header *header = (const Header*)segment->memory;
+		if (std::memcmp(header->magic, "SIMTRACE", 8) != 0 || header->version != Version) {
+			throw std::runtime_error("Error: shared trace " + name + " of another version, remove it from /dev/shm.");
+		}
+		return segment;
+	}
+}
+
+
+// the loader is known as soon as the header exists, the space is reserved before
+// writing so a full /dev/shm fails here instead of with a bus error
+void SharedTraceReader::Load(int fd, const char *file, const char *tree) {
+	TFile input(file, "read");
+	if (input.IsZombie()) throw std::runtime_error("Error read file " + std::string(file) + ".");
+	TTree *inputTree = (TTree*)input.Get(tree);
+	if (!inputTree) throw std::runtime_error("Error: tree " + std::string(tree) + " not in " + std::string(file) + ".");
+	UShort_t size;
+	inputTree->SetBranchAddress("dsize", &size);
+	unsigned long long treeEntries = (unsigned long long)inputTree->GetEntries();
+	unsigned long long longest = (unsigned long long)inputTree->GetMaximum("dsize");
+	std::vector<UShort_t> raw(longest ? longest : 1);
+	inputTree->SetBranchAddress("data", raw.data());
+
+	unsigned long long sizesOffset = (sizeof(Header) + 63) / 64 * 64;
+	unsigned long long samplesOffset = (sizesOffset + treeEntries * sizeof(UShort_t) + 63) / 64 * 64;
+	size_t bytes = size_t(samplesOffset + treeEntries * longest * sizeof(UShort_t));
+	if (ftruncate(fd, sizeof(Header)) != 0) throw std::runtime_error("Error: size shared trace.");
+	void *memory = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED) throw std::runtime_error("Error: map shared trace.");
+	Header *header = (Header*)memory;
+	header->loader = getpid();
+	munmap(memory, sizeof(Header));
+	int error = posix_fallocate(fd, 0, bytes);
+	if (error) {
+		throw std::runtime_error("Error: no room for the shared trace of " + std::to_string(bytes) + " bytes, " + std::strerror(error) + ".");
+	}
+	memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED) throw std::runtime_error("Error: map shared trace.");
+
+	std::cout << "Load shared trace of " << treeEntries << " entries from " << file << std::endl;
+	char *base = (char*)memory;
+	UShort_t *sizes = (UShort_t*)(base + sizesOffset);
+	UShort_t *samples = (UShort_t*)(base + samplesOffset);
+	for (unsigned long long i = 0; i != treeEntries; ++i) {
+		inputTree->GetEntry(i);
+		sizes[i] = size;
+		std::memcpy(samples + i * longest, raw.data(), std::min((unsigned long long)size, longest) * sizeof(UShort_t));
+	}
+	input.Close();
+
+	header = (Header*)memory;
+	std::memcpy(header->magic, "SIMTRACE", 8);
+	header->version = Version;
+	header->entries = treeEntries;
+	header->stride = longest;
+	header->sizesOffset = sizesOffset;
+	header->samplesOffset = samplesOffset;
+	header->ready.store(1, std::memory_order_release);
+	munmap(memory, bytes);
+}
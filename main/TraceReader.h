@@ -6,6 +6,9 @@
 #include <map>
 #include <thread>
 #include <mutex>
+#include <atomic>
+
+#include <sys/types.h>
 
 #include "TF1.h"
 #include "TRandom3.h"
@@ -25,6 +28,12 @@ public:
 	virtual unsigned int GetPeriod() const;
 	virtual double GetBase();
 	virtual void Reset();
+	// the next Read reads the entry, to resume a run
+	virtual void Seek(unsigned long long entry);
+	// points of the last entry before fitting to the trace size
+	virtual size_t GetRawSize() const;
+	// throw if the entry size differs from the first entry, or fit it
+	virtual void SetStrictSize(bool strict_ = true);
 protected:
 	TraceReader(unsigned int dt);
 
@@ -60,6 +69,9 @@ public:
 	virtual double GetBase();
 	virtual Long64_t GetTreeEntries() const;
 	virtual void Reset();
+	virtual void Seek(unsigned long long entry) override;
+	virtual size_t GetRawSize() const override;
+	virtual void SetStrictSize(bool strict_ = true) override;
 private:
 	std::string fileName, treeName;
 	unsigned int dt;
@@ -69,6 +81,101 @@ private:
 	UShort_t *rawData;
 	UShort_t points;
 	Double_t base;
+	bool strict;
+};
+
+
+
+// Reads every stride entry of another reader from the offset, a subset spread
+//  over the whole run for the screening of a sweep
+class StridedTraceReader: public TraceReader {
+public:
+	StridedTraceReader(std::unique_ptr<TraceReader> reader_, unsigned long long stride_, unsigned long long offset_ = 0);
+	virtual ~StridedTraceReader();
+	virtual std::unique_ptr<TraceReader> Clone() const override;
+
+	virtual const std::vector<double> &Read();
+	virtual double GetBase();
+	virtual void Reset();
+	virtual void Seek(unsigned long long entry) override;
+	virtual size_t GetRawSize() const override;
+	virtual void SetStrictSize(bool strict_ = true) override;
+private:
+	std::unique_ptr<TraceReader> reader;
+	unsigned long long stride;
+	unsigned long long offset;
+	unsigned long long next;					// index of the next entry in the subset
+};
+
+
+
+// Reads the traces of a tree from a POSIX shared memory segment
+//  The first process on the node asking for the segment decodes the tree into
+//  it, the raw samples of every entry padded to the longest one, and the others
+//  attach it read-only and wait until it's complete. The process that decoded
+//  it removes the name when its last reader is gone, the processes still
+//  attached keep their mapping. The clones share the mapping.
+class SharedTraceReader: public TraceReader {
+public:
+	/*
+	 * constructor
+	 *  @name_: Name of the segment, see SegmentName.
+	 *  @file_: Tree file to load the segment from if missing.
+	 *  @tree_: Name of the tree.
+	 *  @dt_: Sampling period, ns.
+	 */
+	SharedTraceReader(const std::string &name_, const char *file_, const char *tree_, unsigned int dt_);
+	virtual ~SharedTraceReader();
+	virtual std::unique_ptr<TraceReader> Clone() const override;
+
+	virtual const std::vector<double> &Read();
+	virtual void Reset();
+	virtual void Seek(unsigned long long entry) override;
+	virtual size_t GetRawSize() const override;
+	virtual void SetStrictSize(bool strict_ = true) override;
+	virtual unsigned long long GetEntries() const;
+
+	// name of the segment of the file identity, a changed file gets another segment
+	static std::string SegmentName(const std::string &identity);
+
+	// layout of the segment, readers of another version don't attach
+	static constexpr unsigned int Version = 1;
+private:
+	// the sizes of the entries and then their samples follow the header
+	struct Header {
+		char magic[8];
+		unsigned int version;
+		std::atomic<int> ready;
+		int loader;							// pid of the loading process
+		unsigned long long entries;
+		unsigned long long stride;			// samples of each entry, the longest one
+		unsigned long long sizesOffset;		// bytes from the start of the segment
+		unsigned long long samplesOffset;
+	};
+	// mapping of the segment, unmapped with the last reader, and unlinked
+	// then if this process loaded it
+	struct Segment {
+		void *memory;
+		size_t bytes;
+		std::string name;
+		pid_t owner = 0;
+		~Segment();
+	};
+
+	SharedTraceReader(std::shared_ptr<Segment> segment_, unsigned int dt_);
+	// map the segment of the name, load it or wait until another process loaded it
+	static std::shared_ptr<Segment> Attach(const std::string &name, const char *file, const char *tree);
+	// decode the tree into the segment just created
+	static void Load(int fd, const char *file, const char *tree);
+
+	std::shared_ptr<Segment> segment;
+	const UShort_t *sizes;
+	const UShort_t *samples;
+	unsigned long long entries;
+	unsigned long long stride;
+	unsigned long long jentry;
+	UShort_t points;							// raw size of the last entry
+	bool strict;
 };
 
 #endif
\ No newline at end of file
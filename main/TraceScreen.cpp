@@ -0,0 +1,89 @@
+#include <cmath>
+
+#include "TraceScreen.h"
+
+
+//--------------------------------------------------
+//					TraceScreen
+//--------------------------------------------------
+
+/*
+ * constructor
+ *  @size_: Set the expected points of the trace.
+ *  @saturation_: Set the ADC overflow value, e.g. 16383 for 14 bits.
+ *  @baseLen_: Set the points from the beginning to calculate the baseline RMS.
+ *  @baseRMS_: Set the max RMS of the baseline.
+ *  @skip_: Skip all stages of the bad traces, or only tag them.
+ */
+TraceScreen::TraceScreen(size_t size_, double saturation_, size_t baseLen_, double baseRMS_, bool skip_) {
+	size = size_;
+	saturation = saturation_;
+	baseLen = baseLen_;
+	baseRMS = baseRMS_;
+	skip = skip_;
+}
+
+
+TraceScreen::~TraceScreen() {
+}
+
+
+std::unique_ptr<TraceScreen> TraceScreen::Clone() const {
+	return std::make_unique<TraceScreen>(size, saturation, baseLen, baseRMS, skip);
+}
+
+
+/*
+ * Check
+ *  Check the trace in one pass over the samples. The min/max loop is branch
+ *  free so it vectorizes, the baseline sums use 4 independent accumulators.
+ *
+ *  @trace: The raw trace.
+ *  @rawSize: Points of the entry before the reader fit it to the trace size.
+ *  @return: Reason bits, Good if it passes all checks.
+ */
+unsigned int TraceScreen::Check(const std::vector<double> &trace, size_t rawSize) const {
+	unsigned int reason = Good;
+
+	// length
+	if (rawSize != size || trace.size() != size) reason |= LengthMismatch;
+
+	// min and max
+	const double *d = trace.data();
+	size_t vsize = trace.size();
+	double low = vsize ? d[0] : 0.0;
+	double high = low;
+	for (size_t i = 0; i < vsize; ++i) {
+		low = d[i] < low ? d[i] : low;
+		high = d[i] > high ? d[i] : high;
+	}
+	if (high >= saturation || low <= 0.0) reason |= Saturated;
+
+	// baseline RMS
+	size_t len = baseLen < vsize ? baseLen : vsize;
+	if (len) {
+		double sum[4] = {0.0, 0.0, 0.0, 0.0};
+		double sum2[4] = {0.0, 0.0, 0.0, 0.0};
+		size_t i = 0;
+		for (; i + 4 <= len; i += 4) {
+			for (size_t j = 0; j != 4; ++j) {
+				sum[j] += d[i+j];
+				sum2[j] += d[i+j] * d[i+j];
+			}
+		}
+		for (; i != len; ++i) {
+			sum[0] += d[i];
+			sum2[0] += d[i] * d[i];
+		}
+		double mean = (sum[0] + sum[1] + sum[2] + sum[3]) / len;
+		double mean2 = (sum2[0] + sum2[1] + sum2[2] + sum2[3]) / len;
+		double variance = mean2 - mean * mean;
+		if (variance > baseRMS * baseRMS) reason |= BaseExcursion;
+	}
+	return reason;
+}
+
+
+bool TraceScreen::IsSkip() const {
+	return skip;
+}
@@ -0,0 +1,37 @@
+#ifndef __TRACESCREEN_H__
+#define __TRACESCREEN_H__
+
+#include <vector>
+#include <memory>
+
+
+// Trace quality pre-screen
+//  Checks the length, min/max and baseline RMS of the trace before any filter
+//  runs. The simulator counts the rejections of each reason from the bits.
+
+class TraceScreen {
+public:
+	// reasons of the rejection, bits of the quality flag
+	static constexpr unsigned int Good = 0;
+	static constexpr unsigned int LengthMismatch = 1;
+	static constexpr unsigned int Saturated = 2;
+	static constexpr unsigned int BaseExcursion = 4;
+	static constexpr size_t Reasons = 3;
+
+	TraceScreen(size_t size_, double saturation_, size_t baseLen_, double baseRMS_, bool skip_);
+	virtual ~TraceScreen();
+	virtual std::unique_ptr<TraceScreen> Clone() const;
+
+	// check the trace and return the reason bits
+	virtual unsigned int Check(const std::vector<double> &trace, size_t rawSize) const;
+	// skip the stages of the bad traces, or only tag them
+	virtual bool IsSkip() const;
+private:
+	size_t size;							// expected points
+	double saturation;						// ADC overflow value
+	size_t baseLen;							// points to calculate the baseline
+	double baseRMS;							// max RMS of the baseline
+	bool skip;
+};
+
+#endif
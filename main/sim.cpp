@@ -1,12 +1,28 @@
 #include <thread>
 #include <fstream>
 #include <memory>
+#include <map>
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <cmath>
+#include <chrono>
 
 #include "TF1.h"
+#include "TROOT.h"
 
 #include "Simulator.h"
+#include "ResultCache.h"
+#include "Checkpoint.h"
+#include "Optimizer.h"
+#include "ProcessRunner.h"
+#include "Daemon.h"
+#include "TauEstimator.h"
+#include "ScalingReport.h"
 #include "../lib/json.hpp"
-#include "../lib/ThreadPool.h"
+#include "../lib/WorkStealingPool.h"
 
 typedef Simulator::RunFlag rFlag;
 const rFlag energyRun = rFlag::SlowFilter;
@@ -30,6 +46,51 @@ Double_t ExpDecay(Double_t *x, Double_t *par) {
 }
 
 
+// ReadGate
+//  Read the gate of a stage from json, e.g. {"Trigger": true, "Pileup": true, "Energy": [2000, 3500]}
+Simulator::Gate ReadGate(const nlohmann::json &js) {
+	Simulator::Gate gate;
+	if (js.contains("Trigger")) {
+		gate.trigger = js["Trigger"];
+	}
+	if (js.contains("Pileup")) {
+		gate.pileup = js["Pileup"];
+	}
+	if (js.contains("Energy")) {
+		gate.energy = true;
+		gate.energyMin = js["Energy"][0];
+		gate.energyMax = js["Energy"][1];
+	}
+	return gate;
+}
+
+
+// estimate of the ranking kept by the cache and the checkpoint
+nlohmann::json EstimateToJson(const ResolutionEstimate &estimate) {
+	return {
+		{"Entries", estimate.entries},
+		{"Peak", estimate.peak},
+		{"FWHM", estimate.energyFWHM},
+		{"Resolution", estimate.energyResolution},
+		{"Sigma", estimate.timeSigma}
+	};
+}
+
+
+// add the kept estimate to the ranking under the current name
+void AddEstimate(ResolutionRanking &ranking, const std::string &name, const nlohmann::json &js) {
+	if (!js.contains("Peak")) return;
+	ResolutionEstimate estimate;
+	estimate.name = name;
+	estimate.entries = js["Entries"];
+	estimate.peak = js["Peak"];
+	estimate.energyFWHM = js["FWHM"];
+	estimate.energyResolution = js["Resolution"];
+	estimate.timeSigma = js["Sigma"];
+	ranking.Add(estimate);
+}
+
+
 // void ExpDecayMWDSim() {
 // 	// Reader
 // 	TF1 f1("ExpDecay", ExpDecay, 0, 20000, 4);
@@ -71,16 +132,8 @@ Double_t ExpDecay(Double_t *x, Double_t *par) {
 
 
 
-void TTreeSimulate(const char *configFileName) {
-	std::ifstream configFile(configFileName);
-	if (!configFile.good()) {
-		std::cerr << "Error open file " << configFileName << std::endl;
-		exit(-1);
-	}
-	nlohmann::json js;
-	configFile >> js;
-	configFile.close();
-
+// run the sweep of the config, the exit status is 1 after an error is printed
+int TTreeSimulate(nlohmann::json js) {
 	std::string tracePath = js["TracePath"];
 	std::string traceFile = js["TraceFile"];
 	std::string simPath = js["SimPath"];
@@ -101,9 +154,167 @@ void TTreeSimulate(const char *configFileName) {
 	std::string cfdFilterType = js["CFDFilter"];
 	std::string cfdPickerType = js["CFDPicker"];
 
+	// pile-up inspection, window in points, 0 to disable
+	size_t pileupWindow = js.contains("PileupWindow") ? size_t(js["PileupWindow"]) : 0;
+	bool pileupReject = js.contains("PileupReject") ? bool(js["PileupReject"]) : false;
+	// multi-hit, retrigger holdoff in points, 0 to disable
+	size_t hitHoldoff = js.contains("HitHoldoff") ? size_t(js["HitHoldoff"]) : 0;
+	// staged pipeline in each tree simulator, 0 workers to run serially
+	size_t pipelineWorkers = js.contains("PipelineWorkers") ? size_t(js["PipelineWorkers"]) : 0;
+	size_t pipelineBatch = js.contains("PipelineBatch") ? size_t(js["PipelineBatch"]) : 64;
+	// backend of the result table, "ttree", "rntuple" or "columnar"
+	std::string outputBackend = js.contains("OutputBackend") ? std::string(js["OutputBackend"]) : "ttree";
+	if (!ResultWriter::HasBackend(outputBackend)) {
+		std::cerr << "Error: output backend " << outputBackend << " invalid or not compiled in, rntuple needs SIM_RNTUPLE." << std::endl;
+		return 1;
+	}
+	ResultOptions outputOptions;
+	if (js.contains("ClusterBytes")) outputOptions.clusterBytes = js["ClusterBytes"];
+	if (js.contains("Compression")) outputOptions.compression = js["Compression"];
+	if (js.contains("ClusterRows")) outputOptions.clusterRows = js["ClusterRows"];
+	// "files" for one file of each configuration, "shared" for one table of all
+	std::string outputMode = js.contains("OutputMode") ? std::string(js["OutputMode"]) : "files";
+	// energy histogram {"Bins", "Low", "High"}, or {"Bins", "Auto"} to range by the first Auto energies
+	size_t energyBins = 500;
+	double energyLow = 2000.0;
+	double energyHigh = 3500.0;
+	size_t energySamples = 0;
+	if (js.contains("EnergyHistogram")) {
+		auto &histJs = js["EnergyHistogram"];
+		if (histJs.contains("Bins")) energyBins = histJs["Bins"];
+		if (histJs.contains("Low")) energyLow = histJs["Low"];
+		if (histJs.contains("High")) energyHigh = histJs["High"];
+		if (histJs.contains("Auto")) energySamples = histJs["Auto"];
+	}
+	// ranking of the configurations, e.g. {"Low": 5000, "High": 5300, "Sort": "energy", "Top": 10},
+	// the line is searched in the whole energy histogram without Low and High
+	nlohmann::json rankJs = js.contains("Ranking") ? js["Ranking"] : nlohmann::json::object();
+	double lineLow = rankJs.contains("Low") ? double(rankJs["Low"]) : 0.0;
+	double lineHigh = rankJs.contains("High") ? double(rankJs["High"]) : 0.0;
+	std::string sortBy = rankJs.contains("Sort") ? std::string(rankJs["Sort"]) : "energy";
+	size_t rankingTop = rankJs.contains("Top") ? size_t(rankJs["Top"]) : 10;
+	std::unique_ptr<ResolutionRanking> ranking = std::make_unique<ResolutionRanking>(lineLow, lineHigh, sortBy);
+	// successive halving of the tree simulator in the files mode, e.g. {"Fraction": 0.02, "Eta": 2, "Top": 4},
+	// every configuration runs on a subset of Fraction of the entries spread over the run, the best 1/Eta
+	// of them run again on Eta times the entries, until Top are left and run on all entries
+	bool halving = js.contains("Halving");
+	double halvingFraction = 0.02;
+	size_t halvingEta = 2;
+	size_t halvingTop = 4;
+	unsigned int halvingMin = 1000;
+	if (halving) {
+		auto &halvingJs = js["Halving"];
+		if (halvingJs.contains("Fraction")) halvingFraction = halvingJs["Fraction"];
+		if (halvingJs.contains("Eta")) halvingEta = halvingJs["Eta"];
+		if (halvingJs.contains("Top")) halvingTop = halvingJs["Top"];
+		if (halvingJs.contains("MinEntries")) halvingMin = halvingJs["MinEntries"];
+		if (halvingFraction <= 0.0 || halvingFraction >= 1.0 || halvingEta < 2 || !halvingTop) {
+			std::cerr << "Error: invalid halving, Fraction in (0, 1), Eta at least 2 and Top at least 1." << std::endl;
+			return 1;
+		}
+	}
+	// result cache of the tree simulator in the files mode, size in MB, 0 for no limit
+	std::string cachePath = js.contains("CachePath") ? std::string(js["CachePath"]) : "";
+	bool useCache = js.contains("Cache") ? bool(js["Cache"]) : cachePath.size() > 0;
+	unsigned long long cacheSize = js.contains("CacheSize") ? (unsigned long long)(js["CacheSize"]) : 20480;
+	// journal of the sweep in the files mode to resume it, saved every CheckpointEntries entries
+	bool useCheckpoint = js.contains("Checkpoint") ? bool(js["Checkpoint"]) : true;
+	unsigned int checkpointEntries = js.contains("CheckpointEntries") ? (unsigned int)(js["CheckpointEntries"]) : 100000;
+	// split the configurations longer than the share of a thread into batches of entries run by the
+	// pipeline workers, only when PipelineWorkers is not set
+	bool splitLarge = js.contains("SplitLarge") ? bool(js["SplitLarge"]) : true;
+	// pinning of the threads of the pool, "none", "core" or "node", with "core" or "node" the
+	// configurations are dealt to the NUMA nodes in turn and a scaling report is written
+	WorkStealingPool::Affinity affinity = WorkStealingPool::Affinity::None;
+	try {
+		if (js.contains("Affinity")) affinity = WorkStealingPool::ParseAffinity(js["Affinity"]);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	// run the configurations of the tree simulator in the files mode in worker processes instead of
+	// the threads, each with its own ROOT state, a worker dying runs its configuration again in a new
+	// one at most ProcessRetries times, the journal and the ranking are kept by this process
+	size_t processes = js.contains("Processes") ? size_t(js["Processes"]) : 0;
+	size_t processRetries = js.contains("ProcessRetries") ? size_t(js["ProcessRetries"]) : 2;
+	if (processes) multiThread = false;
+	// read the traces decoded once into shared memory by the first run on the node, instead of
+	// decoding the tree file in each run, the segment of the file stays in /dev/shm until removed
+	bool sharedTrace = js.contains("SharedTrace") ? bool(js["SharedTrace"]) : false;
+	// configurations of the same fast filter run in one pass over the traces, at most Fuse of them,
+	// the filter outputs they share are computed once for each trace, 1 to run each one alone,
+	// only for the tree simulator in the files mode without PipelineWorkers and Processes, the
+	// passes run serially and save no checkpoint before all of their configurations completed
+	size_t fuse = js.contains("Fuse") ? size_t(js["Fuse"]) : 1;
+	if (fuse > 1 && pipelineWorkers) {
+		std::cerr << "Warning: Fuse is ignored with PipelineWorkers, each configuration runs alone." << std::endl;
+	}
+	if (fuse > 1 && useCheckpoint && checkpointEntries) {
+		std::cerr << "Warning: the fused configurations save no checkpoint every CheckpointEntries entries." << std::endl;
+	}
+	// the reader, workers and writer of the pipeline run in different threads
+	if (multiThread || pipelineWorkers) ROOT::EnableThreadSafety();
+
 
 	// readers' preparing
 	std::string traceFileName = tracePath + traceFile;
+	// the only reader opened before the runs, each run opens its clone when it starts and closes it
+	// at the end, so the open files are at most the threads instead of the configurations
+	std::unique_ptr<TraceReader> sourceReader;
+	unsigned long long treeEntries = 0;
+	try {
+		if (sharedTrace) {
+			// a segment that can't be attached, e.g. a stale one of another user, falls back to a private reader
+			try {
+				std::string segmentName = SharedTraceReader::SegmentName(ResultCache::FileIdentity(traceFileName));
+				auto sharedReader = std::make_unique<SharedTraceReader>(segmentName, traceFileName.c_str(), "tree", dt);
+				treeEntries = sharedReader->GetEntries();
+				sourceReader = std::move(sharedReader);
+			} catch (const std::exception &e) {
+				std::cerr << e.what() << " Read the trace privately." << std::endl;
+			}
+		}
+		if (!sourceReader) {
+			auto treeReader = std::make_unique<TTreeTraceReader>(traceFileName.c_str(), "tree", dt);
+			treeEntries = (unsigned long long)treeReader->GetTreeEntries();
+			sourceReader = std::move(treeReader);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	TraceReader &traceReader = *sourceReader;
+
+	// estimate the decay constant from the tails of a sample of traces and use it as the only ST, so
+	// the slow filters sweep SL and SG only, with "ST": "auto" or the options of the estimate, e.g.
+	// {"Entries": 2000, "BaseLength": 80, "Skip": 20, "Fraction": 0.1}, written to tau.json
+	bool estimateTau = js.contains("TauEstimate") || (js.contains("ST") && js["ST"].is_string());
+	if (estimateTau && (runFlag & rFlag::SlowFilter) != 0 && (slowFilterType == "xia" || slowFilterType == "mwd")) {
+		nlohmann::json tauJs = js.contains("TauEstimate") ? js["TauEstimate"] : nlohmann::json::object();
+		unsigned long long tauEntries = tauJs.contains("Entries") ? (unsigned long long)(tauJs["Entries"]) : 2000;
+		size_t baseLen = tauJs.contains("BaseLength") ? size_t(tauJs["BaseLength"]) : (zeroPoint > 20 ? zeroPoint - 20 : 1);
+		size_t skip = tauJs.contains("Skip") ? size_t(tauJs["Skip"]) : 20;
+		double fraction = tauJs.contains("Fraction") ? double(tauJs["Fraction"]) : 0.1;
+		if (!tauEntries || tauEntries > treeEntries) tauEntries = treeEntries;
+		// every stride entry, so a drift of the run is in the sample
+		unsigned long long stride = tauEntries ? treeEntries / tauEntries : 1;
+		StridedTraceReader tauReader(traceReader.Clone(), stride);
+		TauEstimator estimator(baseLen, skip, fraction);
+		TauEstimator::Result tau = estimator.Run(tauReader, size_t(tauEntries), dt);
+		if (!tau.fitted) {
+			std::cerr << "Error: none of " << tau.traces << " traces has a tail to estimate ST." << std::endl;
+			return 1;
+		}
+		unsigned int st = (unsigned int)std::lround(tau.tau);
+		std::cout << "Tau " << st << " ns  quartiles " << tau.low << " " << tau.high
+			<< "  fitted " << tau.fitted << " of " << tau.traces << std::endl;
+		js["ST"] = {st, st, 1};
+		nlohmann::json tauOutput = {
+			{"ST", st}, {"Low", tau.low}, {"High", tau.high}, {"Traces", tau.traces}, {"Fitted", tau.fitted}
+		};
+		std::ofstream(simPath + "tau.json") << tauOutput.dump(4) << std::endl;
+	}
+
 	std::vector<std::string> simFileNames;
 	std::vector<std::string> slowNames, fastNames, cfdNames;
 
@@ -130,12 +341,15 @@ void TTreeSimulate(const char *configFileName) {
 				SG[i] = js["SG"][i];
 				ST[i] = js["ST"][i];
 			}
+			// ST in the name only if it's swept
+			bool stSwept = ST[0] + ST[2] <= ST[1];
 			for (unsigned int sl = SL[0]; sl <= SL[1]; sl += SL[2]) {
 				for (unsigned int sg = SG[0]; sg <= SG[1]; sg += SG[2]) {
 					for (unsigned int st = ST[0]; st <= ST[1]; st += ST[2]) {
 						// slowFilters.push_back(new MWDAlgorithm(sl*dt, sg*dt, st, dt));
 						slowFilters.push_back(std::make_unique<MWDAlgorithm>(sl*dt, sg*dt, st, dt));
-						slowNames.push_back("SL" + std::to_string(sl) + "SG" + std::to_string(sg));
+						slowNames.push_back("SL" + std::to_string(sl) + "SG" + std::to_string(sg)
+							+ (stSwept ? "ST" + std::to_string(st) : ""));
 					}
 				}
 			}
@@ -148,12 +362,14 @@ void TTreeSimulate(const char *configFileName) {
 				SG[i] = js["SG"][i];
 				ST[i] = js["ST"][i];
 			}
+			bool stSwept = ST[0] + ST[2] <= ST[1];
 			for (unsigned int sl = SL[0]; sl <= SL[1]; sl += SL[2]) {
 				for (unsigned int sg = SG[0]; sg <= SG[1]; sg += SG[2]) {
 					for (unsigned int st = ST[0]; st <= ST[1]; st += ST[2]) {
 						// slowFilters.push_back(new XiaSlowFilter(sl*dt, sg*dt, st, dt));
 						slowFilters.push_back(std::make_unique<XiaSlowFilter>(sl*dt, sg*dt, st, dt));
-						slowNames.push_back("SL" + std::to_string(sl) + "SG" + std::to_string(sg));
+						slowNames.push_back("SL" + std::to_string(sl) + "SG" + std::to_string(sg)
+							+ (stSwept ? "ST" + std::to_string(st) : ""));
 					}
 				}
 			}
@@ -161,7 +377,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invalid slow filter type " << slowFilterType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 
@@ -193,7 +409,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invalid slow picker type " << slowPickerType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 	}
@@ -223,7 +439,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invalid fast filter type " << fastFilterType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 
@@ -246,7 +462,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invalid fast picker type " << fastPickerType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 
@@ -304,7 +520,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invalid cfd filter type " << cfdFilterType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 
@@ -325,6 +541,17 @@ void TTreeSimulate(const char *configFileName) {
 				cfdNames[i] += cubic ? "c" : "l";
 			}
 
+		} else if (cfdPickerType == "upsample-zero-cross") {
+
+			size_t cfdPoint = zeroPoint - 10;
+			bool cubic = js["CFDCubic"];
+			unsigned int factor = js.contains("CFDUpsample") ? (unsigned int)(js["CFDUpsample"]) : 8;
+			size_t vsize = cfdFilters.size();
+			for (size_t i = 0; i != vsize; ++i) {
+				cfdPickers.push_back(std::make_unique<UpsampleZeroCrossPicker>(cfdPoint, dt, factor, cubic));
+				cfdNames[i] += "U" + std::to_string(factor) + (cubic ? "c" : "l");
+			}
+
 		} else if (cfdPickerType == "digital-fraction") {
 
 			// size_t cfdPoint = zeroPoint - 5 > 0 ? zeroPoint - 5 : 0;
@@ -357,7 +584,7 @@ void TTreeSimulate(const char *configFileName) {
 		} else {
 
 			std::cerr << "Error: invaild cfd picker type " << cfdPickerType << "." << std::endl;
-			return;
+			return 1;
 
 		}
 
@@ -367,17 +594,17 @@ void TTreeSimulate(const char *configFileName) {
 	if (slowFilters.size() != slowPickers.size() || slowFilters.size() != slowNames.size()) {
 		std::cerr << "Assertion failed: slow file names, filters or pickers size not equal." << std::endl;
 		std::cerr << "file " << slowNames.size() << "  fliter " << slowFilters.size() << "  picker " << slowPickers.size() << std::endl;
-		return;
+		return 1;
 	}
 	if (fastFilters.size() != fastPickers.size() || fastFilters.size() != fastNames.size()) {
 		std::cerr << "Assertion failed: fast file names, filters or pickers size not equal." << std::endl;
 		std::cerr << "file " << fastNames.size() << "  fliter " << fastFilters.size() << "  picker " << fastPickers.size() << std::endl;
-		return;
+		return 1;
 	}
 	if (cfdFilters.size() != cfdPickers.size() || cfdFilters.size() != cfdFilters.size()) {
 		std::cerr << "Assertion failed: cfd file names, filters or pickers size not equal." << std::endl;
 		std::cerr << "file " << cfdNames.size() << "  fliter " << cfdFilters.size() << "  picker " << cfdPickers.size() << std::endl;
-		return;
+		return 1;
 	}
 
 
@@ -406,9 +633,228 @@ void TTreeSimulate(const char *configFileName) {
 	std::cout << "CFD names:" << std::endl;
 	for (auto &name : cfdNames) std::cout << name << std::endl;
 
+	entries = entries > 0 ? entries : (unsigned int)treeEntries;
+	// the calling thread runs the tasks too, so the pool has one thread less
+	std::unique_ptr<WorkStealingPool> pool;
+	if (multiThread) pool = std::make_unique<WorkStealingPool>(threads > 1 ? threads - 1 : 1, affinity);
+
+	// settings of every simulator, the screen checks the raw size of the traces
+	auto configure = [&](Simulator *simulator, size_t rawSize) {
+		simulator->SetZeroPoint(zeroPoint);
+		simulator->SetVerbose(verbose);
+		// stage timing of 1 in ProfileSample entries, 0 turns it off
+		if (js.contains("ProfileSample")) simulator->SetProfileSample(js["ProfileSample"]);
+		if (pileupWindow) {
+			simulator->AddPileupPicker(std::make_unique<PileupPicker>(js["FT"], pileupWindow));
+		}
+		if (js.contains("Screen")) {
+			// e.g. {"Mode": "skip", "Saturation": 16383, "BaseLength": 100, "BaseRMS": 20}
+			auto &screenJs = js["Screen"];
+			std::string mode = screenJs["Mode"];
+			simulator->AddScreen(std::make_unique<TraceScreen>(
+				rawSize, screenJs["Saturation"], screenJs["BaseLength"], screenJs["BaseRMS"], mode == "skip"
+			));
+		}
+		if (hitHoldoff) {
+			simulator->AddHitPicker(std::make_unique<MultiHitPicker>(js["FT"], hitHoldoff, Simulator::MaxHits));
+		}
+		Simulator::Gate slowGate, cfdGate;
+		if (js.contains("Gates")) {
+			if (js["Gates"].contains("Slow")) slowGate = ReadGate(js["Gates"]["Slow"]);
+			if (js["Gates"].contains("CFD")) cfdGate = ReadGate(js["Gates"]["CFD"]);
+		}
+		if (pileupWindow && pileupReject) {
+			slowGate.pileup = true;
+			cfdGate.pileup = true;
+		}
+		simulator->SetGate(rFlag::SlowFilter, slowGate);
+		simulator->SetGate(rFlag::CFDFilter, cfdGate);
+	};
+
+
+	// search SL, SG and ST in their bounds and steps for the best energy resolution instead of the
+	// sweep, with the first fast and cfd configuration, e.g. {"Evaluations": 40, "Entries": 100000},
+	// the entries spread over the run and the search starts in the middle of the bounds by default,
+	// "Speculative": true runs the 4 moves of an iteration in parallel at up to twice the evaluations
+	if (js.contains("Optimize")) {
+		auto &optimizeJs = js["Optimize"];
+		if (js["Simulator"] != "tree" || (slowFilterType != "xia" && slowFilterType != "mwd")) {
+			std::cerr << "Error: optimize needs the tree simulator and the xia or mwd slow filter." << std::endl;
+			return 1;
+		}
+		size_t maxEvaluations = optimizeJs.contains("Evaluations") ? size_t(optimizeJs["Evaluations"]) : 40;
+		bool speculative = optimizeJs.contains("Speculative") ? bool(optimizeJs["Speculative"]) : false;
+		unsigned int totalEntries = (unsigned int)treeEntries;
+		unsigned int optimizeEntries = optimizeJs.contains("Entries") ? (unsigned int)(optimizeJs["Entries"]) : entries;
+		if (!optimizeEntries || optimizeEntries > totalEntries) optimizeEntries = totalEntries;
+		unsigned long long stride = totalEntries / optimizeEntries;
+
+		NelderMead::Point low, high, step, start;
+		for (auto key : {"SL", "SG", "ST"}) {
+			low.push_back(js[key][0]);
+			high.push_back(js[key][1]);
+			step.push_back(js[key][2]);
+			start.push_back((low.back() + high.back()) / 2.0);
+		}
+		if (optimizeJs.contains("Start")) {
+			for (size_t i = 0; i != 3; ++i) start[i] = optimizeJs["Start"][i];
+		}
+
+		// the outputs of the evaluated points are kept for the inspection
+		std::string optimizePath = simPath + "optimize/";
+		std::filesystem::create_directories(optimizePath);
+		ResolutionRanking optimizeRanking(lineLow, lineHigh, "energy");
+		size_t slowPoint = zeroPoint-20 > 0 ? zeroPoint-20 : 0;
+		auto pointName = [](const NelderMead::Point &point) {
+			return "SL" + std::to_string((unsigned int)point[0]) + "SG" + std::to_string((unsigned int)point[1])
+				+ "ST" + std::to_string((unsigned int)point[2]);
+		};
+		auto evaluate = [&](const NelderMead::Point &point) {
+			unsigned int sl = (unsigned int)point[0];
+			unsigned int sg = (unsigned int)point[1];
+			unsigned int st = (unsigned int)point[2];
+			std::string name = pointName(point);
+
+			auto simulator = std::make_unique<TTreeSimulator>();
+			simulator->SetPipeline(pipelineWorkers, pipelineBatch);
+			simulator->SetOutput(outputBackend, outputOptions);
+			simulator->SetEnergyHistogram(energyBins, energyLow, energyHigh, energySamples);
+			if (stride > 1) {
+				simulator->AddReader(std::make_unique<StridedTraceReader>(traceReader.Clone(), stride));
+			} else {
+				simulator->AddReader(traceReader.Clone());
+			}
+			if (slowFilterType == "mwd") {
+				simulator->AddSlowFilter(std::make_unique<MWDAlgorithm>(sl*dt, sg*dt, st, dt));
+			} else {
+				simulator->AddSlowFilter(std::make_unique<XiaSlowFilter>(sl*dt, sg*dt, st, dt));
+			}
+			if (slowPickerType == "trapezoid-top") {
+				simulator->AddSlowPicker(std::make_unique<TrapezoidTopPicker>(slowPoint, sl, sl+sg));
+			} else {
+				simulator->AddSlowPicker(std::make_unique<MaxPicker>());
+			}
+			simulator->AddFastFilter(fastFilters[0]->Clone());
+			std::unique_ptr<FilterAlgorithm> cfdFilter = cfdFilters[0]->Clone();
+			if (cfdFilterType == "xia" && fastFilterType == "xia") {
+				size_t l, m;
+				((XiaFastFilter*)(fastFilters[0].get()))->GetParameters(l, m);
+				((XiaCFDFilter*)(cfdFilter.get()))->SetFastFilterParameters(l, m);
+			}
+			simulator->AddCFDFilter(std::move(cfdFilter));
+			simulator->AddFastPicker(fastPickers[0]->Clone());
+			simulator->AddCFDPicker(cfdPickers[0]->Clone());
+
+			simulator->SetPath(optimizePath.c_str());
+			simulator->SetFileName((name + ".root").c_str());
+			simulator->SetRanking(&optimizeRanking, name);
+			configure(simulator.get(), traceReader.GetRawSize());
+			simulator->Run(optimizeEntries, runFlag);
+			simulator->Close();
+
+			ResolutionEstimate estimate;
+			bool found = optimizeRanking.Find(name, estimate) && estimate.energyResolution > 0.0;
+			return found ? estimate.energyResolution : std::numeric_limits<double>::infinity();
+		};
+		// the proposals of an iteration run in parallel
+		auto evaluateBatch = [&](const std::vector<NelderMead::Point> &points) {
+			std::vector<double> values(points.size());
+			if (processes) {
+				// the estimates come back from the workers into the ranking of this process
+				std::vector<std::string> names;
+				for (auto &point : points) names.push_back(pointName(point));
+				ProcessRunner runner(processes, processRetries);
+				runner.Run(names, []() {}, [&](size_t i) {
+					evaluate(points[i]);
+					ResolutionEstimate estimate;
+					return optimizeRanking.Find(names[i], estimate) ? EstimateToJson(estimate).dump() : std::string("{}");
+				}, [&](size_t i, const std::string &result) {
+					AddEstimate(optimizeRanking, names[i], nlohmann::json::parse(result));
+					ResolutionEstimate estimate;
+					bool found = optimizeRanking.Find(names[i], estimate) && estimate.energyResolution > 0.0;
+					values[i] = found ? estimate.energyResolution : std::numeric_limits<double>::infinity();
+				});
+			} else if (pool) {
+				pool->parallel_for(0, points.size(), 1, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i != end; ++i) values[i] = evaluate(points[i]);
+				});
+			} else {
+				for (size_t i = 0; i != points.size(); ++i) values[i] = evaluate(points[i]);
+			}
+			return values;
+		};
+
+		try {
+			NelderMead optimizer(low, high, step, speculative);
+			NelderMead::Point best = optimizer.Minimize(start, evaluateBatch, maxEvaluations);
+			std::cout << "Optimum SL " << best[0] << "  SG " << best[1] << "  ST " << best[2]
+				<< "  resolution " << optimizer.GetHistory().at(best)
+				<< "  evaluations " << optimizer.GetEvaluations() << std::endl;
+			optimizeRanking.Print(std::cout, rankingTop);
+			optimizeRanking.Write(simPath + "optimize.csv");
+		} catch (const std::exception &e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+
 	std::vector<std::unique_ptr<Simulator>> simulators;
+	std::unique_ptr<SharedResultTable> sharedTable;
+	if (outputMode == "shared") {
+		sharedTable = std::make_unique<SharedResultTable>(simPath + simFile, outputBackend, outputOptions);
+	} else if (outputMode != "files") {
+		std::cerr << "Error: invalid output mode " << outputMode << "." << std::endl;
+		return 1;
+	}
+	if (processes && (sharedTable || js["Simulator"] != "tree")) {
+		std::cerr << "Error: processes need the tree simulator in the files mode." << std::endl;
+		return 1;
+	}
+	// cached configurations are restored instead of run
+	struct CacheTask {
+		std::string key;					// empty if not cached
+		std::string description;
+		std::string stem;					// output files without the extension
+		std::string name;					// name in the ranking
+		std::string journal;				// key in the journal, the description and the file
+	};
+	std::vector<CacheTask> cacheTasks;
+	// fast filter of each configuration, the ones of the same are fused
+	std::vector<size_t> fastIndices;
+	std::unique_ptr<ResultCache> cache;
+	std::unique_ptr<SweepCheckpoint> checkpoint;
+	std::string traceIdentity;
+	if ((useCache || useCheckpoint) && !sharedTable && js["Simulator"] == "tree") {
+		traceIdentity = ResultCache::FileIdentity(traceFileName);
+	}
+	if (useCache && cachePath.size() && traceIdentity.size()) {
+		cache = std::make_unique<ResultCache>(cachePath, cacheSize * 1024 * 1024);
+	}
+	if (useCheckpoint && traceIdentity.size()) {
+		// the options not changing the results don't change the sweep
+		nlohmann::json sweepJs = js;
+		for (auto option : {
+			"Verbose", "MultiThread", "Threads", "PipelineWorkers", "PipelineBatch",
+			"Cache", "CacheSize", "CachePath", "Checkpoint", "CheckpointEntries",
+			"Affinity", "Processes", "ProcessRetries", "SharedTrace", "Fuse"
+		}) {
+			sweepJs.erase(option);
+		}
+		checkpoint = std::make_unique<SweepCheckpoint>(
+			simPath + "sweep.checkpoint.json", ResultCache::Key(sweepJs.dump() + "\ntrace " + traceIdentity)
+		);
+	}
+	// options changing the results, the filters and pickers are added by their signatures
+	const char *cacheOptions[] = {
+		"Simulator", "FT", "PileupWindow", "PileupReject", "HitHoldoff", "Screen", "Gates",
+		"EnergyHistogram", "OutputBackend", "ClusterBytes", "Compression", "ProfileSample", "Ranking"
+	};
 	std::vector<TFile*> ipfs;
 	size_t index = 0;
+	// the names of the outputs, the ranking and the journal are unique
+	std::set<std::string> usedNames;
 	for (size_t i = 0; i != slowFilters.size(); ++i) {
 		for (size_t j = 0; j != fastFilters.size(); ++j) {
 			for (size_t k = 0; k != cfdFilters.size(); ++k) {
@@ -416,27 +862,40 @@ void TTreeSimulate(const char *configFileName) {
 				std::string simulatorType = js["Simulator"];
 				if (simulatorType == "base") {
 
-					simulators.push_back(std::make_unique<BaseSimulator>());
+					auto baseSimulator = std::make_unique<BaseSimulator>();
+					// e.g. {"Mode": "failed", "N": 100, "Batch": 64}, the first 100 traces by default
+					if (js.contains("Dump")) {
+						auto &dumpJs = js["Dump"];
+						size_t dumpBatch = dumpJs.contains("Batch") ? size_t(dumpJs["Batch"]) : 64;
+						baseSimulator->AddDebugDump(std::make_unique<DebugDump>(
+							DebugDump::ParseMode(dumpJs["Mode"]), dumpJs["N"], dumpBatch
+						));
+					} else {
+						baseSimulator->AddDebugDump(std::make_unique<DebugDump>(DebugDump::Mode::First, 100));
+					}
+					simulators.push_back(std::move(baseSimulator));
 
 				} else if (simulatorType == "tree") {
 
-					simulators.push_back(std::make_unique<TTreeSimulator>());
+					auto treeSimulator = std::make_unique<TTreeSimulator>();
+					treeSimulator->SetPipeline(pipelineWorkers, pipelineBatch);
+					treeSimulator->SetOutput(outputBackend, outputOptions);
+					treeSimulator->SetEnergyHistogram(energyBins, energyLow, energyHigh, energySamples);
+					simulators.push_back(std::move(treeSimulator));
 
 				} else {
 
 					std::cerr << "Error: invalid simulator type " << simulatorType << "." << std::endl;
+					return 1;
 
 				}
 
 				auto &simulator = simulators.back();
+				TTreeSimulator *tree = dynamic_cast<TTreeSimulator*>(simulator.get());
 
-				std::unique_ptr<TraceReader> reader = std::make_unique<TTreeTraceReader>(traceFileName.c_str(), "tree", dt);
-				if (i==0 && j==0 && k==0) {
-					entries = entries > 0 ? entries : (unsigned int)(((TTreeTraceReader*)reader.get())->GetTreeEntries());
-				}
-				simulator->AddReader(reader->Clone());
 				simulator->AddSlowFilter(slowFilters[i]->Clone());
 				simulator->AddFastFilter(fastFilters[j]->Clone());
+				std::string cfdSignature = cfdFilters[k]->Signature();
 				if (cfdFilterType == "xia" && fastFilterType == "xia") {
 					std::unique_ptr<FilterAlgorithm> cfdFilter = cfdFilters[k]->Clone();
 					size_t l, m;
@@ -444,6 +903,7 @@ void TTreeSimulate(const char *configFileName) {
 					fastFilter->GetParameters(l, m);
 					XiaCFDFilter *cfdFilterPtr = (XiaCFDFilter*)(cfdFilter.get());
 					cfdFilterPtr->SetFastFilterParameters(l, m);
+					cfdSignature = cfdFilter->Signature();
 					simulator->AddCFDFilter(std::move(cfdFilter));
 				} else {
 					simulator->AddCFDFilter(cfdFilters[k]->Clone());
@@ -470,9 +930,44 @@ void TTreeSimulate(const char *configFileName) {
 				} else {
 					simFileName += ".root";
 				}
+				if (!usedNames.insert(simFileName).second) {
+					size_t dot = simFileName.find_last_of('.');
+					simFileName.insert(dot == std::string::npos ? simFileName.size() : dot, "-" + std::to_string(index));
+					usedNames.insert(simFileName);
+				}
 				simulator->SetFileName(simFileName.c_str());
-				simulator->SetZeroPoint(zeroPoint);
-				simulator->SetVerbose(verbose);
+				if (tree) {
+					std::string configName = simFileName.substr(0, simFileName.find_last_of('.'));
+					if (sharedTable) tree->SetSharedOutput(sharedTable.get(), configName);
+					tree->SetRanking(ranking.get(), configName);
+				}
+				configure(simulator.get(), traceReader.GetRawSize());
+
+				CacheTask cacheTask;
+				cacheTask.stem = simPath + simFileName.substr(0, simFileName.find_last_of('.'));
+				cacheTask.name = simFileName.substr(0, simFileName.find_last_of('.'));
+				if (cache || checkpoint) {
+					// the file name is not in the key, it changes with the size of the sweep
+					cacheTask.description = "trace " + traceIdentity
+						+ "\nentries " + std::to_string(entries)
+						+ "\nflag " + std::to_string(int(runFlag))
+						+ "\ndt " + std::to_string(dt)
+						+ "\nzero " + std::to_string(zeroPoint)
+						+ "\nslow " + slowFilters[i]->Signature() + " " + slowPickers[i]->Signature()
+						+ "\nfast " + fastFilters[j]->Signature() + " " + fastPickers[j]->Signature()
+						+ "\ncfd " + cfdSignature + " " + cfdPickers[k]->Signature();
+					for (auto option : cacheOptions) {
+						if (js.contains(option)) cacheTask.description += std::string("\n") + option + " " + js[option].dump();
+					}
+					if (cache) cacheTask.key = ResultCache::Key(cacheTask.description);
+				}
+				if (checkpoint && tree) {
+					// the journal of the old parameters doesn't match if the same name gets other ones
+					cacheTask.journal = ResultCache::Key(cacheTask.description + "\nfile " + simFileName);
+					tree->SetCheckpoint(checkpoint.get(), cacheTask.journal, checkpointEntries);
+				}
+				cacheTasks.push_back(cacheTask);
+				fastIndices.push_back(j);
 
 				++index;
 			}
@@ -480,25 +975,241 @@ void TTreeSimulate(const char *configFileName) {
 	}
 
 
-	try {
-		if (multiThread) {
-			ThreadPool pool(threads);
-			for (auto &simulator : simulators) {
-				pool.enqueue(&Simulator::Run, simulator.get(), entries, runFlag);
+	// the tree simulator of the configuration, for the steps of the tree simulator only
+	auto asTree = [&](size_t s) {
+		TTreeSimulator *simulator = dynamic_cast<TTreeSimulator*>(simulators[s].get());
+		if (!simulator) throw std::runtime_error("Error: " + cacheTasks[s].name + " is not run by the tree simulator.");
+		return simulator;
+	};
+
+	// runs on the nodes for the scaling report, the calling thread on the node of its cpu
+	ScalingReport scaling(pool ? pool->nodes() : 1, pool ? threads : 1);
+	auto timedRun = [&](Simulator *simulator, unsigned int runEntries) {
+		auto start = std::chrono::steady_clock::now();
+		simulator->Run(runEntries, runFlag);
+		simulator->Close();
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+		scaling.Add(pool ? pool->ThreadNode() : 0, runEntries, seconds.count());
+	};
+
+	// set in the worker processes, only this process writes the journal
+	bool inWorker = false;
+	// configurations run in the pass of each one, set for the last run of the sweep
+	std::vector<std::vector<size_t>> fused(simulators.size());
+
+	// skip the configurations of the pass completed before a restart, restore
+	// them from the cache, or run them, then store them and record them completed
+	auto runSimulator = [&](size_t s) {
+		std::vector<size_t> unit{s};
+		unit.insert(unit.end(), fused[s].begin(), fused[s].end());
+		std::vector<size_t> members;
+		for (size_t u : unit) {
+			CacheTask &task = cacheTasks[u];
+			if (checkpoint && checkpoint->IsCompleted(task.journal) && std::ifstream(task.stem + ".root").good()) {
+				AddEstimate(*ranking, task.name, checkpoint->GetExtra(task.journal));
+				std::cout << "completed " << task.name << std::endl;
+				continue;
+			}
+			if (task.key.size()) {
+				nlohmann::json extra;
+				if (cache->Restore(task.key, task.stem, &extra)) {
+					AddEstimate(*ranking, task.name, extra);
+					if (checkpoint && !inWorker) checkpoint->Complete(task.journal, extra);
+					std::cout << "cached " << task.name << std::endl;
+					continue;
+				}
+			}
+			members.push_back(u);
+		}
+		if (members.empty()) return;
+
+		// only the tree simulator is fused
+		Simulator *leader = simulators[members[0]].get();
+		leader->AddReader(traceReader.Clone());
+		if (members.size() > 1) {
+			std::vector<TTreeSimulator*> followers;
+			for (size_t i = 1; i != members.size(); ++i) followers.push_back(asTree(members[i]));
+			asTree(members[0])->SetFollowers(followers);
+		}
+		// the files are complete only after closing
+		timedRun(leader, entries);
+		for (size_t i = 1; i != members.size(); ++i) simulators[members[i]]->Close();
+		for (size_t u : members) simulators[u]->Release();
+
+		for (size_t u : members) {
+			CacheTask &task = cacheTasks[u];
+			ResolutionEstimate estimate;
+			nlohmann::json extra = ranking->Find(task.name, estimate) ? EstimateToJson(estimate) : nlohmann::json::object();
+			if (task.key.size()) {
+				cache->Store(task.key, task.description, task.stem,
+					{task.stem + ".root", task.stem + ".col", task.stem + ".prof.json"}, extra);
+			}
+			if (checkpoint && !inWorker) checkpoint->Complete(task.journal, extra);
+		}
+	};
+
+	// estimated cost of an entry of each configuration
+	std::vector<double> costs(simulators.size());
+	for (size_t s = 0; s != simulators.size(); ++s) costs[s] = simulators[s]->Cost(runFlag, traceReader.GetRawSize());
+	// and of the pass of it with the fused ones
+	auto passCost = [&](size_t s) {
+		double cost = costs[s];
+		for (size_t f : fused[s]) cost += costs[f];
+		return cost;
+	};
+
+	// run the task of each configuration in the pool, the worker processes or one by one, the
+	// error of a task is thrown here and the journal keeps the progress, the workers send the
+	// estimate of the configuration in the task ranking back to the one of this process, and
+	// the journal records it if complete
+	auto runAll = [&](const std::vector<size_t> &indices, const std::function<void(size_t)> &task,
+		ResolutionRanking &taskRanking, bool complete) {
+		// the longest first, so the pool ends with the short ones instead of idle threads
+		std::vector<size_t> order(indices);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return passCost(a) > passCost(b);
+		});
+		if (processes) {
+			std::vector<std::string> names;
+			for (size_t s : order) names.push_back(cacheTasks[s].name);
+			ProcessRunner runner(processes, processRetries);
+			runner.Run(names, [&]() {
+				inWorker = true;
+				for (size_t s : order) asTree(s)->SetCheckpoint(nullptr, cacheTasks[s].journal, 0);
+			}, [&](size_t i) {
+				task(order[i]);
+				ResolutionEstimate estimate;
+				return taskRanking.Find(names[i], estimate) ? EstimateToJson(estimate).dump() : std::string("{}");
+			}, [&](size_t i, const std::string &result) {
+				nlohmann::json extra = nlohmann::json::parse(result);
+				AddEstimate(taskRanking, names[i], extra);
+				if (checkpoint && complete) checkpoint->Complete(cacheTasks[order[i]].journal, extra);
+				std::cout << "done " << names[i] << std::endl;
+			});
+		} else if (pool) {
+			// the pipeline threads inherit the pinning, so they would share one core
+			bool canSplit = affinity != WorkStealingPool::Affinity::Core;
+			if (splitLarge && canSplit && !pipelineWorkers && threads > 1 && js["Simulator"] == "tree") {
+				double total = 0.0;
+				for (size_t s : order) total += passCost(s);
+				double share = total / double(threads);
+				for (size_t s : order) {
+					// a configuration longer than the share alone makes the sweep longer, the fused
+					// ones run serially
+					if (fused[s].size()) continue;
+					size_t parts = share > 0.0 ? size_t(std::ceil(costs[s] / share)) : 1;
+					size_t workers = parts > 1 ? std::min(parts, threads) : 0;
+					asTree(s)->SetPipeline(workers, pipelineBatch);
+				}
 			}
+			// one configuration in a chunk, claimed in the order
+			pool->parallel_for(0, order.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i != end; ++i) task(order[i]);
+			});
 		} else {
-			for (auto &simulator : simulators) {
-				simulator->Run(entries, runFlag);
+			for (size_t s : indices) task(s);
+		}
+	};
+
+	// configurations run on all entries
+	std::vector<size_t> survivors(simulators.size());
+	for (size_t s = 0; s != survivors.size(); ++s) survivors[s] = s;
+
+	auto sweepStart = std::chrono::steady_clock::now();
+	try {
+		if (halving && !sharedTable && js["Simulator"] == "tree") {
+			// the outputs of the screening are dropped, the estimates of each rung are kept in csv
+			std::string screenPath = simPath + "screen/";
+			std::filesystem::create_directories(screenPath);
+			unsigned long long rungEntries = std::max((unsigned long long)(entries * halvingFraction), (unsigned long long)halvingMin);
+			for (size_t rung = 0; survivors.size() > halvingTop && rungEntries < entries; ++rung) {
+				ResolutionRanking rungRanking(lineLow, lineHigh, sortBy);
+				// every stride entry, so a drift of the run is in the subset
+				unsigned long long stride = entries / rungEntries;
+				runAll(survivors, [&](size_t s) {
+					TTreeSimulator *simulator = asTree(s);
+					simulator->SetPath(screenPath.c_str());
+					simulator->SetRanking(&rungRanking, cacheTasks[s].name);
+					simulator->SetCheckpoint(nullptr, cacheTasks[s].journal, 0);
+					simulator->AddReader(std::make_unique<StridedTraceReader>(traceReader.Clone(), stride));
+					timedRun(simulator, (unsigned int)rungEntries);
+					simulator->Release();
+				}, rungRanking, false);
+				rungRanking.Write(simPath + "screen" + std::to_string(rung) + ".csv");
+
+				// rank the indices of the survivors, the ones without estimate are the last
+				std::vector<ResolutionEstimate> estimates(survivors.size());
+				for (size_t i = 0; i != survivors.size(); ++i) rungRanking.Find(cacheTasks[survivors[i]].name, estimates[i]);
+				std::vector<size_t> ranked(survivors.size());
+				for (size_t i = 0; i != ranked.size(); ++i) ranked[i] = i;
+				std::stable_sort(ranked.begin(), ranked.end(), [&](size_t a, size_t b) {
+					return rungRanking.Better(estimates[a], estimates[b]);
+				});
+				size_t keep = std::min(survivors.size(), std::max(halvingTop, (survivors.size() + halvingEta - 1) / halvingEta));
+				std::cout << "Rung " << rung << "  entries " << rungEntries
+					<< "  configurations " << survivors.size() << "  keep " << keep << std::endl;
+				std::vector<size_t> kept;
+				for (size_t r = 0; r != keep; ++r) kept.push_back(survivors[ranked[r]]);
+				survivors = kept;
+				rungEntries *= halvingEta;
 			}
+			// the survivors run on all entries into the outputs of the sweep
+			for (size_t s : survivors) {
+				TTreeSimulator *simulator = asTree(s);
+				simulator->SetPath(simPath.c_str());
+				simulator->SetRanking(ranking.get(), cacheTasks[s].name);
+				if (checkpoint) simulator->SetCheckpoint(checkpoint.get(), cacheTasks[s].journal, checkpointEntries);
+			}
+			std::filesystem::remove_all(screenPath);
+		}
+
+		// the survivors of the same fast filter in passes of at most fuse, smaller if there would
+		// be fewer passes than threads of the pool
+		std::vector<size_t> leaders(survivors);
+		if (fuse > 1 && !processes && !pipelineWorkers && !sharedTable && js["Simulator"] == "tree") {
+			std::map<size_t, std::vector<size_t>> groups;
+			for (size_t s : survivors) groups[fastIndices[s]].push_back(s);
+			size_t passSize = fuse;
+			auto passes = [&](size_t size) {
+				size_t count = 0;
+				for (auto &group : groups) count += (group.second.size() + size - 1) / size;
+				return count;
+			};
+			while (pool && passSize > 1 && passes(passSize) < threads) --passSize;
+			leaders.clear();
+			for (auto &group : groups) {
+				std::vector<size_t> &members = group.second;
+				for (size_t i = 0; i < members.size(); i += passSize) {
+					leaders.push_back(members[i]);
+					fused[members[i]].assign(members.begin() + i + 1, members.begin() + std::min(i + passSize, members.size()));
+				}
+			}
+		}
+		runAll(leaders, runSimulator, *ranking, true);
+		if (cache) cache->Evict();
+		// the whole sweep completed, the next run starts again
+		if (checkpoint) checkpoint->Remove();
+		// metadata of the configurations after all runs
+		if (sharedTable) sharedTable->Close();
+		if (js["Simulator"] == "tree") {
+			std::cout << "Ranking:" << std::endl;
+			ranking->Print(std::cout, rankingTop);
+			ranking->Write(simPath + "ranking.csv");
+		}
+		if (pool) {
+			std::chrono::duration<double> wall = std::chrono::steady_clock::now() - sweepStart;
+			std::cout << "Scaling:" << std::endl << scaling.Summary(wall.count());
+			scaling.Write(simPath + "scaling.json", wall.count());
 		}
 	} catch (const std::exception &e) {
 		std::cerr << e.what() << std::endl;
-		exit(-1);
+		return 1;
 	}
 
 	// for (auto ipf : ipfs) {
 	// 	ipf->Close();
 	// }
+	return 0;
 }
 
 
@@ -584,9 +1295,59 @@ void TTreeSimulate(const char *configFileName) {
 
 
 
+int TTreeSimulate(const char *configFileName) {
+	std::ifstream configFile(configFileName);
+	if (!configFile.good()) {
+		std::cerr << "Error open file " << configFileName << std::endl;
+		return 1;
+	}
+	nlohmann::json js;
+	configFile >> js;
+	configFile.close();
+	return TTreeSimulate(js);
+}
+
+
+// Serve the sweeps on the socket, the traces of the requests stay decoded in
+// the shared memory mapped by the daemon and the requests attach them
+void ServeSweeps(const char *socketPath, size_t jobs) {
+	std::map<std::string, std::unique_ptr<SharedTraceReader>> resident;
+	SimDaemon daemon(socketPath, jobs);
+	daemon.Serve([&](nlohmann::json &js) {
+		std::string traceFileName = std::string(js["TracePath"]) + std::string(js["TraceFile"]);
+		unsigned int dt = 1000 / (unsigned int)(js["SamplingRate"]);
+		std::string segmentName = SharedTraceReader::SegmentName(ResultCache::FileIdentity(traceFileName));
+		if (!resident.count(segmentName)) {
+			resident[segmentName] = std::make_unique<SharedTraceReader>(segmentName, traceFileName.c_str(), "tree", dt);
+		}
+		js["SharedTrace"] = true;
+	}, [](nlohmann::json &js) {
+		return TTreeSimulate(js);
+	});
+}
+
+
+// sim config.json
+// sim -d socket [jobs], serve the sweeps on the socket, jobs at a time
+// sim -r socket config.json, run the sweep in the daemon and print its output
 int main(int argc, char **argv) {
 
 	// ExpDecayMWDSim();
-	TTreeSimulate(argv[1]);
-	return 0;
+	try {
+		if (argc >= 3 && std::string(argv[1]) == "-d") {
+			ServeSweeps(argv[2], argc >= 4 ? size_t(std::stoul(argv[3])) : 1);
+			return 0;
+		}
+		if (argc >= 4 && std::string(argv[1]) == "-r") {
+			return SimDaemon::Request(argv[2], argv[3]);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " config.json | -d socket [jobs] | -r socket config.json" << std::endl;
+		return -1;
+	}
+	return TTreeSimulate(argv[1]);
 }